@@ -0,0 +1,130 @@
+#!/usr/bin/env python3
+"""Cost of getting events into Python through ctypes.
+
+Runs the simulated devices of libdevice_manager.so as fast as possible and
+compares the legacy by-value DeviceEvent callback with a raw callback that
+receives a pointer, and with draining the event queue in batches.
+
+Usage: python3 ctypes_bench.py [path/to/libdevice_manager.so] [devices] [reports_per_device]
+"""
+
+import ctypes
+import sys
+import time
+
+DEVICE_REPORT_MAX = 64
+DEVICE_REPLAY_FAST = 1
+DEVICE_QUEUE_BLOCK = 2
+
+class DeviceEvent(ctypes.Structure):
+    _fields_ = [
+        ("device_id", ctypes.c_int),
+        ("vendor_id", ctypes.c_int),
+        ("product_id", ctypes.c_int),
+        ("serial_number", ctypes.c_char * 64),
+        ("event_type", ctypes.c_char * 32),
+        ("type", ctypes.c_char * 32),
+        ("value", ctypes.c_char * 256),
+    ]
+
+class DeviceRawEvent(ctypes.Structure):
+    _fields_ = [
+        ("timestamp_ns", ctypes.c_uint64),
+        ("sequence", ctypes.c_uint32),
+        ("device_id", ctypes.c_int32),
+        ("vendor_id", ctypes.c_uint16),
+        ("product_id", ctypes.c_uint16),
+        ("kind", ctypes.c_uint8),
+        ("interface_number", ctypes.c_uint8),
+        ("endpoint", ctypes.c_uint8),
+        ("flags", ctypes.c_uint8),
+        ("length", ctypes.c_uint16),
+        ("generation", ctypes.c_uint16),
+        ("data", ctypes.c_uint8 * DEVICE_REPORT_MAX),
+    ]
+
+LEGACY_CALLBACK = ctypes.CFUNCTYPE(None, DeviceEvent)
+RAW_CALLBACK = ctypes.CFUNCTYPE(None, ctypes.POINTER(DeviceRawEvent))
+BATCH_CALLBACK = ctypes.CFUNCTYPE(None, ctypes.POINTER(DeviceRawEvent), ctypes.c_size_t, ctypes.c_void_p)
+
+lib_path = sys.argv[1] if len(sys.argv) > 1 else './libdevice_manager.so'
+devices = int(sys.argv[2]) if len(sys.argv) > 2 else 4
+reports_per_device = int(sys.argv[3]) if len(sys.argv) > 3 else 20000
+
+lib = ctypes.CDLL(lib_path)
+lib.device_manager_set_callback.argtypes = [LEGACY_CALLBACK]
+lib.device_manager_set_raw_callback.argtypes = [RAW_CALLBACK]
+lib.device_manager_simulate.argtypes = [ctypes.c_int] * 5
+lib.device_manager_simulate.restype = ctypes.c_long
+lib.device_manager_enable_queue.argtypes = [ctypes.c_size_t, ctypes.c_int]
+lib.device_manager_poll.argtypes = [ctypes.POINTER(DeviceRawEvent), ctypes.c_size_t]
+lib.device_manager_poll.restype = ctypes.c_size_t
+lib.device_manager_set_batch_callback.argtypes = [BATCH_CALLBACK, ctypes.c_void_p, ctypes.c_size_t, ctypes.c_int]
+
+count = 0
+
+@LEGACY_CALLBACK
+def legacy_callback(event):
+    global count
+    count += 1
+
+@RAW_CALLBACK
+def raw_callback(event):
+    global count
+    count += 1
+
+@BATCH_CALLBACK
+def batch_callback(events, n, user):
+    global count
+    for i in range(n):
+        event = events[i]
+        count += 1
+
+def simulate():
+    # One report per millisecond of "duration" at the nominal 1 kHz rate
+    return lib.device_manager_simulate(devices, 1000, 16, reports_per_device, DEVICE_REPLAY_FAST)
+
+def report(name, start, events):
+    elapsed = time.perf_counter() - start
+    print(f"{name:<24} {events:>9} events {events / elapsed:>12.0f} events/s {elapsed * 1e6 / events:>8.2f} us/event")
+
+print(f"{devices} simulated devices, {reports_per_device} reports each")
+
+lib.device_manager_set_callback(legacy_callback)
+count = 0
+start = time.perf_counter()
+simulate()
+report("by-value DeviceEvent", start, count)
+
+lib.device_manager_set_raw_callback(raw_callback)
+count = 0
+start = time.perf_counter()
+simulate()
+report("DeviceRawEvent pointer", start, count)
+
+# The queue and batch delivery stay on once enabled, so they run last. The simulation runs in
+# C on this thread, so the queue must hold every event of the run.
+total = devices * (reports_per_device + 2)
+capacity = 1 << max(total - 1, 1).bit_length()
+if lib.device_manager_enable_queue(capacity, DEVICE_QUEUE_BLOCK) == 0:
+    batch = (DeviceRawEvent * 256)()
+    start = time.perf_counter()
+    simulate()
+    consumed = 0
+    while True:
+        n = lib.device_manager_poll(batch, 256)
+        if n == 0:
+            break
+        for i in range(n):
+            event = batch[i]
+            consumed += 1
+    report("queue + poll(256)", start, consumed)
+
+# Batches take precedence over the queue once enabled
+if lib.device_manager_set_batch_callback(batch_callback, None, 256, 250) == 0:
+    count = 0
+    start = time.perf_counter()
+    simulate()
+    while count < total:
+        time.sleep(0.0001)
+    report("batch(256, 250us)", start, count)
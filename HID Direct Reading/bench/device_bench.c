@@ -0,0 +1,221 @@
+// Benchmark for the dispatch path of libdevice_manager. Drives the library
+// with simulated devices (or a capture file) and reports throughput, latency
+// percentiles and heap allocations per event. Needs no USB hardware or root.
+//
+// Build from the "HID Direct Reading" folder:
+//   gcc -O2 -o device_bench bench/device_bench.c libdevice_manager/*.c -Ilibdevice_manager -lusb-1.0 -lpthread -lm
+// Usage:
+//   ./device_bench [devices] [reports_per_device] [capture_file]
+
+#define _GNU_SOURCE
+
+#include "device_manager.h"
+#include "device_stats.h"
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+
+// glibc entry points, used to count allocations without LD_PRELOAD
+extern void* __libc_malloc(size_t size);
+extern void* __libc_calloc(size_t count, size_t size);
+extern void* __libc_realloc(void* ptr, size_t size);
+extern void __libc_free(void* ptr);
+
+static _Atomic uint64_t allocations = 0;
+static LatencyHistogram latency;        // Capture timestamp to callback
+static LatencyHistogram service_time;   // Gap between consecutive callbacks
+static uint64_t last_callback_ns = 0;
+static _Atomic uint64_t events = 0;
+static _Atomic int readers_running = 0;
+static volatile uint64_t sink = 0;      // Keeps callbacks from being optimized out
+
+void* malloc(size_t size) {
+    atomic_fetch_add_explicit(&allocations, 1, memory_order_relaxed);
+    return __libc_malloc(size);
+}
+
+void* calloc(size_t count, size_t size) {
+    atomic_fetch_add_explicit(&allocations, 1, memory_order_relaxed);
+    return __libc_calloc(count, size);
+}
+
+void* realloc(void* ptr, size_t size) {
+    atomic_fetch_add_explicit(&allocations, 1, memory_order_relaxed);
+    return __libc_realloc(ptr, size);
+}
+
+void free(void* ptr) {
+    __libc_free(ptr);
+}
+
+static uint64_t monotonic_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static void note_callback(uint64_t now) {
+    if (last_callback_ns != 0) {
+        stats_record(&service_time, now - last_callback_ns);
+    }
+    last_callback_ns = now;
+    atomic_fetch_add_explicit(&events, 1, memory_order_relaxed);
+}
+
+static void raw_callback(const DeviceRawEvent* event) {
+    uint64_t now = monotonic_ns();
+    stats_record(&latency, now - event->timestamp_ns);
+    sink += event->data[0];
+    note_callback(now);
+}
+
+// DeviceEvent is passed by value, like the ctypes callbacks receive it
+static void legacy_callback(DeviceEvent event) {
+    sink += (uint8_t)event.value[0];
+    note_callback(monotonic_ns());
+}
+
+// Contends on devices_mutex the way a Python thread polling the device table would
+static void* registry_reader(void* /*arg*/) {
+    while (atomic_load_explicit(&readers_running, memory_order_relaxed)) {
+        int slots = get_device_slot_count();
+        for (int i = 0; i < slots; i++) {
+            sink += get_device_handle(i);
+        }
+        sink += (uint64_t)get_device_count();
+    }
+    return NULL;
+}
+
+static void reset_counters() {
+    memset(&latency, 0, sizeof(LatencyHistogram));
+    memset(&service_time, 0, sizeof(LatencyHistogram));
+    last_callback_ns = 0;
+    atomic_store(&events, 0);
+}
+
+static void print_histogram(const char* label, LatencyHistogram* histogram) {
+    DeviceLatencySummary summary;
+    stats_summarize(histogram, &summary);
+    if (summary.count == 0) {
+        return;
+    }
+    printf("    %-14s p50=%6lluns p99=%6lluns p99.9=%7lluns max=%8lluns\n", label,
+           (unsigned long long)summary.p50_ns, (unsigned long long)summary.p99_ns,
+           (unsigned long long)summary.p999_ns, (unsigned long long)summary.max_ns);
+}
+
+static void report(const char* name, uint64_t start_ns, uint64_t end_ns, uint64_t allocations_before) {
+    uint64_t count = atomic_load(&events);
+    uint64_t allocated = atomic_load(&allocations) - allocations_before;
+    double seconds = (double)(end_ns - start_ns) / 1e9;
+    printf("%-22s %10llu events %12.0f events/s %8.3f allocs/event\n", name, (unsigned long long)count,
+           seconds > 0 ? (double)count / seconds : 0.0, count > 0 ? (double)allocated / (double)count : 0.0);
+    print_histogram("latency", &latency);
+    print_histogram("service time", &service_time);
+}
+
+// Fast-mode simulation: reports_per_device at a nominal 1 kHz, one per millisecond of duration
+static void run_simulation(const char* name, int devices, int reports_per_device) {
+    reset_counters();
+    uint64_t allocations_before = atomic_load(&allocations);
+    uint64_t start = monotonic_ns();
+    device_manager_simulate(devices, 1000, 16, reports_per_device, DEVICE_REPLAY_FAST);
+    report(name, start, monotonic_ns(), allocations_before);
+}
+
+static void batch_callback(const DeviceRawEvent* batch, size_t count, void* user) {
+    (void)user;
+    uint64_t now = monotonic_ns();
+    for (size_t i = 0; i < count; i++) {
+        stats_record(&latency, now - batch[i].timestamp_ns);
+        sink += batch[i].data[0];
+    }
+    note_callback(now);
+    atomic_fetch_add_explicit(&events, count - 1, memory_order_relaxed);
+}
+
+static void* queue_consumer(void* arg) {
+    uint64_t expected = *(uint64_t*)arg;
+    DeviceRawEvent batch[256];
+    while (atomic_load_explicit(&events, memory_order_relaxed) < expected) {
+        size_t count = device_manager_poll(batch, 256);
+        uint64_t now = monotonic_ns();
+        for (size_t i = 0; i < count; i++) {
+            stats_record(&latency, now - batch[i].timestamp_ns);
+            note_callback(now);
+        }
+    }
+    return NULL;
+}
+
+int main(int argc, char** argv) {
+    int devices = argc > 1 ? atoi(argv[1]) : 8;
+    int reports_per_device = argc > 2 ? atoi(argv[2]) : 100000;
+    const char* capture = argc > 3 ? argv[3] : NULL;
+    if (devices <= 0 || reports_per_device <= 0) {
+        fprintf(stderr, "Usage: %s [devices] [reports_per_device] [capture_file]\n", argv[0]);
+        return 1;
+    }
+    printf("%d simulated devices, %d reports each\n", devices, reports_per_device);
+
+    device_manager_set_raw_callback(raw_callback);
+    run_simulation("raw callback", devices, reports_per_device);
+
+    device_manager_set_callback(legacy_callback);
+    run_simulation("legacy DeviceEvent", devices, reports_per_device);
+
+    device_manager_set_raw_callback(raw_callback);
+    pthread_t readers[2];
+    atomic_store(&readers_running, 1);
+    for (int i = 0; i < 2; i++) {
+        pthread_create(&readers[i], NULL, registry_reader, NULL);
+    }
+    run_simulation("raw + 2 table readers", devices, reports_per_device);
+    atomic_store(&readers_running, 0);
+    for (int i = 0; i < 2; i++) {
+        pthread_join(readers[i], NULL);
+    }
+
+    if (capture != NULL) {
+        reset_counters();
+        uint64_t allocations_before = atomic_load(&allocations);
+        uint64_t start = monotonic_ns();
+        if (device_manager_replay(capture, DEVICE_REPLAY_FAST) < 0) {
+            return 1;
+        }
+        report("replay", start, monotonic_ns(), allocations_before);
+    }
+
+    // Neither the queue nor batch delivery can be turned off again, so they run last
+    if (device_manager_enable_queue(1 << 16, DEVICE_QUEUE_BLOCK) == 0) {
+        reset_counters();
+        // Connect and disconnect events are queued too
+        uint64_t expected = (uint64_t)devices * (uint64_t)reports_per_device + 2 * (uint64_t)devices;
+        pthread_t consumer;
+        uint64_t allocations_before = atomic_load(&allocations);
+        uint64_t start = monotonic_ns();
+        pthread_create(&consumer, NULL, queue_consumer, &expected);
+        device_manager_simulate(devices, 1000, 16, reports_per_device, DEVICE_REPLAY_FAST);
+        pthread_join(consumer, NULL);
+        report("queue + poll(256)", start, monotonic_ns(), allocations_before);
+    }
+
+    // Batches take precedence over the queue; service time is per batch here
+    if (device_manager_set_batch_callback(batch_callback, NULL, 256, 250) == 0) {
+        reset_counters();
+        uint64_t expected = (uint64_t)devices * (uint64_t)reports_per_device + 2 * (uint64_t)devices;
+        uint64_t allocations_before = atomic_load(&allocations);
+        uint64_t start = monotonic_ns();
+        device_manager_simulate(devices, 1000, 16, reports_per_device, DEVICE_REPLAY_FAST);
+        while (atomic_load(&events) < expected) {
+            sched_yield();
+        }
+        report("batch(256, 250us)", start, monotonic_ns(), allocations_before);
+    }
+    return 0;
+}
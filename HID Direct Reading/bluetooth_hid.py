@@ -77,15 +77,20 @@ lib.clean_up_devices.restype = None
 lib.get_device_count.argtypes = []
 lib.get_device_count.restype = ctypes.c_int
 
-class Device(ctypes.Structure):
+# Mirrors DeviceInfo, which unlike Device does not change with the backends
+class DeviceInfo(ctypes.Structure):
     _fields_ = [("device_index", ctypes.c_int),
-                ("joystick", ctypes.c_void_p),
-                ("device_name", ctypes.c_char * 128),
+                ("backend", ctypes.c_int),
                 ("vendor_id", ctypes.c_int),
-                ("product_id", ctypes.c_int)]
+                ("product_id", ctypes.c_int),
+                ("handle", ctypes.c_uint32),
+                ("device_name", ctypes.c_char * 128),
+                ("key", ctypes.c_char * 96)]
 
-lib.get_device.argtypes = [ctypes.c_int]
-lib.get_device.restype = ctypes.POINTER(Device)
+lib.get_device_slot_count.argtypes = []
+lib.get_device_slot_count.restype = ctypes.c_int
+lib.get_device_info.argtypes = [ctypes.c_int, ctypes.POINTER(DeviceInfo)]
+lib.get_device_info.restype = ctypes.c_int
 
 # Bluetooth setup
 server_sock = bluetooth.BluetoothSocket(bluetooth.RFCOMM)
@@ -108,10 +113,9 @@ def detect_devices_thread():
             descriptor_sent = False  # Reset the flag when Bluetooth is not ready
         else:
             if not descriptor_sent:
-                device_count = lib.get_device_count()
-                for i in range(device_count):
-                    device = lib.get_device(i)
-                    if device and device.contents:
+                info = DeviceInfo()
+                for i in range(lib.get_device_slot_count()):
+                    if lib.get_device_info(i, ctypes.byref(info)) == 0:
                         # Send HID report descriptor here if not sent
                         descriptor_sent = True
                         break
@@ -0,0 +1,148 @@
+#include "axis_filter.h"
+#include <math.h>
+#include <string.h>
+
+#define TWO_PI 6.28318530718f
+#define SNAP 1.5e-5f            // Half a step of a 16-bit axis: closer than this is the target
+
+// Passthrough: every change is reported unmodified.
+void axis_filter_init(AxisFilterBank* bank, int count) {
+    memset(bank, 0, sizeof(AxisFilterBank));
+    bank->count = count < AXIS_FILTER_MAX ? count : AXIS_FILTER_MAX;
+    for (int i = 0; i < AXIS_FILTER_MAX; ++i) {
+        bank->ema_alpha[i] = 1.0f;
+        bank->min_cutoff[i] = 1.0f;
+        bank->derivative_cutoff[i] = 1.0f;
+    }
+}
+
+void axis_filter_configure(AxisFilterBank* bank, int axis, const AxisFilterConfig* config) {
+    if (axis < 0 || axis >= AXIS_FILTER_MAX) {
+        return;
+    }
+    bank->deadzone[axis] = fminf(fmaxf(config->deadzone, 0.0f), 0.99f);
+    bank->hysteresis[axis] = fmaxf(config->hysteresis, 0.0f);
+    bank->min_interval[axis] = config->max_rate_hz > 0.0f ? 1.0f / config->max_rate_hz : 0.0f;
+    bank->mode[axis] = (float)config->smoothing;
+    bank->ema_alpha[axis] = config->ema_alpha > 0.0f && config->ema_alpha <= 1.0f ? config->ema_alpha : 1.0f;
+    bank->min_cutoff[axis] = config->min_cutoff_hz > 0.0f ? config->min_cutoff_hz : 1.0f;
+    bank->beta[axis] = fmaxf(config->beta, 0.0f);
+    bank->derivative_cutoff[axis] = config->derivative_cutoff_hz > 0.0f ? config->derivative_cutoff_hz : 1.0f;
+}
+
+// Plain compare-and-select rather than fmaxf(), whose NaN rules keep it scalar.
+static inline float positive_part(float value) {
+    return value > 0.0f ? value : 0.0f;
+}
+
+// Smoothing factor of a first-order low-pass filter with cutoff fc at step dt.
+static inline float low_pass_alpha(float cutoff, float dt) {
+    float tau = TWO_PI * cutoff * dt;
+    return tau / (1.0f + tau);
+}
+
+// Smoothing, hysteresis and rate limiting over bank->target. A flush waives
+// the hysteresis for axes that settled on their input and stayed idle.
+static int filter_step(AxisFilterBank* bank, uint64_t timestamp_ns, int flush) {
+    int count = bank->count;
+    float dt = bank->primed ? (float)(timestamp_ns - bank->last_ns) * 1e-9f : 0.001f;
+    dt = dt > 1e-5f ? dt : 1e-5f;
+    bank->last_ns = timestamp_ns;
+    float* target = bank->target;
+    int idle = flush && timestamp_ns - bank->input_ns >= AXIS_FILTER_SETTLE_NS;
+
+    if (!bank->primed) {
+        for (int i = 0; i < count; ++i) {
+            bank->smoothed[i] = target[i];
+            bank->reported[i] = 0.0f;
+            bank->since_report[i] = 1e9f;
+        }
+        bank->primed = 1;
+    }
+
+    for (int i = 0; i < count; ++i) {
+        float speed = (target[i] - bank->smoothed[i]) / dt;
+        float derivative = bank->derivative[i] + low_pass_alpha(bank->derivative_cutoff[i], dt) * (speed - bank->derivative[i]);
+        float euro = low_pass_alpha(bank->min_cutoff[i] + bank->beta[i] * fabsf(derivative), dt);
+        float mode = bank->mode[i];
+        float ema_alpha = bank->ema_alpha[i];
+        float ema = mode == (float)AXIS_SMOOTHING_EMA ? ema_alpha : 1.0f;
+        // Blend instead of select so the division above is not sunk into a branch
+        float is_euro = (float)(mode == (float)AXIS_SMOOTHING_ONE_EURO);
+        float alpha = ema + is_euro * (euro - ema);
+        bank->derivative[i] = derivative;
+        float smoothed = bank->smoothed[i] + alpha * (target[i] - bank->smoothed[i]);
+        // Let a released stick settle on exactly zero instead of an endless tail
+        float hysteresis = bank->hysteresis[i];
+        int settle = (target[i] == 0.0f) & (fabsf(smoothed) < hysteresis);
+        // and any other one on its input, so a flush can end
+        int snap = fabsf(target[i] - smoothed) < SNAP;
+        bank->smoothed[i] = settle ? 0.0f : snap ? target[i] : smoothed;
+    }
+
+    int changed = 0;
+    for (int i = 0; i < count; ++i) {
+        float delta = fabsf(bank->smoothed[i] - bank->reported[i]);
+        float since = bank->since_report[i] + dt;
+        int settled = idle & (bank->smoothed[i] == target[i]);
+        int moved = (delta > 0.0f) & ((delta >= bank->hysteresis[i]) | (bank->smoothed[i] == 0.0f) | settled);
+        int report = moved & (since >= bank->min_interval[i]);
+        bank->reported[i] = report ? bank->smoothed[i] : bank->reported[i];
+        bank->since_report[i] = report ? 0.0f : since;
+        bank->changed[i] = (uint8_t)report;
+        changed += report;
+    }
+    return changed;
+}
+
+// Runs deadzone, smoothing, hysteresis and rate limiting over bank->input.
+// Sets bank->changed for the axes whose reported value moved and returns how many.
+int axis_filter_process(AxisFilterBank* bank, uint64_t timestamp_ns) {
+    for (int i = 0; i < bank->count; ++i) {
+        float x = bank->input[i];
+        float magnitude = positive_part(fabsf(x) - bank->deadzone[i]) / (1.0f - bank->deadzone[i]);
+        bank->target[i] = copysignf(magnitude, x);
+    }
+    bank->input_ns = timestamp_ns;
+    return filter_step(bank, timestamp_ns, 0);
+}
+
+// Same with the last input, for a device that stopped reporting: lets the
+// smoothing converge and rate-limited changes through. Call at
+// axis_filter_due(); like axis_filter_process(), returns the changed axes.
+int axis_filter_flush(AxisFilterBank* bank, uint64_t now_ns) {
+    if (!bank->primed || now_ns <= bank->last_ns) {
+        memset(bank->changed, 0, sizeof(bank->changed));
+        return 0;
+    }
+    return filter_step(bank, now_ns, 1);
+}
+
+// When axis_filter_flush() has something to do, or 0 once every axis reports
+// its input.
+uint64_t axis_filter_due(const AxisFilterBank* bank) {
+    if (!bank->primed) {
+        return 0;
+    }
+    uint64_t due = 0;
+    for (int i = 0; i < bank->count; ++i) {
+        float target = bank->target[i];
+        if (bank->reported[i] == target) {
+            continue;
+        }
+        float wait = bank->min_interval[i] - bank->since_report[i];
+        uint64_t rate_due = bank->last_ns + (wait > 0.0f ? (uint64_t)(wait * 1e9f) : 0);
+        uint64_t settle_due = bank->input_ns + AXIS_FILTER_SETTLE_NS;
+        uint64_t axis_due;
+        if (bank->smoothed[i] != target) {
+            axis_due = bank->last_ns + AXIS_FILTER_STEP_NS;     // Still converging
+        } else if (fabsf(target - bank->reported[i]) >= bank->hysteresis[i] || target == 0.0f) {
+            axis_due = rate_due;                                // Held by the rate limit
+        } else {
+            axis_due = settle_due > rate_due ? settle_due : rate_due;  // Below the hysteresis
+        }
+        due = due == 0 || axis_due < due ? axis_due : due;
+    }
+    // At least a millisecond out, so callers never spin on it
+    return due != 0 && due < bank->last_ns + 1000000ull ? bank->last_ns + 1000000ull : due;
+}
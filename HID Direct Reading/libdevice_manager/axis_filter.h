@@ -0,0 +1,68 @@
+#ifndef AXIS_FILTER_H
+#define AXIS_FILTER_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#define AXIS_FILTER_MAX 32      // Axes filtered per interface
+#define AXIS_FILTER_STEP_NS 10000000ull     // Flush step while an idle axis catches up
+#define AXIS_FILTER_SETTLE_NS 100000000ull  // Idle time before a change below the hysteresis is reported
+
+typedef enum {
+    AXIS_SMOOTHING_NONE = 0,
+    AXIS_SMOOTHING_EMA,         // Exponential moving average with a fixed alpha
+    AXIS_SMOOTHING_ONE_EURO,    // Casiez et al.: cutoff rises with the speed of the stick
+} AxisSmoothing;
+
+// Values are fractions of full scale (an axis spans -1..1).
+typedef struct {
+    float deadzone;             // |x| below this reads as 0; the rest is rescaled to 0..1
+    float hysteresis;           // Smallest change that is reported
+    float max_rate_hz;          // Reported changes per second, 0 = unlimited
+    int smoothing;              // AxisSmoothing
+    float ema_alpha;            // 0..1, weight of the newest sample
+    float min_cutoff_hz;        // One-euro: cutoff at rest
+    float beta;                 // One-euro: cutoff increase per unit/s of speed
+    float derivative_cutoff_hz; // One-euro: smoothing of the speed estimate
+} AxisFilterConfig;
+
+// Structure of arrays so every stage is a straight loop over the axes that
+// the compiler can vectorize; per-axis modes are selects, not branches.
+typedef struct {
+    int count;
+    int primed;
+    uint64_t last_ns;
+    // Configuration
+    float deadzone[AXIS_FILTER_MAX];
+    float hysteresis[AXIS_FILTER_MAX];
+    float min_interval[AXIS_FILTER_MAX];    // Seconds between reported changes
+    float mode[AXIS_FILTER_MAX];            // AxisSmoothing as float, for the selects
+    float ema_alpha[AXIS_FILTER_MAX];
+    float min_cutoff[AXIS_FILTER_MAX];
+    float beta[AXIS_FILTER_MAX];
+    float derivative_cutoff[AXIS_FILTER_MAX];
+    // State
+    uint64_t input_ns;                      // Last axis_filter_process(), flushes excluded
+    float input[AXIS_FILTER_MAX];           // Latest raw value, -1..1
+    float target[AXIS_FILTER_MAX];          // input after the deadzone
+    float smoothed[AXIS_FILTER_MAX];
+    float derivative[AXIS_FILTER_MAX];
+    float reported[AXIS_FILTER_MAX];        // Last value let through
+    float since_report[AXIS_FILTER_MAX];    // Seconds
+    uint8_t changed[AXIS_FILTER_MAX];       // Set by the last axis_filter_process()
+} AxisFilterBank;
+
+void axis_filter_init(AxisFilterBank* bank, int count);
+void axis_filter_configure(AxisFilterBank* bank, int axis, const AxisFilterConfig* config);
+int axis_filter_process(AxisFilterBank* bank, uint64_t timestamp_ns);
+int axis_filter_flush(AxisFilterBank* bank, uint64_t now_ns);
+uint64_t axis_filter_due(const AxisFilterBank* bank);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // AXIS_FILTER_H
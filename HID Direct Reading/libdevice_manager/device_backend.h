@@ -0,0 +1,43 @@
+#ifndef DEVICE_BACKEND_H
+#define DEVICE_BACKEND_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "device_manager.h"
+
+// A source of devices. Each backend runs its own discovery and reader
+// threads, registers the devices device_backend_for() assigns to it with
+// backend_add_device() and delivers their reports with backend_report(),
+// so capture, queues, batching and stats work the same for all of them.
+typedef struct {
+    DeviceBackendKind kind;
+    const char* name;
+    int (*available)(void);     // Usable on this machine (library present, devices readable)
+    int (*start)(void);         // Starts the threads; 0 or -1
+    void (*stop)(void);         // Asks the threads to exit, never blocks
+    void (*join)(void);         // Waits for them, disconnects its devices and frees everything
+} DeviceBackend;
+
+extern const DeviceBackend usb_backend;
+extern const DeviceBackend evdev_backend;
+extern const DeviceBackend hidraw_backend;
+#ifdef DEVICE_WITH_SDL
+extern const DeviceBackend sdl_backend;
+#endif
+
+DeviceBackendKind device_backend_for(int vendor_id, int product_id);
+int backend_add_device(const Device* candidate);
+void backend_report(Device* device, DeviceRawEvent* event, size_t length);
+void backend_remove_device(int slot);
+void backend_compile_layout(DeviceInterface* interface);
+int backend_flush_filters(DeviceBackendKind backend);
+void backend_init_event(DeviceRawEvent* event, Device* device, DeviceEventKind kind);
+uint64_t backend_time_ns();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // DEVICE_BACKEND_H
@@ -0,0 +1,207 @@
+#include "device_cache.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CACHE_INDEX_SIZE (DEVICE_CACHE_MAX * 2)
+
+typedef struct ArenaChunk {
+    struct ArenaChunk* next;
+    size_t used;
+    size_t size;
+    _Alignas(16) unsigned char data[];
+} ArenaChunk;
+
+typedef struct {
+    uint64_t hash;
+    DeviceMetadata* metadata;   // NULL when the entry is empty
+} CacheEntry;
+
+static pthread_mutex_t cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+static ArenaChunk* arena = NULL;
+static CacheEntry cache_index[CACHE_INDEX_SIZE];
+static int cache_count = 0;
+
+// Must be called with cache_mutex held.
+static void* arena_alloc(size_t size) {
+    size = (size + 15) & ~(size_t)15;
+    if (arena == NULL || arena->used + size > arena->size) {
+        size_t chunk_size = size > DEVICE_CACHE_ARENA_CHUNK ? size : DEVICE_CACHE_ARENA_CHUNK;
+        ArenaChunk* chunk = malloc(sizeof(ArenaChunk) + chunk_size);
+        if (chunk == NULL) {
+            return NULL;
+        }
+        chunk->next = arena;
+        chunk->used = 0;
+        chunk->size = chunk_size;
+        arena = chunk;
+    }
+    void* memory = arena->data + arena->used;
+    arena->used += size;
+    return memory;
+}
+
+static const char* arena_strdup(const char* text) {
+    size_t length = strlen(text);
+    char* copy = arena_alloc(length + 1);
+    if (copy != NULL) {
+        memcpy(copy, text, length + 1);
+    }
+    return copy != NULL ? copy : "";
+}
+
+static uint64_t hash_key(const char* key) {
+    uint64_t hash = 14695981039346656037ull;  // FNV-1a
+    for (; *key; ++key) {
+        hash = (hash ^ (uint8_t)*key) * 1099511628211ull;
+    }
+    return hash;
+}
+
+// A port path and serial can come back as another device (a different
+// product plugged into the same port, devices without serial numbers, new
+// firmware), so the entry only matches if the identity is the same too.
+static int same_identity(const DeviceMetadata* metadata, const Device* device, int bcd_device) {
+    return metadata->vendor_id == (uint16_t)device->vendor_id && metadata->product_id == (uint16_t)device->product_id &&
+           (bcd_device < 0 || metadata->bcd_device == (uint16_t)bcd_device);
+}
+
+// Finds the metadata of the device's key, or creates it from the device.
+// bcd_device is the device release, -1 when the backend does not know it.
+// An entry whose vendor, product or release differ is replaced by a new one;
+// the old one stays in the arena for connections still using it. NULL once
+// DEVICE_CACHE_MAX identities are known (or without memory); the device then
+// works as before, just without the cache.
+DeviceMetadata* device_cache_get(const Device* device, int bcd_device, int* created) {
+    uint64_t hash = hash_key(device->key);
+    size_t pos = (size_t)(hash % CACHE_INDEX_SIZE);
+    *created = 0;
+
+    pthread_mutex_lock(&cache_mutex);
+    int replace = 0;
+    while (cache_index[pos].metadata != NULL) {
+        if (cache_index[pos].hash == hash && strcmp(cache_index[pos].metadata->key, device->key) == 0) {
+            DeviceMetadata* metadata = cache_index[pos].metadata;
+            if (same_identity(metadata, device, bcd_device)) {
+                pthread_mutex_unlock(&cache_mutex);
+                return metadata;
+            }
+            replace = 1;
+            break;
+        }
+        pos = (pos + 1) % CACHE_INDEX_SIZE;
+    }
+
+    DeviceMetadata* metadata = NULL;
+    if (replace || cache_count < DEVICE_CACHE_MAX) {
+        metadata = arena_alloc(sizeof(DeviceMetadata));
+    } else if (cache_count++ == DEVICE_CACHE_MAX) {
+        fprintf(stderr, "Device metadata cache full, new devices are not cached\n");
+    }
+    if (metadata != NULL) {
+        memset(metadata, 0, sizeof(DeviceMetadata));
+        memcpy(metadata->key, device->key, sizeof(metadata->key));
+        metadata->vendor_id = (uint16_t)device->vendor_id;
+        metadata->product_id = (uint16_t)device->product_id;
+        metadata->bcd_device = bcd_device >= 0 ? (uint16_t)bcd_device : 0;
+        metadata->backend = device->backend;
+        metadata->manufacturer = "";
+        metadata->product = "";
+        metadata->serial = "";
+        snprintf(metadata->event_name, sizeof(metadata->event_name), "%.63s", device->device_name);
+        cache_index[pos].hash = hash;
+        cache_index[pos].metadata = metadata;
+        cache_count += !replace;
+        *created = 1;
+    } else if (replace) {
+        // Without memory for a new entry the stale one must not be found again
+        cache_index[pos].hash = ~hash;
+    }
+    pthread_mutex_unlock(&cache_mutex);
+    return metadata;
+}
+
+// Copies a string into the arena; "" if there is no memory left.
+const char* device_cache_string(const char* text) {
+    pthread_mutex_lock(&cache_mutex);
+    const char* copy = arena_strdup(text);
+    pthread_mutex_unlock(&cache_mutex);
+    return copy;
+}
+
+static DeviceMetadataInterface* find_cached_interface(DeviceMetadata* metadata, uint8_t interface_number) {
+    for (int i = 0; i < metadata->interface_count; ++i) {
+        if (metadata->interfaces[i].interface_number == interface_number) {
+            return &metadata->interfaces[i];
+        }
+    }
+    return NULL;
+}
+
+// Gives the interface the cached descriptor and layout if the device announces
+// a descriptor of the same length. Returns 1 on a hit; on a miss the caller
+// reads the descriptor and hands it to device_cache_adopt().
+int device_cache_use(DeviceMetadata* metadata, DeviceInterface* interface, int descriptor_length) {
+    pthread_mutex_lock(&cache_mutex);
+    DeviceMetadataInterface* cached = find_cached_interface(metadata, interface->interface_number);
+    int hit = cached != NULL && cached->descriptor_length == descriptor_length;
+    if (hit) {
+        interface->report_descriptor = (unsigned char*)cached->descriptor;
+        interface->report_descriptor_length = cached->descriptor_length;
+        interface->layout = (HidLayout*)cached->layout;
+        interface->cached = 1;
+    }
+    pthread_mutex_unlock(&cache_mutex);
+
+    // Field values change with every report, so they stay per connection
+    if (hit && interface->layout != NULL) {
+        interface->field_values = calloc((size_t)interface->layout->field_count, sizeof(int32_t));
+        if (interface->field_values == NULL) {
+            interface->layout = NULL;
+        }
+    }
+    return hit;
+}
+
+// Moves a freshly read descriptor and its layout into the arena (or onto an
+// identical cached copy) and frees the heap copies of the interface.
+void device_cache_adopt(DeviceMetadata* metadata, DeviceInterface* interface) {
+    if (interface->cached || interface->report_descriptor == NULL || interface->report_descriptor_length <= 0) {
+        return;
+    }
+    pthread_mutex_lock(&cache_mutex);
+    DeviceMetadataInterface* cached = find_cached_interface(metadata, interface->interface_number);
+    int same = cached != NULL && cached->descriptor_length == interface->report_descriptor_length &&
+               memcmp(cached->descriptor, interface->report_descriptor, (size_t)cached->descriptor_length) == 0 &&
+               (cached->layout != NULL) == (interface->layout != NULL);
+    if (!same) {
+        if (cached == NULL && metadata->interface_count < DEVICE_MAX_INTERFACES) {
+            cached = &metadata->interfaces[metadata->interface_count];
+        }
+        unsigned char* descriptor = cached != NULL ? arena_alloc((size_t)interface->report_descriptor_length) : NULL;
+        HidLayout* layout = descriptor != NULL && interface->layout != NULL ? arena_alloc(sizeof(HidLayout)) : NULL;
+        if (descriptor == NULL || (interface->layout != NULL && layout == NULL)) {
+            pthread_mutex_unlock(&cache_mutex);
+            return;  // Keeps its own copies
+        }
+        memcpy(descriptor, interface->report_descriptor, (size_t)interface->report_descriptor_length);
+        if (layout != NULL) {
+            memcpy(layout, interface->layout, sizeof(HidLayout));
+        }
+        // A replaced entry stays in the arena for connections still using it
+        cached->interface_number = interface->interface_number;
+        cached->descriptor_length = interface->report_descriptor_length;
+        cached->descriptor = descriptor;
+        cached->layout = layout;
+        if (cached == &metadata->interfaces[metadata->interface_count]) {
+            metadata->interface_count++;
+        }
+    }
+    free(interface->report_descriptor);
+    free(interface->layout);
+    interface->report_descriptor = (unsigned char*)cached->descriptor;
+    interface->layout = (HidLayout*)cached->layout;
+    interface->cached = 1;
+    pthread_mutex_unlock(&cache_mutex);
+}
@@ -0,0 +1,26 @@
+#ifndef DEVICE_CACHE_H
+#define DEVICE_CACHE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "device_manager.h"
+
+// Metadata cache keyed by device identity (port path + serial, checked
+// against vendor, product and release). Entries and
+// everything they point to live in an arena that only grows, so a
+// DeviceMetadata* and its descriptors stay valid for the life of the library.
+#define DEVICE_CACHE_MAX 1024           // Identities remembered
+#define DEVICE_CACHE_ARENA_CHUNK (256 * 1024)
+
+DeviceMetadata* device_cache_get(const Device* device, int bcd_device, int* created);
+const char* device_cache_string(const char* text);
+int device_cache_use(DeviceMetadata* metadata, DeviceInterface* interface, int descriptor_length);
+void device_cache_adopt(DeviceMetadata* metadata, DeviceInterface* interface);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // DEVICE_CACHE_H
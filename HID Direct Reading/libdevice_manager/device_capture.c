@@ -0,0 +1,99 @@
+#include "device_capture.h"
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+_Static_assert(sizeof(CaptureHeader) == 64, "capture header layout changed");
+_Static_assert(sizeof(CaptureRecord) == 96, "capture record layout changed");
+
+int capture_writer_open(CaptureWriter* writer, const char* path, uint64_t start_ns) {
+    writer->record_count = 0;
+    writer->file = fopen(path, "wb");
+    if (writer->file == NULL) {
+        fprintf(stderr, "Could not create capture file %s\n", path);
+        return -1;
+    }
+
+    CaptureHeader header;
+    memset(&header, 0, sizeof(CaptureHeader));
+    memcpy(header.magic, CAPTURE_MAGIC, sizeof(CAPTURE_MAGIC));
+    header.version = CAPTURE_VERSION;
+    header.record_size = sizeof(CaptureRecord);
+    header.start_ns = start_ns;
+    if (fwrite(&header, sizeof(CaptureHeader), 1, writer->file) != 1) {
+        fprintf(stderr, "Could not write capture header\n");
+        fclose(writer->file);
+        writer->file = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+// Buffered by stdio; records reach the disk in large writes.
+int capture_writer_append(CaptureWriter* writer, const CaptureRecord* record) {
+    if (writer->file == NULL || fwrite(record, sizeof(CaptureRecord), 1, writer->file) != 1) {
+        return -1;
+    }
+    writer->record_count++;
+    return 0;
+}
+
+void capture_writer_close(CaptureWriter* writer) {
+    if (writer->file == NULL) {
+        return;
+    }
+    // Record count lets readers ignore a partially written trailing record
+    if (fseek(writer->file, offsetof(CaptureHeader, record_count), SEEK_SET) == 0) {
+        fwrite(&writer->record_count, sizeof(uint64_t), 1, writer->file);
+    }
+    fclose(writer->file);
+    writer->file = NULL;
+}
+
+int capture_map(CaptureFile* capture, const char* path) {
+    memset(capture, 0, sizeof(CaptureFile));
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        fprintf(stderr, "Could not open capture file %s\n", path);
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(CaptureHeader)) {
+        fprintf(stderr, "Capture file %s is too short\n", path);
+        close(fd);
+        return -1;
+    }
+
+    void* map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        fprintf(stderr, "Could not map capture file %s\n", path);
+        return -1;
+    }
+
+    const CaptureHeader* header = (const CaptureHeader*)map;
+    if (memcmp(header->magic, CAPTURE_MAGIC, sizeof(CAPTURE_MAGIC)) != 0 ||
+        header->version != CAPTURE_VERSION || header->record_size != sizeof(CaptureRecord)) {
+        fprintf(stderr, "%s is not a supported capture file\n", path);
+        munmap(map, (size_t)st.st_size);
+        return -1;
+    }
+
+    uint64_t available = ((size_t)st.st_size - sizeof(CaptureHeader)) / sizeof(CaptureRecord);
+    capture->map = map;
+    capture->map_size = (size_t)st.st_size;
+    capture->header = header;
+    capture->records = (const CaptureRecord*)((const uint8_t*)map + sizeof(CaptureHeader));
+    capture->record_count = header->record_count != 0 && header->record_count < available ? header->record_count : available;
+    madvise(map, capture->map_size, MADV_SEQUENTIAL);
+    return 0;
+}
+
+void capture_unmap(CaptureFile* capture) {
+    if (capture->map != NULL) {
+        munmap(capture->map, capture->map_size);
+    }
+    memset(capture, 0, sizeof(CaptureFile));
+}
@@ -0,0 +1,94 @@
+#ifndef DEVICE_CAPTURE_H
+#define DEVICE_CAPTURE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Capture files are a 64-byte header followed by fixed-size little-endian
+// records, so a reader can mmap() the file and index records directly. The
+// header only depends on this file, which lets the SDL reader write the same
+// format.
+#define CAPTURE_MAGIC "DEVCAPT"
+#define CAPTURE_VERSION 1
+#define CAPTURE_DATA_MAX 64
+
+typedef enum {
+    CAPTURE_SOURCE_HID = 0,     // Raw report from an interrupt IN endpoint
+    CAPTURE_SOURCE_SDL,         // CaptureSdlInput in data
+} CaptureSource;
+
+typedef enum {
+    CAPTURE_KIND_REPORT = 0,    // Same values as DeviceEventKind
+    CAPTURE_KIND_CONNECTED,
+    CAPTURE_KIND_DISCONNECTED,
+} CaptureKind;
+
+typedef enum {
+    CAPTURE_SDL_AXIS = 0,
+    CAPTURE_SDL_BUTTON,
+    CAPTURE_SDL_HAT,
+} CaptureSdlInputType;
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t record_size;
+    uint64_t start_ns;          // CLOCK_MONOTONIC when the capture was opened
+    uint64_t record_count;      // Patched on close; 0 means "derive from file size"
+    uint8_t reserved[32];
+} CaptureHeader;
+
+typedef struct {
+    uint64_t timestamp_ns;      // CLOCK_MONOTONIC capture time
+    uint32_t sequence;
+    int32_t device_id;
+    uint16_t vendor_id;
+    uint16_t product_id;
+    uint8_t kind;               // CaptureKind
+    uint8_t source;             // CaptureSource
+    uint8_t interface_number;
+    uint8_t endpoint;
+    uint8_t flags;
+    uint8_t reserved;
+    uint16_t length;
+    uint8_t data[CAPTURE_DATA_MAX];
+    uint8_t padding[4];
+} CaptureRecord;
+
+// Payload of CAPTURE_SOURCE_SDL reports.
+typedef struct {
+    uint8_t type;               // CaptureSdlInputType
+    uint8_t index;
+    uint16_t reserved;
+    int32_t value;
+} CaptureSdlInput;
+
+typedef struct {
+    FILE* file;
+    uint64_t record_count;
+} CaptureWriter;
+
+typedef struct {
+    void* map;
+    size_t map_size;
+    const CaptureHeader* header;
+    const CaptureRecord* records;
+    uint64_t record_count;
+} CaptureFile;
+
+int capture_writer_open(CaptureWriter* writer, const char* path, uint64_t start_ns);
+int capture_writer_append(CaptureWriter* writer, const CaptureRecord* record);
+void capture_writer_close(CaptureWriter* writer);
+int capture_map(CaptureFile* capture, const char* path);
+void capture_unmap(CaptureFile* capture);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // DEVICE_CAPTURE_H
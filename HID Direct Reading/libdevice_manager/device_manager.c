@@ -1,26 +1,139 @@
+#define _GNU_SOURCE
+
 #include "device_manager.h"
+#include "device_registry.h"
+#include "device_state.h"
+#include "device_cache.h"
+#include "device_output.h"
+#include "device_backend.h"
+#include "event_queue.h"
+#include "event_batch.h"
+#include "event_frame.h"
+#include "event_shm.h"
+#include "event_net.h"
+#include "device_capture.h"
 #include <stdio.h>
 #include <string.h>
 #include <pthread.h>
 #include <libusb-1.0/libusb.h>
+#include <stdlib.h>
 #include <unistd.h>
+#include <time.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <errno.h>
+#include <math.h>
+
+#define HOTPLUG_QUEUE_SIZE 64
+#define RECOVERY_ATTEMPTS 6         // Failed recoveries in a row before the device is dropped
+#define RECOVERY_BACKOFF_MS 10      // Doubles with every failed attempt
+#define RECOVERY_BACKOFF_MAX_MS 2000
 
 void (*send_data)(DeviceEvent event) = NULL;
+void (*send_raw)(const DeviceRawEvent* event) = NULL;
 
-Device devices[MAX_DEVICES];
 pthread_mutex_t devices_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t transfers_cond = PTHREAD_COND_INITIALIZER;
+static int monitor_wake[2] = {-1, -1};
+
+// Threads and libusb context of the libusb backend. start/stop/join are
+// serialized by lifecycle_mutex and the joining state; the monitor owns
+// everything else.
+typedef struct {
+    libusb_context *context;
+    pthread_t monitor_thread;
+    pthread_t event_thread;
+    int started;                // Monitor thread created and not joined yet
+    _Atomic int running;        // Cleared by device_manager_stop()
+    _Atomic int events_running; // Cleared by the monitor once every transfer is retired
+} DeviceManagerContext;
+
+static DeviceManagerContext manager;
+static pthread_mutex_t lifecycle_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t lifecycle_cond = PTHREAD_COND_INITIALIZER;
+static unsigned started_backends = 0;   // Bit per DeviceBackendKind
+static int stopping = 0;
+static int joining = 0;                 // device_manager_join() waits for the threads without the mutex
+
+#define DEVICE_BACKEND_RULES 32
+
+typedef struct {
+    int vendor_id;
+    int product_id;             // 0 matches every product of the vendor
+    DeviceBackendKind backend;
+} BackendRule;
+
+static pthread_mutex_t backend_mutex = PTHREAD_MUTEX_INITIALIZER;
+static BackendRule backend_rules[DEVICE_BACKEND_RULES];
+static int backend_rule_count = 0;
+static DeviceBackendKind default_backend = DEVICE_BACKEND_LIBUSB;
+static EventQueue event_queue;
+static int queue_enabled = 0;
+static EventBatcher event_batcher;
+static int batch_enabled = 0;
+static EventFramer event_framer;
+static int frame_enabled = 0;
+static EventShmPublisher shm_publisher;
+static int shm_enabled = 0;
+static EventNetStream net_stream;
+static int stream_enabled = 0;
+static int decode_reports = 0;
+static DeviceDedupMode dedup_mode = DEVICE_DEDUP_COUNT;
+static AxisFilterConfig default_filters[AXIS_FILTER_MAX];
+static int default_filters_set = 0;
+static int stats_dump_ms = 0;   // Periodic stats dump to stderr, 0 = off
+static pthread_mutex_t capture_mutex = PTHREAD_MUTEX_INITIALIZER;
+static CaptureWriter capture_writer;
+static int capture_enabled = 0;
+static _Atomic uint32_t virtual_devices = 0;    // Keys handed out to replayed/simulated devices
+
+typedef struct {
+    libusb_device *device;
+    libusb_hotplug_event event;
+} HotplugEntry;
+
+static pthread_mutex_t hotplug_mutex = PTHREAD_MUTEX_INITIALIZER;
+static HotplugEntry hotplug_queue[HOTPLUG_QUEUE_SIZE];
+static int hotplug_head = 0;
+static int hotplug_count = 0;
+static int rescan_needed = 0;  // Full rescan requested (queue overflow or deferred connect)
+
+static void cancel_device_transfers(Device *device);
+static void close_device(Device *device);
+static void wake_monitor();
 
 void clean_up_devices() {
+    device_manager_stop();
+    device_manager_join();
+
+    // Only replayed or simulated devices can be left at this point
     pthread_mutex_lock(&devices_mutex);
-    for (int i = 0; i < MAX_DEVICES; ++i) {
-        if (devices[i].handle != NULL) {
-            libusb_release_interface(devices[i].handle, 0);
-            libusb_close(devices[i].handle);
-            devices[i].handle = NULL;
-        }
+    for (int i = 0; i < registry_slot_count(); ++i) {
+        registry_release(i);
     }
     pthread_mutex_unlock(&devices_mutex);
-    libusb_exit(NULL);
+    if (batch_enabled) {
+        batch_enabled = 0;
+        event_batcher_stop(&event_batcher);  // Deliver the last partial batch
+    }
+    if (frame_enabled) {
+        frame_enabled = 0;
+        event_framer_stop(&event_framer);  // Deliver the last frame
+    }
+    if (shm_enabled) {
+        shm_enabled = 0;
+        event_shm_destroy(&shm_publisher);
+    }
+    if (stream_enabled) {
+        stream_enabled = 0;
+        event_net_stop(&net_stream);
+    }
+    if (queue_enabled) {
+        queue_enabled = 0;
+        event_queue_destroy(&event_queue);  // Undelivered events are discarded
+    }
     printf("Dispositivos limpiados y libusb cerrada.\n");
 }
 
@@ -32,237 +145,2383 @@ void print_hid_report_descriptor(const unsigned char *data, int length) {
     printf("\n");
 }
 
-void send_hid_report_descriptor(libusb_device_handle *handle, int interface_number, DeviceEvent *connect_event) {
-    unsigned char data[256];
-    int res = libusb_control_transfer(handle,
+static uint64_t monotonic_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static void init_event(DeviceRawEvent *event, Device *device, DeviceEventKind kind) {
+    event->timestamp_ns = monotonic_ns();
+    event->sequence = device->sequence++;
+    event->device_id = device->device_index;
+    event->vendor_id = (uint16_t)device->vendor_id;
+    event->product_id = (uint16_t)device->product_id;
+    event->kind = (uint8_t)kind;
+    event->interface_number = 0;
+    event->endpoint = 0;
+    event->flags = 0;
+    event->length = 0;
+    event->generation = (uint16_t)device->generation;
+}
+
+static void capture_event(const DeviceRawEvent *event) {
+    CaptureRecord record;
+    memset(&record, 0, sizeof(CaptureRecord));
+    record.timestamp_ns = event->timestamp_ns;
+    record.sequence = event->sequence;
+    record.device_id = event->device_id;
+    record.vendor_id = event->vendor_id;
+    record.product_id = event->product_id;
+    record.kind = event->kind;
+    record.source = (event->flags & DEVICE_EVENT_SDL) ? CAPTURE_SOURCE_SDL : CAPTURE_SOURCE_HID;
+    record.interface_number = event->interface_number;
+    record.endpoint = event->endpoint;
+    record.flags = event->flags & ~DEVICE_EVENT_SDL;
+    record.length = event->length < CAPTURE_DATA_MAX ? event->length : CAPTURE_DATA_MAX;
+    if (record.length < event->length) {
+        record.flags |= DEVICE_EVENT_TRUNCATED;
+    }
+    memcpy(record.data, event->data, record.length);
+
+    pthread_mutex_lock(&capture_mutex);
+    if (capture_enabled) {
+        capture_writer_append(&capture_writer, &record);
+    }
+    pthread_mutex_unlock(&capture_mutex);
+}
+
+static void dispatch_event(const DeviceRawEvent *event) {
+    Device *device = registry_get(event->device_id);
+    if (capture_enabled) {
+        capture_event(event);
+    }
+    if (shm_enabled) {
+        event_shm_publish(&shm_publisher, event);
+    }
+    if (stream_enabled) {
+        event_net_push(&net_stream, event);
+    }
+    if (frame_enabled && !event_framer_push(&event_framer, event) && device) {
+        atomic_fetch_add_explicit(&device->stats.dropped, 1, memory_order_relaxed);
+    }
+    if (batch_enabled) {
+        if (!event_batcher_push(&event_batcher, event) && device) {
+            atomic_fetch_add_explicit(&device->stats.dropped, 1, memory_order_relaxed);
+        }
+        if (device) {
+            stats_record(&device->stats.dispatch_latency, monotonic_ns() - event->timestamp_ns);
+        }
+    } else if (queue_enabled) {
+        int32_t dropped_device;
+        event_queue_push(&event_queue, event, &dropped_device);
+        Device *dropped = dropped_device >= 0 ? registry_get(dropped_device) : NULL;
+        if (dropped) {
+            atomic_fetch_add_explicit(&dropped->stats.dropped, 1, memory_order_relaxed);
+        }
+        if (device) {
+            stats_record(&device->stats.dispatch_latency, monotonic_ns() - event->timestamp_ns);
+        }
+    } else if (send_raw) {
+        uint64_t start = monotonic_ns();
+        send_raw(event);
+        uint64_t end = monotonic_ns();
+        if (device) {
+            stats_record(&device->stats.callback_duration, end - start);
+            stats_record(&device->stats.dispatch_latency, end - event->timestamp_ns);
+        }
+    }
+}
+
+// Hex dump in a single pass; output is truncated on a whole byte boundary.
+static void format_hex(char *out, size_t out_size, const unsigned char *data, size_t length) {
+    static const char digits[] = "0123456789abcdef";
+    size_t pos = 0;
+    for (size_t i = 0; i < length && pos + 3 < out_size; ++i) {
+        out[pos++] = digits[data[i] >> 4];
+        out[pos++] = digits[data[i] & 0x0f];
+        out[pos++] = ' ';
+    }
+    out[pos] = '\0';
+}
+
+static DeviceInterface* find_interface(Device *device, uint8_t interface_number) {
+    for (int i = 0; i < device->interface_count; ++i) {
+        if (device->interfaces[i].interface_number == interface_number) {
+            return &device->interfaces[i];
+        }
+    }
+    return NULL;
+}
+
+// Emits one SDL style event per field whose value changed since the last report.
+static void send_decoded_events(DeviceInterface *interface, const DeviceRawEvent *event, DeviceEvent *legacy_event) {
+    HidValue values[HID_MAX_FIELDS];
+    int count = hid_decode_report(interface->layout, event->data, event->length, values, HID_MAX_FIELDS);
+
+    for (int i = 0; i < count; ++i) {
+        const HidField *field = &interface->layout->fields[values[i].field];
+        int32_t value = interface->filters != NULL ? interface->filtered_values[values[i].field]
+                                                   : hid_normalize_value(field, values[i].value);
+        if (interface->field_values[values[i].field] == value) {
+            continue;
+        }
+        interface->field_values[values[i].field] = value;
+
+        switch (values[i].kind) {
+            case HID_FIELD_AXIS:
+                snprintf(legacy_event->event_type, sizeof(legacy_event->event_type), "Axis %d", values[i].index);
+                snprintf(legacy_event->value, sizeof(legacy_event->value), "%d", value);
+                break;
+            case HID_FIELD_BUTTON:
+                snprintf(legacy_event->event_type, sizeof(legacy_event->event_type), "Button %d %s", values[i].index, value ? "Down" : "Up");
+                snprintf(legacy_event->value, sizeof(legacy_event->value), "%s", value ? "Down" : "Up");
+                break;
+            case HID_FIELD_HAT:
+                snprintf(legacy_event->event_type, sizeof(legacy_event->event_type), "Hat %d", values[i].index);
+                snprintf(legacy_event->value, sizeof(legacy_event->value), "%d", value);
+                break;
+            default:
+                snprintf(legacy_event->event_type, sizeof(legacy_event->event_type), "Usage %04x:%04x", field->usage_page, field->usage);
+                snprintf(legacy_event->value, sizeof(legacy_event->value), "%d", value);
+                break;
+        }
+        send_data(*legacy_event);
+    }
+}
+
+// Same strings as the SDL version of the library.
+static void send_sdl_event(const DeviceRawEvent *event, DeviceEvent *legacy_event) {
+    CaptureSdlInput input;
+    if (event->length < sizeof(CaptureSdlInput)) {
+        return;
+    }
+    memcpy(&input, event->data, sizeof(CaptureSdlInput));
+    switch (input.type) {
+        case CAPTURE_SDL_AXIS:
+            snprintf(legacy_event->event_type, sizeof(legacy_event->event_type), "Axis %d", input.index);
+            snprintf(legacy_event->value, sizeof(legacy_event->value), "%d", input.value);
+            break;
+        case CAPTURE_SDL_BUTTON:
+            snprintf(legacy_event->event_type, sizeof(legacy_event->event_type), "Button %d %s", input.index, input.value ? "Down" : "Up");
+            snprintf(legacy_event->value, sizeof(legacy_event->value), "%s", input.value ? "Down" : "Up");
+            break;
+        default:
+            snprintf(legacy_event->event_type, sizeof(legacy_event->event_type), "Hat %d", input.index);
+            snprintf(legacy_event->value, sizeof(legacy_event->value), "%d", input.value);
+            break;
+    }
+    send_data(*legacy_event);
+}
+
+// One string event per key or axis of an evdev frame, named by evdev code.
+static void send_evdev_events(const DeviceRawEvent *event, DeviceEvent *legacy_event) {
+    int count = event->length / (int)sizeof(DeviceEvdevInput);
+    for (int i = 0; i < count; ++i) {
+        DeviceEvdevInput input;
+        memcpy(&input, event->data + i * (int)sizeof(DeviceEvdevInput), sizeof(DeviceEvdevInput));
+        if (input.type == 0x01) {           // EV_KEY
+            snprintf(legacy_event->event_type, sizeof(legacy_event->event_type), "Button %d %s", input.code, input.value ? "Down" : "Up");
+            snprintf(legacy_event->value, sizeof(legacy_event->value), "%s", input.value ? "Down" : "Up");
+        } else if (input.type == 0x03) {    // EV_ABS
+            snprintf(legacy_event->event_type, sizeof(legacy_event->event_type), "Axis %d", input.code);
+            snprintf(legacy_event->value, sizeof(legacy_event->value), "%d", input.value);
+        } else {
+            snprintf(legacy_event->event_type, sizeof(legacy_event->event_type), "Event %d:%d", input.type, input.code);
+            snprintf(legacy_event->value, sizeof(legacy_event->value), "%d", input.value);
+        }
+        send_data(*legacy_event);
+    }
+}
+
+_Static_assert(sizeof(((DeviceEvent*)0)->serial_number) == sizeof(((DeviceMetadata*)0)->event_name),
+               "event_name is copied into DeviceEvent.serial_number");
+
+// Adapter that keeps the original DeviceEvent string API on top of the raw events.
+static void send_legacy_event(const DeviceRawEvent *event) {
+    Device *device = registry_get(event->device_id);
+    if (!send_data || device == NULL) {
+        return;
+    }
+
+    DeviceEvent legacy_event;
+    memset(&legacy_event, 0, sizeof(DeviceEvent));
+    legacy_event.device_id = event->device_id;
+    legacy_event.vendor_id = event->vendor_id;
+    legacy_event.product_id = event->product_id;
+    if (device->metadata != NULL) {
+        memcpy(legacy_event.serial_number, device->metadata->event_name, sizeof(legacy_event.serial_number));
+    } else {
+        snprintf(legacy_event.serial_number, sizeof(legacy_event.serial_number), "%.63s", device->device_name);
+    }
+
+    DeviceInterface *interface = find_interface(device, event->interface_number);
+    switch (event->kind) {
+        case DEVICE_EVENT_REPORT:
+            if (event->flags & DEVICE_EVENT_EVDEV) {
+                send_evdev_events(event, &legacy_event);
+                return;
+            }
+            if (event->flags & DEVICE_EVENT_SDL) {
+                send_sdl_event(event, &legacy_event);
+                return;
+            }
+            if (decode_reports && interface != NULL && interface->layout != NULL) {
+                send_decoded_events(interface, event, &legacy_event);
+                return;
+            }
+            format_hex(legacy_event.value, sizeof(legacy_event.value), event->data, event->length);
+            break;
+        case DEVICE_EVENT_CONNECTED:
+            snprintf(legacy_event.event_type, sizeof(legacy_event.event_type), "connected");
+            snprintf(legacy_event.type, sizeof(legacy_event.type), "Connection");
+            if (device->interface_count > 0) {
+                format_hex(legacy_event.value, sizeof(legacy_event.value), device->interfaces[0].report_descriptor,
+                           (size_t)device->interfaces[0].report_descriptor_length);
+            }
+            break;
+        case DEVICE_EVENT_DISCONNECTED:
+            snprintf(legacy_event.event_type, sizeof(legacy_event.event_type), "disconnected");
+            snprintf(legacy_event.type, sizeof(legacy_event.type), "Disconnection");
+            snprintf(legacy_event.value, sizeof(legacy_event.value), "%s", device->device_name);
+            break;
+    }
+
+    send_data(legacy_event);
+}
+
+// Length of the report descriptor announced by the HID class descriptor of the interface.
+static int hid_descriptor_length(const struct libusb_interface_descriptor *interface) {
+    const unsigned char *extra = interface->extra;
+    for (int pos = 0; pos + 1 < interface->extra_length && extra[pos] > 0; pos += extra[pos]) {
+        if (extra[pos + 1] == LIBUSB_DT_HID && extra[pos] >= 9 && pos + 8 < interface->extra_length) {
+            int length = extra[pos + 7] | (extra[pos + 8] << 8);
+            return length < DEVICE_DESCRIPTOR_MAX ? length : DEVICE_DESCRIPTOR_MAX;
+        }
+    }
+    return DEVICE_DESCRIPTOR_MAX;
+}
+
+// Reads the report descriptor of an interface and compiles it into its decode table.
+void read_hid_report_descriptor(Device *device, DeviceInterface *interface, int length) {
+    interface->report_descriptor = malloc((size_t)length);
+    interface->report_descriptor_length = 0;
+    if (interface->report_descriptor == NULL) {
+        return;
+    }
+
+    int res = libusb_control_transfer(device->handle,
                                       LIBUSB_ENDPOINT_IN | LIBUSB_REQUEST_TYPE_STANDARD | LIBUSB_RECIPIENT_INTERFACE,
                                       HID_GET_DESCRIPTOR,
                                       (HID_REPORT_DESCRIPTOR << 8),
-                                      interface_number,
-                                      data,
-                                      sizeof(data),
+                                      interface->interface_number,
+                                      interface->report_descriptor,
+                                      (uint16_t)length,
                                       1000);
 
     if (res < 0) {
         fprintf(stderr, "Control transfer failed: %s\n", libusb_strerror(res));
-    } else {
-        print_hid_report_descriptor(data, res);
-        connect_event->value[0] = '\0'; // Limpiar el valor previo
-        for (int i = 0; i < res; ++i) {
-            char byte_str[4];
-            snprintf(byte_str, sizeof(byte_str), "%02x ", data[i]);
-            strncat(connect_event->value, byte_str, sizeof(connect_event->value) - strlen(connect_event->value) - 1);
-        }
-        if (send_data) {
-            send_data(*connect_event);
-        }
+        return;
     }
+    print_hid_report_descriptor(interface->report_descriptor, res);
+    interface->report_descriptor_length = res;
+    backend_compile_layout(interface);
 }
 
-void* read_device_data(void* arg) {
-    Device* device = (Device*)arg;
-    libusb_device_handle *handle = device->handle;
-    unsigned char data[256];
-    int actual_length;
+// Builds the decode table of an interface from its report descriptor.
+void backend_compile_layout(DeviceInterface* interface) {
+    interface->layout = malloc(sizeof(HidLayout));
+    if (interface->layout == NULL) {
+        return;
+    }
+    int fields = hid_parse_report_descriptor(interface->report_descriptor, (size_t)interface->report_descriptor_length,
+                                             interface->layout);
+    interface->field_values = fields > 0 ? calloc((size_t)fields, sizeof(int32_t)) : NULL;
+    if (interface->field_values == NULL) {
+        free(interface->layout);
+        interface->layout = NULL;
+    }
+}
 
-    while (1) {
-        int res = libusb_interrupt_transfer(handle, LIBUSB_ENDPOINT_IN | 1, data, sizeof(data), &actual_length, 1000);
-        if (res == 0 && actual_length > 0) {
-            DeviceEvent data_event;
-            memset(&data_event, 0, sizeof(DeviceEvent));
-            data_event.device_id = device->device_index;
-            data_event.vendor_id = device->vendor_id;
-            data_event.product_id = device->product_id;
-            snprintf(data_event.serial_number, sizeof(data_event.serial_number), "%s", device->device_name);
-            data_event.value[0] = '\0'; // Limpiar el valor previo
-            for (int i = 0; i < actual_length; ++i) {
-                char byte_str[4];
-                snprintf(byte_str, sizeof(byte_str), "%02x ", data[i]);
-                strncat(data_event.value, byte_str, sizeof(data_event.value) - strlen(data_event.value) - 1);
+// wMaxPacketSize bits 0-10 are the size, bits 11-12 the extra transactions per microframe.
+static uint16_t endpoint_packet_size(uint16_t max_packet_size) {
+    return (uint16_t)((max_packet_size & 0x7ff) * (1 + ((max_packet_size >> 11) & 0x3)));
+}
+
+// Claims every HID-class interface of the active configuration and records
+// its interrupt IN endpoints. Returns the number of claimed interfaces.
+static int claim_hid_interfaces(Device *device) {
+    struct libusb_config_descriptor *config;
+    int res = libusb_get_active_config_descriptor(libusb_get_device(device->handle), &config);
+    if (res < 0) {
+        fprintf(stderr, "Failed to get config descriptor: %s\n", libusb_strerror(res));
+        return 0;
+    }
+
+    for (int i = 0; i < config->bNumInterfaces && device->interface_count < DEVICE_MAX_INTERFACES; ++i) {
+        if (config->interface[i].num_altsetting == 0) {
+            continue;
+        }
+        const struct libusb_interface_descriptor *descriptor = &config->interface[i].altsetting[0];
+        if (descriptor->bInterfaceClass != LIBUSB_CLASS_HID) {
+            continue;
+        }
+        int number = descriptor->bInterfaceNumber;
+
+        DeviceInterface *interface = &device->interfaces[device->interface_count];
+        memset(interface, 0, sizeof(DeviceInterface));
+        interface->interface_number = (uint8_t)number;
+
+        // Detach the kernel driver if necessary
+        if (libusb_kernel_driver_active(device->handle, number) == 1) {
+            res = libusb_detach_kernel_driver(device->handle, number);
+            if (res < 0) {
+                fprintf(stderr, "Failed to detach kernel driver from interface %d: %s\n", number, libusb_strerror(res));
+                continue;
+            }
+            interface->kernel_driver_detached = 1;
+        }
+
+        res = libusb_claim_interface(device->handle, number);
+        if (res < 0) {
+            fprintf(stderr, "Failed to claim interface %d: %s\n", number, libusb_strerror(res));
+            if (interface->kernel_driver_detached) {
+                libusb_attach_kernel_driver(device->handle, number);
+            }
+            continue;
+        }
+        device->interface_count++;
+
+        for (int e = 0; e < descriptor->bNumEndpoints && device->endpoint_count < DEVICE_MAX_ENDPOINTS; ++e) {
+            const struct libusb_endpoint_descriptor *endpoint = &descriptor->endpoint[e];
+            if ((endpoint->bmAttributes & LIBUSB_TRANSFER_TYPE_MASK) != LIBUSB_TRANSFER_TYPE_INTERRUPT) {
+                continue;
             }
-            if (send_data) {
-                send_data(data_event);
+            if ((endpoint->bEndpointAddress & LIBUSB_ENDPOINT_DIR_MASK) != LIBUSB_ENDPOINT_IN) {
+                if (interface->out_endpoint == 0) {
+                    interface->out_endpoint = endpoint->bEndpointAddress;
+                }
+                continue;
+            }
+            DeviceEndpoint *entry = &device->endpoints[device->endpoint_count++];
+            entry->address = endpoint->bEndpointAddress;
+            entry->interface_number = (uint8_t)number;
+            entry->interval = endpoint->bInterval;
+            entry->max_packet_size = endpoint_packet_size(endpoint->wMaxPacketSize);
+        }
+
+        // A known device announcing the same descriptor length gets the cached one
+        int length = hid_descriptor_length(descriptor);
+        DeviceMetadata *metadata = (DeviceMetadata*)device->metadata;
+        if (metadata == NULL || !device_cache_use(metadata, interface, length)) {
+            read_hid_report_descriptor(device, interface, length);
+            if (metadata != NULL) {
+                device_cache_adopt(metadata, interface);
             }
-        } else if (res != 0) {
-            fprintf(stderr, "Interrupt transfer failed: %s\n", libusb_strerror(res));
-            break;  // Salir del bucle si falla la transferencia
         }
     }
 
-    // Si sale del bucle, el dispositivo probablemente se ha desconectado
-    pthread_mutex_lock(&devices_mutex);
-    libusb_release_interface(device->handle, 0);
-    libusb_close(device->handle);
-    device->handle = NULL;
-    pthread_mutex_unlock(&devices_mutex);
+    libusb_free_config_descriptor(config);
+    return device->interface_count;
+}
+
+static const DeviceEndpoint* find_endpoint(const Device *device, uint8_t address) {
+    for (int i = 0; i < device->endpoint_count; ++i) {
+        if (device->endpoints[i].address == address) {
+            return &device->endpoints[i];
+        }
+    }
     return NULL;
 }
 
-void* monitor_devices(void* /*arg*/) {
-    libusb_context *context = NULL;
-    libusb_init(&context);
-    libusb_device **devices_list;
-    ssize_t count;
+// Earliest axis_filter_due() of the devices of each backend, 0 when none.
+// Written by the backend's reader thread, which also runs the flushes.
+static _Atomic uint64_t filter_due[DEVICE_BACKEND_COUNT];
 
-    while (1) {
-        count = libusb_get_device_list(context, &devices_list);
-        if (count < 0) {
-            fprintf(stderr, "Error getting USB device list\n");
+static void note_filter_due(const Device *device, uint64_t due) {
+    uint64_t current = atomic_load_explicit(&filter_due[device->backend], memory_order_relaxed);
+    while (due != 0 && (current == 0 || due < current) &&
+           !atomic_compare_exchange_weak(&filter_due[device->backend], &current, due)) {
+    }
+}
+
+static void store_filtered_axes(DeviceInterface *interface, const HidValue *values, int count) {
+    AxisFilterBank *bank = interface->filters;
+    for (int i = 0; i < count; ++i) {
+        if (values[i].kind == HID_FIELD_AXIS && values[i].index < bank->count) {
+            interface->filtered_values[values[i].field] = (int32_t)lrintf(bank->reported[values[i].index] * 32767.0f);
+        }
+    }
+}
+
+// New settings for some axes of a bank that is already in use. The reader
+// thread filters without devices_mutex, so it applies them itself between
+// two reports instead of having them change in the middle of one.
+typedef struct AxisFilterUpdate {
+    AxisFilterConfig configs[AXIS_FILTER_MAX];
+    uint32_t axes;                  // Bit per axis to configure
+} AxisFilterUpdate;
+
+// Called by the reader thread before it uses the bank.
+static void apply_filter_update(DeviceInterface *interface, AxisFilterBank *bank) {
+    if (__atomic_load_n(&interface->filter_update, __ATOMIC_RELAXED) == NULL) {
+        return;
+    }
+    AxisFilterUpdate *update = __atomic_exchange_n(&interface->filter_update, NULL, __ATOMIC_ACQUIRE);
+    if (update == NULL) {
+        return;
+    }
+    for (int i = 0; i < bank->count; ++i) {
+        if (update->axes & (1u << i)) {
+            axis_filter_configure(bank, i, &update->configs[i]);
+        }
+    }
+    free(update);
+}
+
+// Feeds a report through the axis filters of its interface. Returns how many
+// fields changed their filtered value; 0 means the report carries nothing new.
+static int filter_report(Device *device, DeviceInterface *interface, const DeviceRawEvent *event) {
+    AxisFilterBank *bank = interface->filters;
+    apply_filter_update(interface, bank);
+    const HidLayout *layout = interface->layout;
+    HidValue values[HID_MAX_FIELDS];
+    int count = hid_decode_report(layout, event->data, event->length, values, HID_MAX_FIELDS);
+
+    int changed = 0;
+    int axes = 0;
+    for (int i = 0; i < count; ++i) {
+        int32_t value = hid_normalize_value(&layout->fields[values[i].field], values[i].value);
+        if (values[i].kind == HID_FIELD_AXIS && values[i].index < bank->count) {
+            bank->input[values[i].index] = (float)value / 32767.0f;
+            axes = 1;
+        } else if (interface->filtered_values[values[i].field] != value) {
+            interface->filtered_values[values[i].field] = value;
+            changed++;
+        }
+    }
+    if (axes) {
+        changed += axis_filter_process(bank, event->timestamp_ns);
+        store_filtered_axes(interface, values, count);
+        memcpy(interface->axis_report, event, offsetof(DeviceRawEvent, data) + event->length);
+        note_filter_due(device, axis_filter_due(bank));
+    }
+    return changed;
+}
+
+// Lets the axis filters of an idle device catch up with its last input, see
+// axis_filter_flush(), and repeats its last report when that moved an axis.
+static void flush_device_filters(Device *device, uint64_t now) {
+    for (int j = 0; j < device->interface_count; ++j) {
+        DeviceInterface *interface = &device->interfaces[j];
+        AxisFilterBank *bank = __atomic_load_n(&interface->filters, __ATOMIC_ACQUIRE);
+        if (bank != NULL) {
+            apply_filter_update(interface, bank);
+        }
+        uint64_t due = bank != NULL ? axis_filter_due(bank) : 0;
+        if (due == 0 || due > now) {
+            note_filter_due(device, due);
+            continue;
+        }
+        int changed = axis_filter_flush(bank, now);
+        note_filter_due(device, axis_filter_due(bank));
+        if (changed == 0) {
             continue;
         }
+        DeviceRawEvent event;
+        memcpy(&event, interface->axis_report, sizeof(DeviceRawEvent));
+        HidValue values[HID_MAX_FIELDS];
+        int count = hid_decode_report(interface->layout, event.data, event.length, values, HID_MAX_FIELDS);
+        store_filtered_axes(interface, values, count);
+        init_event(&event, device, DEVICE_EVENT_REPORT);
+        event.interface_number = interface->axis_report->interface_number;
+        event.endpoint = interface->axis_report->endpoint;
+        event.flags = interface->axis_report->flags | DEVICE_EVENT_REPEAT;
+        event.length = interface->axis_report->length;
+        dispatch_event(&event);
+    }
+}
+
+// Called by each backend's reader thread, the one that filters the reports
+// of its devices. Returns the milliseconds until the next flush is due, -1
+// when no filter is waiting for one.
+int backend_flush_filters(DeviceBackendKind backend) {
+    uint64_t due = atomic_load_explicit(&filter_due[backend], memory_order_relaxed);
+    if (due == 0) {
+        return -1;
+    }
+    uint64_t now = monotonic_ns();
+    if (now < due) {
+        return (int)((due - now + 999999) / 1000000);
+    }
+    atomic_store(&filter_due[backend], 0);  // Raised again by the filters still pending
 
+    for (int slot = 0; slot < registry_slot_count(); ++slot) {
+        Device *device = registry_get(slot);
+        // Held like a transfer, so the monitor does not close the device meanwhile
         pthread_mutex_lock(&devices_mutex);
-        for (ssize_t i = 0; i < count; ++i) {
-            libusb_device *device = devices_list[i];
-            struct libusb_device_descriptor desc;
+        int usable = device->in_use && device->backend == backend && !device->closing;
+        if (usable) {
+            device->pending_transfers++;
+        }
+        pthread_mutex_unlock(&devices_mutex);
+        if (!usable) {
+            continue;
+        }
+        flush_device_filters(device, now);
 
-            int res = libusb_get_device_descriptor(device, &desc);
-            if (res < 0) {
-                fprintf(stderr, "Failed to get device descriptor\n");
-                continue;
-            }
+        pthread_mutex_lock(&devices_mutex);
+        device->pending_transfers--;
+        int retired = device->handle != NULL && device->closing && device->pending_transfers == 0;
+        pthread_cond_broadcast(&transfers_cond);
+        pthread_mutex_unlock(&devices_mutex);
+        if (retired) {
+            wake_monitor();
+        }
+    }
+    due = atomic_load_explicit(&filter_due[backend], memory_order_relaxed);
+    if (due == 0) {
+        return -1;
+    }
+    now = monotonic_ns();
+    return now < due ? (int)((due - now + 999999) / 1000000) : 0;
+}
 
-            // Check if it's a HID device
-            if (desc.bDeviceClass == LIBUSB_CLASS_PER_INTERFACE) {
-                int already_connected = 0;
-                for (int j = 0; j < MAX_DEVICES; ++j) {
-                    if (devices[j].handle != NULL &&
-                        devices[j].vendor_id == desc.idVendor &&
-                        devices[j].product_id == desc.idProduct) {
-                        already_connected = 1;
-                        break;
-                    }
-                }
+static void count_report(Device *device, const DeviceRawEvent *event, uint64_t length) {
+    DeviceStats *stats = &device->stats;
+    uint64_t last = atomic_exchange_explicit(&stats->last_report_ns, event->timestamp_ns, memory_order_relaxed);
+    if (last != 0) {
+        stats_record(&stats->report_interval, event->timestamp_ns - last);
+    }
+    atomic_fetch_add_explicit(&stats->reports, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&stats->bytes, length, memory_order_relaxed);
+    if (event->flags & DEVICE_EVENT_TRUNCATED) {
+        atomic_fetch_add_explicit(&stats->truncated, 1, memory_order_relaxed);
+    }
+}
 
-                if (already_connected) {
-                    continue;
-                }
+// Counts a report, keeps it as the device state and dispatches it unless it
+// is a suppressed duplicate or the axis filters leave nothing new in it.
+static void deliver_report(Device *device, const DeviceRawEvent *event, uint64_t length) {
+    count_report(device, event, length);
+    DeviceInterface *interface = find_interface(device, event->interface_number);
+    int duplicate = 0;
+    // evdev and SDL events are changes already, only raw reports are a state
+    if (!(event->flags & (DEVICE_EVENT_SDL | DEVICE_EVENT_EVDEV))) {
+        uint8_t report_id = 0;
+        if (interface != NULL && interface->layout != NULL && interface->layout->uses_report_ids && event->length > 0) {
+            report_id = event->data[0];
+        }
+        duplicate = !device_state_update(device->device_index, event, report_id);
+        if (duplicate) {
+            atomic_fetch_add_explicit(&device->stats.duplicates, 1, memory_order_relaxed);
+        }
+    }
 
-                libusb_device_handle *handle;
-                res = libusb_open(device, &handle);
-                if (res < 0) {
-                    fprintf(stderr, "Failed to open device: %s\n", libusb_strerror(res));
-                    continue;
-                }
+    if (interface != NULL && interface->filters != NULL) {
+        // Duplicates still go through: smoothing and rate limits move with time
+        if (filter_report(device, interface, event) == 0) {
+            atomic_fetch_add_explicit(&device->stats.filtered, 1, memory_order_relaxed);
+            return;
+        }
+    } else if (duplicate && dedup_mode == DEVICE_DEDUP_SUPPRESS) {
+        return;
+    }
+    dispatch_event(event);
+}
 
-                // Detach the kernel driver if necessary
-                if (libusb_kernel_driver_active(handle, 0) == 1) {
-                    res = libusb_detach_kernel_driver(handle, 0);
-                    if (res < 0) {
-                        fprintf(stderr, "Failed to detach kernel driver: %s\n", libusb_strerror(res));
-                        libusb_close(handle);
-                        continue;
-                    }
-                }
+_Static_assert(DEVICE_MAX_ENDPOINTS * DEVICE_TRANSFERS <= 32, "parked_transfers has a bit per transfer");
 
-                res = libusb_claim_interface(handle, 0);
-                if (res < 0) {
-                    fprintf(stderr, "Failed to claim interface: %s\n", libusb_strerror(res));
-                    libusb_close(handle);
-                    continue;
-                }
+static uint64_t recovery_backoff_ns(int attempts) {
+    if (attempts == 0) {
+        return 0;
+    }
+    uint64_t backoff_ms = (uint64_t)RECOVERY_BACKOFF_MS << (attempts - 1);
+    return (backoff_ms < RECOVERY_BACKOFF_MAX_MS ? backoff_ms : RECOVERY_BACKOFF_MAX_MS) * 1000000ull;
+}
 
-                for (int j = 0; j < MAX_DEVICES; ++j) {
-                    if (devices[j].handle == NULL) {
-                        devices[j].handle = handle;
-                        devices[j].vendor_id = desc.idVendor;
-                        devices[j].product_id = desc.idProduct;
-                        snprintf(devices[j].device_name, sizeof(devices[j].device_name), "%04x:%04x", desc.idVendor, desc.idProduct);
-                        devices[j].device_index = j;
-
-                        DeviceEvent connect_event;
-                        memset(&connect_event, 0, sizeof(DeviceEvent));
-                        connect_event.device_id = j;
-                        connect_event.vendor_id = desc.idVendor;
-                        connect_event.product_id = desc.idProduct;
-                        snprintf(connect_event.serial_number, sizeof(connect_event.serial_number), "%04x:%04x", desc.idVendor, desc.idProduct);
-                        snprintf(connect_event.event_type, sizeof(connect_event.event_type), "connected");
-                        snprintf(connect_event.type, sizeof(connect_event.type), "Connection");
-
-                        send_hid_report_descriptor(handle, 0, &connect_event);
-
-                        if (send_data) {
-                            send_data(connect_event);
-                        }
-
-                        pthread_t data_thread;
-                        if (pthread_create(&data_thread, NULL, read_device_data, &devices[j]) != 0) {
-                            fprintf(stderr, "Failed to create data thread\n");
-                        } else {
-                            pthread_detach(data_thread);
-                        }
-
-                        break;
-                    }
-                }
+// Takes a failed transfer out of the rotation and schedules the recovery: a
+// clear-halt for a stalled endpoint, a reset for anything else. Must be called
+// with devices_mutex held.
+static void park_transfer(Device *device, struct libusb_transfer *transfer, int stalled) {
+    for (int i = 0; i < DEVICE_MAX_ENDPOINTS * DEVICE_TRANSFERS; ++i) {
+        if (device->transfers[i] == transfer) {
+            device->parked_transfers |= 1u << i;
+        }
+    }
+    if (device->recovery == DEVICE_RECOVERY_RESET) {
+        return;  // Cancelled for the reset, or failed while waiting for it
+    }
+    if (stalled) {
+        for (int i = 0; i < device->endpoint_count; ++i) {
+            if (device->endpoints[i].address == transfer->endpoint) {
+                device->halted_endpoints |= (uint8_t)(1u << i);
             }
         }
+        if (device->recovery == DEVICE_RECOVERY_NONE) {
+            device->recovery_ns = monotonic_ns() + recovery_backoff_ns(device->recovery_attempts);
+        }
+        device->recovery = DEVICE_RECOVERY_CLEAR_HALT;
+    } else {
+        device->recovery_ns = monotonic_ns() + recovery_backoff_ns(device->recovery_attempts);
+        __atomic_store_n(&device->recovery, DEVICE_RECOVERY_RESET, __ATOMIC_RELEASE);
+    }
+    wake_monitor();
+}
 
-        // Detect disconnected devices
-        for (int j = 0; j < MAX_DEVICES; ++j) {
-            if (devices[j].handle != NULL) {
-                struct libusb_device_descriptor desc;
-                int res = libusb_get_device_descriptor(libusb_get_device(devices[j].handle), &desc);
-                if (res < 0) {
-                    fprintf(stderr, "Device %d disconnected\n", j);
-                    libusb_release_interface(devices[j].handle, 0);
-                    libusb_close(devices[j].handle);
-                    devices[j].handle = NULL;
-
-                    DeviceEvent disconnect_event;
-                    memset(&disconnect_event, 0, sizeof(DeviceEvent));
-                    disconnect_event.device_id = j;
-                    disconnect_event.vendor_id = devices[j].vendor_id;
-                    disconnect_event.product_id = devices[j].product_id;
-                    snprintf(disconnect_event.serial_number, sizeof(disconnect_event.serial_number), "%s", devices[j].device_name);
-                    snprintf(disconnect_event.event_type, sizeof(disconnect_event.event_type), "disconnected");
-                    snprintf(disconnect_event.type, sizeof(disconnect_event.type), "Disconnection");
-                    snprintf(disconnect_event.value, sizeof(disconnect_event.value), "%s", devices[j].device_name);
-
-                    if (send_data) {
-                        send_data(disconnect_event);
-                    }
-                }
+static void LIBUSB_CALL transfer_completed(struct libusb_transfer *transfer) {
+    Device *device = (Device*)transfer->user_data;
+
+    if (transfer->status == LIBUSB_TRANSFER_COMPLETED && transfer->actual_length > 0) {
+        const DeviceEndpoint *endpoint = find_endpoint(device, transfer->endpoint);
+        DeviceRawEvent data_event;
+        init_event(&data_event, device, DEVICE_EVENT_REPORT);
+        data_event.interface_number = endpoint != NULL ? endpoint->interface_number : 0;
+        data_event.endpoint = transfer->endpoint;
+        if (transfer->actual_length > DEVICE_REPORT_MAX) {
+            data_event.length = DEVICE_REPORT_MAX;
+            data_event.flags |= DEVICE_EVENT_TRUNCATED;
+        } else {
+            data_event.length = (uint16_t)transfer->actual_length;
+        }
+        memcpy(data_event.data, transfer->buffer, data_event.length);
+
+        deliver_report(device, &data_event, (uint64_t)transfer->actual_length);
+    } else if (transfer->status == LIBUSB_TRANSFER_TIMED_OUT) {
+        atomic_fetch_add_explicit(&device->stats.timeouts, 1, memory_order_relaxed);
+    }
+
+    if (transfer->status == LIBUSB_TRANSFER_COMPLETED && __atomic_load_n(&device->recovery_attempts, __ATOMIC_RELAXED)) {
+        __atomic_store_n(&device->recovery_attempts, 0, __ATOMIC_RELAXED);  // Reading again, recovered
+    }
+
+    // Timeouts are normal for an idle device, they are only counted
+    int gone = transfer->status == LIBUSB_TRANSFER_NO_DEVICE;
+    int stalled = transfer->status == LIBUSB_TRANSFER_STALL;
+    if ((transfer->status == LIBUSB_TRANSFER_COMPLETED || transfer->status == LIBUSB_TRANSFER_TIMED_OUT) &&
+        !device->closing && __atomic_load_n(&device->recovery, __ATOMIC_ACQUIRE) != DEVICE_RECOVERY_RESET) {
+        int res = libusb_submit_transfer(transfer);
+        if (res == 0) {
+            // Closed or reset while this transfer was not submitted: the cancel pass missed it
+            if (__atomic_load_n(&device->closing, __ATOMIC_ACQUIRE) ||
+                __atomic_load_n(&device->recovery, __ATOMIC_ACQUIRE) == DEVICE_RECOVERY_RESET) {
+                libusb_cancel_transfer(transfer);
             }
+            return;
         }
+        atomic_fetch_add_explicit(&device->stats.errors, 1, memory_order_relaxed);
+        fprintf(stderr, "Failed to resubmit transfer: %s\n", libusb_strerror(res));
+        gone = res == LIBUSB_ERROR_NO_DEVICE;
+    } else if (transfer->status != LIBUSB_TRANSFER_CANCELLED && transfer->status != LIBUSB_TRANSFER_COMPLETED &&
+               transfer->status != LIBUSB_TRANSFER_TIMED_OUT) {
+        atomic_fetch_add_explicit(&device->stats.errors, 1, memory_order_relaxed);
+        fprintf(stderr, "Interrupt transfer failed: status %d\n", transfer->status);
+    }
 
-        libusb_free_device_list(devices_list, 1);
-        pthread_mutex_unlock(&devices_mutex);
-        usleep(500000);  // 500ms
+    // The transfer is retired. Unless the device is gone it is parked for the
+    // monitor to recover the device; once the last one of a closing device is
+    // gone the monitor closes it
+    pthread_mutex_lock(&devices_mutex);
+    if (!device->closing && !gone) {
+        park_transfer(device, transfer, stalled);
+    } else if (!device->closing) {
+        cancel_device_transfers(device);
     }
+    device->pending_transfers--;
+    int retired = device->pending_transfers == 0;
+    pthread_cond_broadcast(&transfers_cond);
+    pthread_mutex_unlock(&devices_mutex);
 
-    libusb_exit(context);
-    return NULL;
+    if (retired) {
+        wake_monitor();
+    }
 }
 
-void detect_devices(void (*send_data_func)(DeviceEvent)) {
-    send_data = send_data_func;
+// Must be called with devices_mutex held.
+static void cancel_device_transfers(Device *device) {
+    __atomic_store_n(&device->closing, 1, __ATOMIC_RELEASE);
+    for (int i = 0; i < DEVICE_MAX_ENDPOINTS * DEVICE_TRANSFERS; ++i) {
+        if (device->transfers[i] != NULL) {
+            libusb_cancel_transfer(device->transfers[i]);
+        }
+    }
+    if (device->output != NULL && device->output->in_flight) {
+        libusb_cancel_transfer(device->output->transfer);
+    }
+}
 
-    pthread_t monitor_thread;
-    if (pthread_create(&monitor_thread, NULL, monitor_devices, NULL) != 0) {
-        fprintf(stderr, "Failed to create monitor thread\n");
-    } else {
-        pthread_detach(monitor_thread);
+static void LIBUSB_CALL write_completed(struct libusb_transfer *transfer);
+
+// Starts the next queued write unless one is in flight. Output reports go to
+// the interrupt OUT endpoint when the interface has one, everything else is a
+// SET_REPORT control request. Must be called with devices_mutex held.
+static void submit_next_write(Device *device) {
+    DeviceOutputQueue *output = device->output;
+    DeviceOutputReport report;
+    while (!output->in_flight && !device->closing && device->recovery != DEVICE_RECOVERY_RESET &&
+           device_output_pop(output, &report) == 0) {
+        // Report ID 0 means the interface has no IDs, it is not sent
+        uint8_t report_id = report.data[0];
+        const uint8_t *payload = report_id != 0 ? report.data : report.data + 1;
+        uint16_t length = report_id != 0 ? report.length : (uint16_t)(report.length - 1);
+        DeviceInterface *interface = find_interface(device, report.interface_number);
+        struct libusb_transfer *transfer = output->transfer;
+
+        if (report.type == DEVICE_REPORT_OUTPUT && interface != NULL && interface->out_endpoint != 0) {
+            memcpy(output->buffer, payload, length);
+            libusb_fill_interrupt_transfer(transfer, device->handle, interface->out_endpoint, output->buffer, length,
+                                           write_completed, device, 1000);
+        } else {
+            libusb_fill_control_setup(output->buffer,
+                                      LIBUSB_ENDPOINT_OUT | LIBUSB_REQUEST_TYPE_CLASS | LIBUSB_RECIPIENT_INTERFACE,
+                                      HID_SET_REPORT, (uint16_t)((report.type << 8) | report_id),
+                                      report.interface_number, length);
+            memcpy(output->buffer + LIBUSB_CONTROL_SETUP_SIZE, payload, length);
+            libusb_fill_control_transfer(transfer, device->handle, output->buffer, write_completed, device, 1000);
+        }
+
+        int res = libusb_submit_transfer(transfer);
+        if (res == 0) {
+            output->in_flight = 1;
+            device->pending_transfers++;
+        } else {
+            atomic_fetch_add_explicit(&device->stats.errors, 1, memory_order_relaxed);
+            fprintf(stderr, "Failed to submit write to device %d: %s\n", device->device_index, libusb_strerror(res));
+        }
+    }
+}
+
+// Runs on the event thread. The input transfers never wait for writes: they
+// only share devices_mutex on retirement, like here.
+static void LIBUSB_CALL write_completed(struct libusb_transfer *transfer) {
+    Device *device = (Device*)transfer->user_data;
+    if (transfer->status == LIBUSB_TRANSFER_COMPLETED) {
+        atomic_fetch_add_explicit(&device->stats.writes, 1, memory_order_relaxed);
+    } else if (transfer->status != LIBUSB_TRANSFER_CANCELLED) {
+        atomic_fetch_add_explicit(&device->stats.errors, 1, memory_order_relaxed);
+        fprintf(stderr, "Write to device %d failed: status %d\n", device->device_index, transfer->status);
     }
 
-    printf("Device detection started.\n");
+    pthread_mutex_lock(&devices_mutex);
+    device->output->in_flight = 0;
+    device->pending_transfers--;
+    submit_next_write(device);
+    int retired = device->pending_transfers == 0;
+    pthread_cond_broadcast(&transfers_cond);
+    pthread_mutex_unlock(&devices_mutex);
+
+    if (retired) {
+        wake_monitor();
+    }
 }
 
-const Device* get_device(int index) {
-    if (index < 0 || index >= MAX_DEVICES) {
-        return NULL;
+// Queues DEVICE_TRANSFERS reads on every interrupt IN endpoint, each buffer
+// sized to the endpoint's max packet size. The host controller schedules
+// interrupt transfers at the endpoint's bInterval.
+static int start_device_transfers(Device *device) {
+    device->closing = 0;
+    device->pending_transfers = 0;
+    device->recovery = DEVICE_RECOVERY_NONE;
+    device->parked_transfers = 0;
+    device->halted_endpoints = 0;
+    if (device->output == NULL) {
+        device->output = device_output_create();
+    }
+    for (int e = 0; e < device->endpoint_count; ++e) {
+        const DeviceEndpoint *endpoint = &device->endpoints[e];
+        for (int i = 0; i < DEVICE_TRANSFERS; ++i) {
+            struct libusb_transfer *transfer = libusb_alloc_transfer(0);
+            unsigned char *buffer = malloc(endpoint->max_packet_size);
+            if (transfer == NULL || buffer == NULL) {
+                libusb_free_transfer(transfer);
+                free(buffer);
+                break;
+            }
+            libusb_fill_interrupt_transfer(transfer, device->handle, endpoint->address, buffer, endpoint->max_packet_size,
+                                           transfer_completed, device, 0);
+            transfer->flags = LIBUSB_TRANSFER_FREE_BUFFER;
+            device->transfers[e * DEVICE_TRANSFERS + i] = transfer;
+
+            int res = libusb_submit_transfer(transfer);
+            if (res < 0) {
+                fprintf(stderr, "Failed to submit transfer on endpoint %02x: %s\n", endpoint->address, libusb_strerror(res));
+                break;
+            }
+            device->pending_transfers++;
+        }
     }
-    return &devices[index];
+    return device->pending_transfers;
 }
 
-int get_device_count() {
-    int count = 0;
-    pthread_mutex_lock(&devices_mutex);
-    for (int i = 0; i < MAX_DEVICES; ++i) {
-        if (devices[i].handle != NULL) {
-            count++;
+static void free_interfaces(Device *device) {
+    for (int i = 0; i < device->interface_count; ++i) {
+        DeviceInterface *interface = &device->interfaces[i];
+        if (!interface->cached) {
+            free(interface->report_descriptor);
+            free(interface->layout);
         }
+        free(interface->field_values);
+        free(interface->filters);
+        free(interface->filtered_values);
+        free(interface->axis_report);
+        free(interface->filter_update);
     }
-    pthread_mutex_unlock(&devices_mutex);
-    return count;
+    memset(device->interfaces, 0, sizeof(device->interfaces));
+    device->interface_count = 0;
+}
+
+// Must be called with no transfers pending (and devices_mutex held for a slot in devices).
+static void close_device(Device *device) {
+    for (int i = 0; i < DEVICE_MAX_ENDPOINTS * DEVICE_TRANSFERS; ++i) {
+        libusb_free_transfer(device->transfers[i]);
+        device->transfers[i] = NULL;
+    }
+    device_output_destroy(device->output);
+    device->output = NULL;
+    for (int i = 0; i < device->interface_count; ++i) {
+        DeviceInterface *interface = &device->interfaces[i];
+        libusb_release_interface(device->handle, interface->interface_number);
+        if (interface->kernel_driver_detached) {
+            libusb_attach_kernel_driver(device->handle, interface->interface_number);
+        }
+    }
+    free_interfaces(device);
+    device->endpoint_count = 0;
+    libusb_close(device->handle);
+    device->handle = NULL;
+}
+
+// Single event loop thread that drives the transfers of every device.
+void* read_device_data(void* arg) {
+    libusb_context *context = (libusb_context*)arg;
+    thread_sched_apply(DEVICE_THREAD_READER);
+    // device_manager_stop() wakes it with libusb_interrupt_event_handler()
+    while (atomic_load(&manager.events_running)) {
+        // Wakes up for the axis filters of idle devices, otherwise like libusb_handle_events()
+        int flush_ms = backend_flush_filters(DEVICE_BACKEND_LIBUSB);
+        struct timeval timeout;
+        timeout.tv_sec = flush_ms < 0 ? 60 : flush_ms / 1000;
+        timeout.tv_usec = flush_ms < 0 ? 0 : (flush_ms % 1000) * 1000;
+        int res = libusb_handle_events_timeout_completed(context, &timeout, NULL);
+        if (res < 0 && res != LIBUSB_ERROR_INTERRUPTED) {
+            fprintf(stderr, "Event handling failed: %s\n", libusb_strerror(res));
+        }
+    }
+    thread_sched_forget(DEVICE_THREAD_READER);
+    return NULL;
+}
+
+static void wake_monitor() {
+    if (monitor_wake[1] >= 0) {
+        char byte = 1;
+        if (write(monitor_wake[1], &byte, 1) < 0) {
+            // The pipe is already full, the monitor will wake up anyway
+        }
+    }
+}
+
+static void request_rescan() {
+    pthread_mutex_lock(&hotplug_mutex);
+    rescan_needed = 1;
+    pthread_mutex_unlock(&hotplug_mutex);
+}
+
+static int take_rescan_request() {
+    pthread_mutex_lock(&hotplug_mutex);
+    int rescan = rescan_needed;
+    rescan_needed = 0;
+    pthread_mutex_unlock(&hotplug_mutex);
+    return rescan;
+}
+
+static int LIBUSB_CALL hotplug_callback(libusb_context* /*context*/, libusb_device *device,
+                                        libusb_hotplug_event event, void* /*user_data*/) {
+    // Runs on the event thread: only queue the device, the monitor does the slow USB I/O
+    pthread_mutex_lock(&hotplug_mutex);
+    if (hotplug_count < HOTPLUG_QUEUE_SIZE) {
+        int tail = (hotplug_head + hotplug_count) % HOTPLUG_QUEUE_SIZE;
+        hotplug_queue[tail].device = libusb_ref_device(device);
+        hotplug_queue[tail].event = event;
+        hotplug_count++;
+    } else {
+        rescan_needed = 1;
+    }
+    pthread_mutex_unlock(&hotplug_mutex);
+    wake_monitor();
+    return 0;
+}
+
+static int open_uevent_socket() {
+    int fd = socket(AF_NETLINK, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, NETLINK_KOBJECT_UEVENT);
+    if (fd < 0) {
+        return -1;
+    }
+    struct sockaddr_nl addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.nl_family = AF_NETLINK;
+    addr.nl_groups = 1;  // Kernel uevents
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Returns 1 if any pending uevent concerns the USB subsystem.
+static int drain_uevents(int fd) {
+    char buffer[4096];
+    int usb_event = 0;
+    ssize_t length;
+    while ((length = recv(fd, buffer, sizeof(buffer) - 1, 0)) > 0) {
+        buffer[length] = '\0';
+        for (ssize_t i = 0; i < length; i += (ssize_t)strlen(buffer + i) + 1) {
+            if (strcmp(buffer + i, "SUBSYSTEM=usb") == 0) {
+                usb_event = 1;
+            }
+        }
+    }
+    return usb_event;
+}
+
+// Creates the filter bank of an interface on first use and applies configs
+// (one per axis) to one axis, or to all of them when axis is -1. Called with
+// devices_mutex held; a bank in use only gets the new settings through its
+// reader thread, see apply_filter_update().
+static void configure_interface_filters(DeviceInterface *interface, const AxisFilterConfig *configs, int axis) {
+    if (interface->layout == NULL || interface->layout->axis_count == 0) {
+        return;
+    }
+    AxisFilterBank *bank = interface->filters;
+    if (bank == NULL) {
+        bank = malloc(sizeof(AxisFilterBank));
+        interface->filtered_values = calloc((size_t)interface->layout->field_count, sizeof(int32_t));
+        interface->axis_report = calloc(1, sizeof(DeviceRawEvent));
+        if (bank == NULL || interface->filtered_values == NULL || interface->axis_report == NULL) {
+            free(bank);
+            free(interface->filtered_values);
+            free(interface->axis_report);
+            interface->filtered_values = NULL;
+            interface->axis_report = NULL;
+            return;
+        }
+        axis_filter_init(bank, interface->layout->axis_count);
+        for (int i = 0; i < bank->count; ++i) {
+            axis_filter_configure(bank, i, &configs[i]);
+        }
+        // The event thread picks the bank up on its next report
+        __atomic_store_n(&interface->filters, bank, __ATOMIC_RELEASE);
+        return;
+    }
+    // The reader only ever takes the pending update, so merging into it is safe here
+    AxisFilterUpdate *update = __atomic_exchange_n(&interface->filter_update, NULL, __ATOMIC_ACQUIRE);
+    if (update == NULL) {
+        update = calloc(1, sizeof(AxisFilterUpdate));
+        if (update == NULL) {
+            return;
+        }
+    }
+    for (int i = 0; i < bank->count; ++i) {
+        if (axis < 0 || axis == i) {
+            update->configs[i] = configs[i];
+            update->axes |= 1u << i;
+        }
+    }
+    __atomic_store_n(&interface->filter_update, update, __ATOMIC_RELEASE);
+}
+
+static uint64_t device_instance_id(libusb_device *device) {
+    return ((uint64_t)libusb_get_bus_number(device) << 8) | libusb_get_device_address(device);
+}
+
+// Identity that survives reconnects: bus and port path, plus the serial number if any.
+static void build_device_key(libusb_device *device, libusb_device_handle *handle,
+                             const struct libusb_device_descriptor *desc, char *key, size_t size) {
+    uint8_t ports[8];
+    int depth = libusb_get_port_numbers(device, ports, sizeof(ports));
+    int pos = snprintf(key, size, "%u", libusb_get_bus_number(device));
+    for (int i = 0; i < depth && (size_t)pos < size; ++i) {
+        pos += snprintf(key + pos, size - (size_t)pos, i ? ".%u" : "-%u", ports[i]);
+    }
+
+    unsigned char serial[64] = "";
+    if (desc->iSerialNumber != 0) {
+        libusb_get_string_descriptor_ascii(handle, desc->iSerialNumber, serial, sizeof(serial));
+    }
+    if ((size_t)pos < size) {
+        snprintf(key + pos, size - (size_t)pos, "/%s", serial);
+    }
+}
+
+static const char* read_string(libusb_device_handle *handle, uint8_t index) {
+    unsigned char text[128] = "";
+    if (index != 0 && libusb_get_string_descriptor_ascii(handle, index, text, sizeof(text)) < 0) {
+        text[0] = '\0';
+    }
+    return device_cache_string((const char*)text);
+}
+
+// Metadata of the candidate's identity. Strings, topology and descriptors are
+// only read the first time a key is seen with this vendor, product and release.
+static DeviceMetadata* cache_usb_metadata(Device *candidate, libusb_device *device,
+                                          const struct libusb_device_descriptor *desc) {
+    int created;
+    DeviceMetadata *metadata = device_cache_get(candidate, desc->bcdDevice, &created);
+    if (metadata == NULL) {
+        return NULL;
+    }
+    if (created) {
+        metadata->bus = libusb_get_bus_number(device);
+        metadata->speed = (uint8_t)libusb_get_device_speed(device);
+        int depth = libusb_get_port_numbers(device, metadata->ports, sizeof(metadata->ports));
+        metadata->port_depth = depth > 0 ? (uint8_t)depth : 0;
+        metadata->manufacturer = read_string(candidate->handle, desc->iManufacturer);
+        metadata->product = read_string(candidate->handle, desc->iProduct);
+        const char *serial = strchr(candidate->key, '/');
+        metadata->serial = device_cache_string(serial != NULL ? serial + 1 : "");
+    }
+    return metadata;
+}
+
+// Looks at the active configuration without opening the device, so hubs and
+// other devices without HID interfaces are never opened.
+static int has_hid_interface(libusb_device *device) {
+    struct libusb_config_descriptor *config;
+    if (libusb_get_active_config_descriptor(device, &config) < 0) {
+        return 0;
+    }
+    int found = 0;
+    for (int i = 0; i < config->bNumInterfaces && !found; ++i) {
+        found = config->interface[i].num_altsetting > 0 &&
+                config->interface[i].altsetting[0].bInterfaceClass == LIBUSB_CLASS_HID;
+    }
+    libusb_free_config_descriptor(config);
+    return found;
+}
+
+static void connect_device(libusb_device *device) {
+    struct libusb_device_descriptor desc;
+    int res = libusb_get_device_descriptor(device, &desc);
+    if (res < 0) {
+        fprintf(stderr, "Failed to get device descriptor\n");
+        return;
+    }
+
+    // Any device class: composite devices (IAD/misc, vendor) carry HID interfaces too
+    if (!has_hid_interface(device)) {
+        return;
+    }
+    if (device_backend_for(desc.idVendor, desc.idProduct) != DEVICE_BACKEND_LIBUSB) {
+        return;
+    }
+
+    uint64_t instance_id = device_instance_id(device);
+    pthread_mutex_lock(&devices_mutex);
+    int already_connected = registry_find_instance(instance_id) >= 0;
+    pthread_mutex_unlock(&devices_mutex);
+
+    if (already_connected) {
+        return;
+    }
+
+    // Open, claim and read the descriptor without holding devices_mutex
+    Device candidate;
+    memset(&candidate, 0, sizeof(Device));
+    res = libusb_open(device, &candidate.handle);
+    if (res < 0) {
+        fprintf(stderr, "Failed to open device: %s\n", libusb_strerror(res));
+        return;
+    }
+    candidate.instance_id = instance_id;
+    candidate.backend = DEVICE_BACKEND_LIBUSB;
+    candidate.fd = -1;
+    build_device_key(device, candidate.handle, &desc, candidate.key, sizeof(candidate.key));
+
+    candidate.vendor_id = desc.idVendor;
+    candidate.product_id = desc.idProduct;
+    snprintf(candidate.device_name, sizeof(candidate.device_name), "%04x:%04x", desc.idVendor, desc.idProduct);
+    candidate.stats.connected_ns = monotonic_ns();
+    candidate.metadata = cache_usb_metadata(&candidate, device, &desc);
+
+    if (claim_hid_interfaces(&candidate) == 0) {
+        libusb_close(candidate.handle);
+        return;
+    }
+    if (default_filters_set) {
+        for (int i = 0; i < candidate.interface_count; ++i) {
+            configure_interface_filters(&candidate.interfaces[i], default_filters, -1);
+        }
+    }
+
+    pthread_mutex_lock(&devices_mutex);
+    int slot = -1;
+    int previous = registry_find_key(candidate.key);
+    if (previous < 0) {
+        candidate.stats.reconnects = stats_note_connect(candidate.key);
+        slot = registry_insert(&candidate);
+    }
+    // Replugged before the previous connection was reaped: retry once it is gone
+    int retry = previous >= 0 && registry_get(previous)->closing;
+    pthread_mutex_unlock(&devices_mutex);
+
+    if (slot < 0) {
+        if (retry) {
+            request_rescan();
+        } else {
+            fprintf(stderr, "Could not register device %s\n", candidate.key);
+        }
+        close_device(&candidate);
+        return;
+    }
+    Device *registered = registry_get(slot);
+
+    DeviceRawEvent connect_event;
+    init_event(&connect_event, registered, DEVICE_EVENT_CONNECTED);
+    dispatch_event(&connect_event);
+
+    pthread_mutex_lock(&devices_mutex);
+    if (start_device_transfers(registered) == 0) {
+        fprintf(stderr, "Failed to start transfers for device %d\n", slot);
+        cancel_device_transfers(registered);
+    }
+    pthread_mutex_unlock(&devices_mutex);
+}
+
+static void scan_devices(libusb_context *context) {
+    libusb_device **devices_list;
+    ssize_t count = libusb_get_device_list(context, &devices_list);
+    if (count < 0) {
+        fprintf(stderr, "Error getting USB device list\n");
+        return;
+    }
+    for (ssize_t i = 0; i < count; ++i) {
+        connect_device(devices_list[i]);
+    }
+    libusb_free_device_list(devices_list, 1);
+}
+
+static void process_hotplug_queue() {
+    while (1) {
+        pthread_mutex_lock(&hotplug_mutex);
+        if (hotplug_count == 0) {
+            pthread_mutex_unlock(&hotplug_mutex);
+            return;
+        }
+        HotplugEntry entry = hotplug_queue[hotplug_head];
+        hotplug_head = (hotplug_head + 1) % HOTPLUG_QUEUE_SIZE;
+        hotplug_count--;
+        pthread_mutex_unlock(&hotplug_mutex);
+
+        if (entry.event == LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED) {
+            connect_device(entry.device);
+        } else {
+            pthread_mutex_lock(&devices_mutex);
+            Device *gone = registry_get(registry_find_instance(device_instance_id(entry.device)));
+            if (gone != NULL && gone->handle != NULL) {
+                cancel_device_transfers(gone);
+            }
+            pthread_mutex_unlock(&devices_mutex);
+        }
+        libusb_unref_device(entry.device);
+    }
+}
+
+// Close devices whose transfers have all been retired
+static void reap_devices() {
+    for (int j = 0; j < registry_slot_count(); ++j) {
+        Device *device = registry_get(j);
+        pthread_mutex_lock(&devices_mutex);
+        int retired = device->in_use && device->handle != NULL && device->closing && device->pending_transfers == 0;
+        if (retired) {
+            close_device(device);
+        }
+        pthread_mutex_unlock(&devices_mutex);
+
+        if (retired) {
+            fprintf(stderr, "Device %d disconnected\n", j);
+            DeviceRawEvent disconnect_event;
+            init_event(&disconnect_event, device, DEVICE_EVENT_DISCONNECTED);
+            dispatch_event(&disconnect_event);
+
+            // Released only now so the slot is not reused while the event is delivered
+            pthread_mutex_lock(&devices_mutex);
+            registry_release(j);
+            pthread_mutex_unlock(&devices_mutex);
+        }
+    }
+}
+
+// Resubmits the parked transfers after a recovery. Must be called with devices_mutex held.
+static int resubmit_parked(Device *device) {
+    for (int i = 0; i < DEVICE_MAX_ENDPOINTS * DEVICE_TRANSFERS; ++i) {
+        if (!(device->parked_transfers & (1u << i))) {
+            continue;
+        }
+        int res = libusb_submit_transfer(device->transfers[i]);
+        if (res < 0) {
+            fprintf(stderr, "Failed to resubmit transfer of device %d: %s\n", device->device_index, libusb_strerror(res));
+            return res;
+        }
+        device->parked_transfers &= ~(1u << i);
+        device->pending_transfers++;
+    }
+    return 0;
+}
+
+// Clears stalled endpoints and resets devices whose transfers failed, then
+// puts the parked transfers back. Every failure doubles the wait before the
+// next attempt; after RECOVERY_ATTEMPTS, or when libusb says the device is
+// gone, the device is closed and gets its disconnect event. Returns the ms
+// until the next attempt is due, or -1.
+static int recover_devices() {
+    int next_ms = -1;
+    for (int j = 0; j < registry_slot_count(); ++j) {
+        Device *device = registry_get(j);
+        pthread_mutex_lock(&devices_mutex);
+        if (!device->in_use || device->handle == NULL || device->closing || device->recovery == DEVICE_RECOVERY_NONE) {
+            pthread_mutex_unlock(&devices_mutex);
+            continue;
+        }
+        uint64_t now = monotonic_ns();
+        if (now < device->recovery_ns) {
+            int wait_ms = (int)((device->recovery_ns - now + 999999) / 1000000);
+            next_ms = next_ms < 0 || wait_ms < next_ms ? wait_ms : next_ms;
+            pthread_mutex_unlock(&devices_mutex);
+            continue;
+        }
+        if (device->recovery == DEVICE_RECOVERY_RESET && device->pending_transfers > 0) {
+            // Nothing may be in flight during the reset; the last one to retire wakes us up
+            for (int i = 0; i < DEVICE_MAX_ENDPOINTS * DEVICE_TRANSFERS; ++i) {
+                if (device->transfers[i] != NULL && !(device->parked_transfers & (1u << i))) {
+                    libusb_cancel_transfer(device->transfers[i]);
+                }
+            }
+            if (device->output != NULL && device->output->in_flight) {
+                libusb_cancel_transfer(device->output->transfer);
+            }
+            pthread_mutex_unlock(&devices_mutex);
+            continue;
+        }
+        DeviceRecovery recovery = (DeviceRecovery)device->recovery;
+        uint8_t halted = device->halted_endpoints;
+        pthread_mutex_unlock(&devices_mutex);
+
+        // Blocking requests, made without devices_mutex so the event thread
+        // keeps running; only this thread closes devices
+        int res = 0;
+        if (recovery == DEVICE_RECOVERY_CLEAR_HALT) {
+            for (int i = 0; i < device->endpoint_count && res == 0; ++i) {
+                if (halted & (1u << i)) {
+                    res = libusb_clear_halt(device->handle, device->endpoints[i].address);
+                }
+            }
+        } else {
+            res = libusb_reset_device(device->handle);
+        }
+
+        pthread_mutex_lock(&devices_mutex);
+        if (device->closing) {
+            pthread_mutex_unlock(&devices_mutex);
+            continue;
+        }
+        if (res == 0) {
+            device->halted_endpoints &= (uint8_t)~halted;
+            if (recovery == DEVICE_RECOVERY_RESET) {
+                device->halted_endpoints = 0;
+            }
+            if (device->halted_endpoints == 0) {
+                __atomic_store_n(&device->recovery, DEVICE_RECOVERY_NONE, __ATOMIC_RELEASE);
+                res = resubmit_parked(device);
+                if (res == 0) {
+                    atomic_fetch_add_explicit(&device->stats.recoveries, 1, memory_order_relaxed);
+                    if (device->output != NULL) {
+                        submit_next_write(device);
+                    }
+                }
+            }
+        }
+        if (res < 0) {
+            atomic_fetch_add_explicit(&device->stats.errors, 1, memory_order_relaxed);
+            if (res == LIBUSB_ERROR_NO_DEVICE || res == LIBUSB_ERROR_NOT_FOUND ||
+                ++device->recovery_attempts >= RECOVERY_ATTEMPTS) {
+                fprintf(stderr, "Device %d did not recover: %s\n", j, libusb_strerror(res));
+                cancel_device_transfers(device);
+            } else {
+                // A clear-halt that failed escalates to a reset
+                device->recovery_ns = monotonic_ns() + recovery_backoff_ns(device->recovery_attempts);
+                __atomic_store_n(&device->recovery, DEVICE_RECOVERY_RESET, __ATOMIC_RELEASE);
+                int wait_ms = (int)(recovery_backoff_ns(device->recovery_attempts) / 1000000);
+                next_ms = next_ms < 0 || wait_ms < next_ms ? wait_ms : next_ms;
+            }
+        }
+        int retired = device->closing && device->pending_transfers == 0;
+        pthread_mutex_unlock(&devices_mutex);
+        if (retired) {
+            wake_monitor();
+        }
+    }
+    return next_ms;
+}
+
+static void dump_stats() {
+    uint64_t now = monotonic_ns();
+    pthread_mutex_lock(&devices_mutex);
+    int slots = registry_slot_count();
+    for (int i = 0; i < slots; i++) {
+        Device *device = registry_get(i);
+        if (!device->in_use) {
+            continue;
+        }
+        DeviceStatsSnapshot snapshot;
+        stats_snapshot(&device->stats, now, &snapshot);
+        stats_print(stderr, device->key, &snapshot);
+    }
+    pthread_mutex_unlock(&devices_mutex);
+}
+
+// Cancels every transfer and waits for the event thread to retire them, so
+// each device gets its disconnect event. Then stops the event thread.
+static void shut_down_devices() {
+    pthread_mutex_lock(&devices_mutex);
+    for (int i = 0; i < registry_slot_count(); ++i) {
+        Device *device = registry_get(i);
+        if (device->in_use && device->handle != NULL) {
+            cancel_device_transfers(device);
+        }
+    }
+    for (int i = 0; i < registry_slot_count(); ++i) {
+        Device *device = registry_get(i);
+        while (device->in_use && device->handle != NULL && device->pending_transfers > 0) {
+            pthread_cond_wait(&transfers_cond, &devices_mutex);
+        }
+    }
+    pthread_mutex_unlock(&devices_mutex);
+    reap_devices();
+
+    atomic_store(&manager.events_running, 0);
+    libusb_interrupt_event_handler(manager.context);
+    pthread_join(manager.event_thread, NULL);
+
+    // Hotplug events that arrived after the last pass still hold a reference
+    pthread_mutex_lock(&hotplug_mutex);
+    while (hotplug_count > 0) {
+        libusb_unref_device(hotplug_queue[hotplug_head].device);
+        hotplug_head = (hotplug_head + 1) % HOTPLUG_QUEUE_SIZE;
+        hotplug_count--;
+    }
+    rescan_needed = 0;
+    pthread_mutex_unlock(&hotplug_mutex);
+}
+
+void* monitor_devices(void* /*arg*/) {
+    thread_sched_apply(DEVICE_THREAD_MONITOR);
+    libusb_context *context = manager.context;
+
+    // Discovery: libusb hotplug callbacks, else kernel uevents, else polling
+    int uevent_fd = -1;
+    int hotplug = 0;
+    libusb_hotplug_callback_handle callback_handle;
+    if (libusb_has_capability(LIBUSB_CAP_HAS_HOTPLUG)) {
+        int res = libusb_hotplug_register_callback(context,
+                                                   LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED | LIBUSB_HOTPLUG_EVENT_DEVICE_LEFT,
+                                                   LIBUSB_HOTPLUG_ENUMERATE,
+                                                   LIBUSB_HOTPLUG_MATCH_ANY, LIBUSB_HOTPLUG_MATCH_ANY, LIBUSB_HOTPLUG_MATCH_ANY,
+                                                   hotplug_callback, NULL, &callback_handle);
+        if (res == LIBUSB_SUCCESS) {
+            hotplug = 1;
+        } else {
+            fprintf(stderr, "Failed to register hotplug callback: %s\n", libusb_strerror(res));
+        }
+    }
+    if (!hotplug) {
+        uevent_fd = open_uevent_socket();
+        scan_devices(context);
+    }
+
+    int settle_rescan = 0;
+    int recovery_ms = -1;
+    uint64_t next_dump = 0;
+    while (atomic_load(&manager.running)) {
+        struct pollfd fds[2];
+        nfds_t nfds = 0;
+        if (monitor_wake[0] >= 0) {
+            fds[nfds].fd = monitor_wake[0];
+            fds[nfds++].events = POLLIN;
+        }
+        if (uevent_fd >= 0) {
+            fds[nfds].fd = uevent_fd;
+            fds[nfds++].events = POLLIN;
+        }
+
+        int timeout = -1;
+        if (settle_rescan) {
+            timeout = 100;  // The device node may not be ready on the first uevent
+        } else if (!hotplug && uevent_fd < 0) {
+            timeout = 500;  // 500ms
+        }
+        if (recovery_ms >= 0 && (timeout < 0 || recovery_ms < timeout)) {
+            timeout = recovery_ms;
+        }
+        int dump_ms = stats_dump_ms;
+        if (dump_ms > 0) {
+            uint64_t now = monotonic_ns();
+            if (next_dump == 0 || now >= next_dump) {
+                if (next_dump != 0) {
+                    dump_stats();
+                }
+                next_dump = now + (uint64_t)dump_ms * 1000000ULL;
+            }
+            int until_dump = (int)((next_dump - now + 999999) / 1000000);
+            if (timeout < 0 || until_dump < timeout) {
+                timeout = until_dump;
+            }
+        } else {
+            next_dump = 0;
+        }
+        int ready = poll(fds, nfds, timeout);
+
+        if (monitor_wake[0] >= 0) {
+            char buffer[64];
+            while (read(monitor_wake[0], buffer, sizeof(buffer)) > 0) {
+            }
+        }
+
+        reap_devices();
+
+        if (hotplug) {
+            process_hotplug_queue();
+        } else if (uevent_fd < 0 || (ready == 0 && settle_rescan)) {
+            scan_devices(context);
+            settle_rescan = 0;
+        } else if (drain_uevents(uevent_fd)) {
+            scan_devices(context);
+            settle_rescan = 1;
+        }
+        if (take_rescan_request()) {
+            scan_devices(context);
+        }
+
+        recovery_ms = recover_devices();
+        reap_devices();
+    }
+
+    if (hotplug) {
+        libusb_hotplug_deregister_callback(context, callback_handle);
+    }
+    if (uevent_fd >= 0) {
+        close(uevent_fd);
+    }
+    shut_down_devices();
+    thread_sched_forget(DEVICE_THREAD_MONITOR);
+    return NULL;
+}
+
+void device_manager_set_raw_callback(void (*send_raw_func)(const DeviceRawEvent*)) {
+    send_raw = send_raw_func;
+}
+
+// Legacy string events; also used by replay and simulation without detect_devices().
+void device_manager_set_callback(void (*send_data_func)(DeviceEvent)) {
+    send_data = send_data_func;
+    send_raw = send_legacy_event;
+}
+
+void detect_devices_raw(void (*send_raw_func)(const DeviceRawEvent*)) {
+    device_manager_set_raw_callback(send_raw_func);
+    if (device_manager_start() == 0) {
+        printf("Device detection started.\n");
+    }
+}
+
+void detect_devices(void (*send_data_func)(DeviceEvent)) {
+    device_manager_set_callback(send_data_func);
+    detect_devices_raw(send_raw);
+}
+
+static int usb_available() {
+    libusb_context *context = NULL;
+    if (libusb_init(&context) < 0) {
+        return 0;
+    }
+    libusb_exit(context);
+    return 1;
+}
+
+// Starts the monitor and event threads of the libusb backend.
+static int usb_start() {
+    int res = libusb_init(&manager.context);
+    if (res < 0) {
+        fprintf(stderr, "Failed to initialize libusb: %s\n", libusb_strerror(res));
+        return -1;
+    }
+    if (pipe2(monitor_wake, O_NONBLOCK | O_CLOEXEC) < 0) {
+        fprintf(stderr, "Failed to create monitor wake pipe\n");
+        monitor_wake[0] = monitor_wake[1] = -1;
+    }
+
+    atomic_store(&manager.running, 1);
+    atomic_store(&manager.events_running, 1);
+    if (pthread_create(&manager.event_thread, NULL, read_device_data, manager.context) != 0) {
+        fprintf(stderr, "Failed to create event thread\n");
+    } else if (pthread_create(&manager.monitor_thread, NULL, monitor_devices, NULL) != 0) {
+        fprintf(stderr, "Failed to create monitor thread\n");
+        atomic_store(&manager.events_running, 0);
+        libusb_interrupt_event_handler(manager.context);
+        pthread_join(manager.event_thread, NULL);
+    } else {
+        manager.started = 1;
+        return 0;
+    }
+
+    close(monitor_wake[0]);
+    close(monitor_wake[1]);
+    monitor_wake[0] = monitor_wake[1] = -1;
+    libusb_exit(manager.context);
+    manager.context = NULL;
+    return -1;
+}
+
+// In-flight transfers are cancelled and every device gets its disconnect
+// event before the threads exit.
+static void usb_stop() {
+    if (manager.started) {
+        atomic_store(&manager.running, 0);
+        wake_monitor();
+    }
+}
+
+static void usb_join() {
+    if (manager.started) {
+        pthread_join(manager.monitor_thread, NULL);
+        close(monitor_wake[0]);
+        close(monitor_wake[1]);
+        monitor_wake[0] = monitor_wake[1] = -1;
+        libusb_exit(manager.context);
+        manager.context = NULL;
+        manager.started = 0;
+    }
+}
+
+const DeviceBackend usb_backend = {
+    DEVICE_BACKEND_LIBUSB, "libusb", usb_available, usb_start, usb_stop, usb_join,
+};
+
+static const DeviceBackend* backend_table(DeviceBackendKind kind) {
+    switch (kind) {
+        case DEVICE_BACKEND_LIBUSB: return &usb_backend;
+        case DEVICE_BACKEND_EVDEV: return &evdev_backend;
+        case DEVICE_BACKEND_HIDRAW: return &hidraw_backend;
+#ifdef DEVICE_WITH_SDL
+        case DEVICE_BACKEND_SDL: return &sdl_backend;
+#endif
+        default: return NULL;
+    }
+}
+
+// Backend that reads a device: an exact vendor/product rule, else a vendor
+// rule, else the default.
+DeviceBackendKind device_backend_for(int vendor_id, int product_id) {
+    pthread_mutex_lock(&backend_mutex);
+    DeviceBackendKind backend = default_backend;
+    int vendor_match = 0;
+    for (int i = 0; i < backend_rule_count; ++i) {
+        const BackendRule *rule = &backend_rules[i];
+        if (rule->vendor_id != vendor_id) {
+            continue;
+        }
+        if (rule->product_id == product_id) {
+            backend = rule->backend;
+            break;
+        }
+        if (rule->product_id == 0 && !vendor_match) {
+            backend = rule->backend;
+            vendor_match = 1;
+        }
+    }
+    pthread_mutex_unlock(&backend_mutex);
+    return backend;
+}
+
+// Chooses the backend for a vendor/product (product_id 0 for every product
+// of the vendor, both 0 for the default). Backends are started by
+// device_manager_start(), so a backend that is not running yet only takes
+// effect from the next start.
+int device_manager_set_backend(int vendor_id, int product_id, DeviceBackendKind backend) {
+    if (backend_table(backend) == NULL) {
+        fprintf(stderr, "Backend %d is not built into this library\n", (int)backend);
+        return -1;
+    }
+    pthread_mutex_lock(&backend_mutex);
+    int res = 0;
+    if (vendor_id == 0 && product_id == 0) {
+        default_backend = backend;
+    } else {
+        int i = 0;
+        while (i < backend_rule_count &&
+               (backend_rules[i].vendor_id != vendor_id || backend_rules[i].product_id != product_id)) {
+            ++i;
+        }
+        if (i == DEVICE_BACKEND_RULES) {
+            res = -1;
+        } else {
+            backend_rules[i].vendor_id = vendor_id;
+            backend_rules[i].product_id = product_id;
+            backend_rules[i].backend = backend;
+            if (i == backend_rule_count) {
+                backend_rule_count++;
+            }
+        }
+    }
+    pthread_mutex_unlock(&backend_mutex);
+    return res;
+}
+
+int device_manager_backend_available(DeviceBackendKind backend) {
+    const DeviceBackend *table = backend_table(backend);
+    return table != NULL && table->available();
+}
+
+// Starts every backend that the default or a rule selects. Calling it again
+// while they run does nothing, so a caller may call detect_devices() on every
+// reconnect. Returns -1 if no backend could be started.
+int device_manager_start() {
+    pthread_mutex_lock(&lifecycle_mutex);
+    if (joining) {
+        fprintf(stderr, "Cannot start while the previous run is being joined\n");
+        pthread_mutex_unlock(&lifecycle_mutex);
+        return -1;
+    }
+    if (started_backends != 0) {
+        pthread_mutex_unlock(&lifecycle_mutex);
+        return 0;
+    }
+    unsigned wanted;
+    pthread_mutex_lock(&backend_mutex);
+    wanted = 1u << default_backend;
+    for (int i = 0; i < backend_rule_count; ++i) {
+        wanted |= 1u << backend_rules[i].backend;
+    }
+    pthread_mutex_unlock(&backend_mutex);
+
+    for (int kind = 0; kind < DEVICE_BACKEND_COUNT; ++kind) {
+        const DeviceBackend *backend = backend_table((DeviceBackendKind)kind);
+        if ((wanted & (1u << kind)) && backend != NULL) {
+            if (backend->start() == 0) {
+                started_backends |= 1u << kind;
+            } else {
+                fprintf(stderr, "Could not start the %s backend\n", backend->name);
+            }
+        }
+    }
+    stopping = 0;
+    if (queue_enabled) {
+        event_queue_close(&event_queue, 0);
+    }
+    int res = started_backends != 0 ? 0 : -1;
+    pthread_mutex_unlock(&lifecycle_mutex);
+    return res;
+}
+
+// Called with lifecycle_mutex held
+static void stop_backends() {
+    if (joining) {
+        return;  // Already stopped by device_manager_join()
+    }
+    if (queue_enabled) {
+        // The consumer may stop polling now; the threads must still get out
+        event_queue_close(&event_queue, 1);
+    }
+    for (int kind = 0; kind < DEVICE_BACKEND_COUNT; ++kind) {
+        if (started_backends & (1u << kind)) {
+            backend_table((DeviceBackendKind)kind)->stop();
+        }
+    }
+    stopping = started_backends != 0;
+}
+
+// Asks every backend to stop and returns at once.
+void device_manager_stop() {
+    pthread_mutex_lock(&lifecycle_mutex);
+    stop_backends();
+    pthread_mutex_unlock(&lifecycle_mutex);
+}
+
+// Stops the run if device_manager_stop() was not called, waits for its
+// threads and frees their resources. Every device gets its disconnect event.
+// The threads are joined without lifecycle_mutex, so a callback may still
+// call device_manager_stop() or device_manager_running() meanwhile.
+// device_manager_start() can be called again afterwards.
+void device_manager_join() {
+    pthread_mutex_lock(&lifecycle_mutex);
+    if (joining) {
+        // Another thread is joining this run; wait until it is done
+        while (joining) {
+            pthread_cond_wait(&lifecycle_cond, &lifecycle_mutex);
+        }
+        pthread_mutex_unlock(&lifecycle_mutex);
+        return;
+    }
+    stop_backends();
+    unsigned backends = started_backends;
+    joining = 1;
+    pthread_mutex_unlock(&lifecycle_mutex);
+
+    for (int kind = 0; kind < DEVICE_BACKEND_COUNT; ++kind) {
+        if (backends & (1u << kind)) {
+            backend_table((DeviceBackendKind)kind)->join();
+        }
+    }
+
+    pthread_mutex_lock(&lifecycle_mutex);
+    started_backends = 0;
+    stopping = 0;
+    joining = 0;
+    pthread_cond_broadcast(&lifecycle_cond);
+    pthread_mutex_unlock(&lifecycle_mutex);
+}
+
+int device_manager_running() {
+    pthread_mutex_lock(&lifecycle_mutex);
+    int running = started_backends != 0 && !stopping;
+    pthread_mutex_unlock(&lifecycle_mutex);
+    return running;
+}
+
+// Route events through a lock-free queue instead of the callback. Must be
+// called before detect_devices_raw(); the consumer drains with device_manager_poll().
+// With DEVICE_QUEUE_BLOCK the readers wait for the consumer while the
+// library runs; from device_manager_stop() on, a full queue drops instead.
+// clean_up_devices() frees the queue, so it has to be enabled again after it.
+int device_manager_enable_queue(size_t capacity, DeviceQueueOverflow overflow) {
+    if (queue_enabled) {
+        return 0;
+    }
+    if (event_queue_init(&event_queue, capacity, overflow) < 0) {
+        return -1;
+    }
+    queue_enabled = 1;
+    return 0;
+}
+
+// Deliver events in batches from a dedicated thread instead of one callback per
+// event. A batch is flushed when batch_size events are pending or the oldest
+// has waited deadline_us. Takes precedence over the queue and the per-event
+// callbacks; call before detect_devices_raw(). user is passed back untouched.
+int device_manager_set_batch_callback(DeviceBatchCallback callback, void* user, size_t batch_size, int deadline_us) {
+    if (batch_enabled || callback == NULL) {
+        return -1;
+    }
+    if (deadline_us <= 0) {
+        deadline_us = 250;
+    }
+    if (event_batcher_start(&event_batcher, callback, user, batch_size, (uint64_t)deadline_us * 1000ull) < 0) {
+        return -1;
+    }
+    batch_enabled = 1;
+    return 0;
+}
+
+// Also deliver one DeviceFrame per tick at rate_hz from a dedicated thread:
+// the latest report of every device plus the events captured in the window,
+// sorted by their CLOCK_MONOTONIC capture timestamp. A window is delivered
+// budget_us after it closes (default 1000) so slow reports still land in it;
+// past max_events (default 1024) events are dropped and counted. Works
+// alongside the other delivery paths; call before detect_devices_raw().
+int device_manager_set_frame_callback(DeviceFrameCallback callback, void* user, int rate_hz, size_t max_events, int budget_us) {
+    if (frame_enabled || callback == NULL || rate_hz <= 0) {
+        return -1;
+    }
+    if (max_events == 0) {
+        max_events = 1024;
+    }
+    if (budget_us <= 0) {
+        budget_us = 1000;
+    }
+    if (event_framer_start(&event_framer, callback, user, rate_hz, max_events, (uint64_t)budget_us * 1000ull) < 0) {
+        return -1;
+    }
+    frame_enabled = 1;
+    return 0;
+}
+
+// Also publish every event into a shared-memory ring named name (e.g.
+// "/device_events") that other processes read with device_shm_open(). mode is
+// the permission of the segment; readers need write access to block on it.
+// Works alongside the callback, queue or batch delivery. Call before
+// detect_devices_raw(); the segment is removed by clean_up_devices().
+int device_manager_publish_shm(const char* name, size_t capacity, int mode) {
+    if (shm_enabled) {
+        return -1;
+    }
+    if (event_shm_create(&shm_publisher, name, capacity, mode) < 0) {
+        return -1;
+    }
+    shm_enabled = 1;
+    return 0;
+}
+
+// Stream every event to a TCP peer in the compact framing of event_net.h.
+// A sender thread batches frames with writev-style sends and reconnects
+// with backoff; events queue up to capacity and then follow overflow. With
+// change_only, unchanged reports are skipped and changed ones sent as deltas.
+int device_manager_stream_connect(const char* host, int port, size_t capacity, DeviceQueueOverflow overflow, int change_only) {
+    if (stream_enabled || host == NULL) {
+        return -1;
+    }
+    if (event_net_start(&net_stream, host, port, -1, capacity, overflow, change_only) < 0) {
+        return -1;
+    }
+    stream_enabled = 1;
+    return 0;
+}
+
+// Same, over an already connected stream socket (or one end of a socketpair).
+// The library owns fd afterwards; there is no reconnect once it fails.
+int device_manager_stream_fd(int fd, size_t capacity, DeviceQueueOverflow overflow, int change_only) {
+    if (stream_enabled || fd < 0) {
+        return -1;
+    }
+    if (event_net_start(&net_stream, NULL, 0, fd, capacity, overflow, change_only) < 0) {
+        return -1;
+    }
+    stream_enabled = 1;
+    return 0;
+}
+
+void device_manager_stream_stats(DeviceStreamStats* stats) {
+    memset(stats, 0, sizeof(DeviceStreamStats));
+    if (!stream_enabled) {
+        return;
+    }
+    stats->frames = atomic_load(&net_stream.frames);
+    stats->bytes = atomic_load(&net_stream.bytes);
+    stats->suppressed = atomic_load(&net_stream.suppressed);
+    stats->dropped = atomic_load(&net_stream.queue.dropped);
+    stats->reconnects = atomic_load(&net_stream.reconnects);
+    stats->connected = atomic_load(&net_stream.connected);
+}
+
+size_t device_manager_poll(DeviceRawEvent* events, size_t max) {
+    if (!queue_enabled) {
+        return 0;
+    }
+    return event_queue_pop(&event_queue, events, max);
+}
+
+uint64_t device_manager_dropped_events() {
+    if (!queue_enabled) {
+        return 0;
+    }
+    return atomic_load_explicit(&event_queue.dropped, memory_order_relaxed);
+}
+
+// When enabled, detect_devices() reports decoded axes, buttons and hats
+// like the SDL version instead of hex dumps of the raw reports.
+void device_manager_set_decoding(int enabled) {
+    decode_reports = enabled;
+}
+
+// Decodes a report event with the compiled layout of its device. Returns 0
+// once that connection is gone, even if its slot already holds another device.
+int device_manager_decode(const DeviceRawEvent* event, HidValue* values, int max) {
+    if (event->kind != DEVICE_EVENT_REPORT || event->device_id < 0) {
+        return 0;
+    }
+    // Events drained late may belong to a connection whose slot was reused
+    DeviceHandle handle = ((uint32_t)event->generation << 16) | ((uint32_t)event->device_id & 0xffff);
+    int count = 0;
+    pthread_mutex_lock(&devices_mutex);
+    Device *device = registry_resolve(handle);
+    const DeviceInterface *interface = device != NULL ? find_interface(device, event->interface_number) : NULL;
+    if (interface != NULL && interface->layout != NULL) {
+        count = hid_decode_report(interface->layout, event->data, event->length, values, max);
+    }
+    pthread_mutex_unlock(&devices_mutex);
+    return count;
+}
+
+// Reports identical to the previous one of the same kind are always counted;
+// DEVICE_DEDUP_SUPPRESS also drops them (devices with axis filters excepted).
+void device_manager_set_dedup(DeviceDedupMode mode) {
+    dedup_mode = mode;
+}
+
+// Latest report of a device, for consumers that sample instead of taking
+// callbacks. Lock-free; -1 for a free slot or before the first report.
+int device_manager_get_state(int index, DeviceRawEvent* state) {
+    Device *device = registry_get(index);
+    if (device == NULL || !__atomic_load_n(&device->in_use, __ATOMIC_ACQUIRE)) {
+        return -1;
+    }
+    int entry = device_state_latest(index);
+    return entry >= 0 ? device_state_read(index, entry, state) : -1;
+}
+
+// Latest report of every kind (interface, endpoint, report ID) the device
+// sent, up to DEVICE_STATE_REPORTS of them. Returns how many were copied.
+int device_manager_get_states(int index, DeviceRawEvent* states, int max) {
+    Device *device = registry_get(index);
+    if (device == NULL || !__atomic_load_n(&device->in_use, __ATOMIC_ACQUIRE)) {
+        return 0;
+    }
+    int count = 0;
+    for (int i = 0; i < DEVICE_STATE_REPORTS && count < max; ++i) {
+        if (device_state_read(index, i, &states[count]) == 0) {
+            count++;
+        }
+    }
+    return count;
+}
+
+// Queues an output or feature report for a libusb device. data[0] is the
+// report ID (0 if the interface has none) followed by the report. Never waits
+// for the device: the report is sent by the event thread, and a queued report
+// with the same type, interface and ID is replaced. 0 if queued, -1 otherwise.
+int device_manager_write_report(int index, int interface_number, DeviceReportType type, const uint8_t* data, size_t length) {
+    if (data == NULL || length == 0 || length > DEVICE_OUTPUT_MAX ||
+        (type != DEVICE_REPORT_OUTPUT && type != DEVICE_REPORT_FEATURE)) {
+        return -1;
+    }
+    DeviceOutputReport report;
+    report.type = (uint8_t)type;
+    report.interface_number = (uint8_t)interface_number;
+    report.length = (uint16_t)length;
+    memcpy(report.data, data, length);
+
+    int res = -1;
+    pthread_mutex_lock(&devices_mutex);
+    Device *device = registry_get(index);
+    if (device != NULL && device->in_use && device->output != NULL && !device->closing &&
+        find_interface(device, (uint8_t)interface_number) != NULL) {
+        res = device_output_push(device->output, &report);
+        if (res == 1) {
+            atomic_fetch_add_explicit(&device->stats.coalesced, 1, memory_order_relaxed);
+        }
+        if (res >= 0) {
+            submit_next_write(device);
+        }
+    }
+    pthread_mutex_unlock(&devices_mutex);
+    return res < 0 ? -1 : 0;
+}
+
+// Deadzone, hysteresis, rate limit and smoothing for one axis (or all axes
+// with axis -1) of a device. index -1 changes the default used for every
+// device, including the ones connected later. Once a device has filters,
+// reports in which no field changes after filtering are not delivered.
+int device_manager_set_axis_filter(int index, int axis, const AxisFilterConfig* filter) {
+    if (filter == NULL || axis >= AXIS_FILTER_MAX) {
+        return -1;
+    }
+    pthread_mutex_lock(&devices_mutex);
+    // Axes that are not selected take the defaults. Existing banks only
+    // change the selected axes, so this only matters for a device that gets
+    // its first filter here.
+    AxisFilterConfig configs[AXIS_FILTER_MAX];
+    for (int i = 0; i < AXIS_FILTER_MAX; ++i) {
+        configs[i] = (axis < 0 || axis == i) ? *filter : default_filters[i];
+    }
+    if (index < 0) {
+        memcpy(default_filters, configs, sizeof(configs));
+        default_filters_set = 1;
+    }
+
+    int res = -1;
+    int first = index < 0 ? 0 : index;
+    int last = index < 0 ? registry_slot_count() - 1 : index;
+    for (int slot = first; slot <= last; ++slot) {
+        Device *device = registry_get(slot);
+        if (device == NULL || !device->in_use) {
+            continue;
+        }
+        for (int i = 0; i < device->interface_count; ++i) {
+            configure_interface_filters(&device->interfaces[i], configs, axis);
+        }
+        res = 0;
+    }
+    pthread_mutex_unlock(&devices_mutex);
+    return index < 0 ? 0 : res;
+}
+
+// Real-time policy, priority and CPU pinning for the reader, monitor or
+// delivery thread. Can be called before or after detect_devices_raw();
+// settings the process is not allowed to use fall back to the closest one
+// that works, see device_manager_get_thread_status().
+int device_manager_set_thread_config(DeviceThreadRole role, const DeviceThreadConfig* config) {
+    if (role < 0 || role >= DEVICE_THREAD_ROLES || config == NULL) {
+        return -1;
+    }
+    thread_sched_configure(role, config);
+    return 0;
+}
+
+// What the threads of a role actually run with. status->running counts them, 0 until one has started.
+int device_manager_get_thread_status(DeviceThreadRole role, DeviceThreadStatus* status) {
+    if (role < 0 || role >= DEVICE_THREAD_ROLES || status == NULL) {
+        return -1;
+    }
+    thread_sched_status(role, status);
+    return 0;
+}
+
+// mlockall() for the whole process; call before detect_devices_raw() so thread stacks are locked too.
+int device_manager_lock_memory(int enable) {
+    return thread_sched_lock_memory(enable);
+}
+
+int device_manager_memory_locked() {
+    return thread_sched_memory_locked();
+}
+
+const Device* get_device(int index) {
+    return registry_get(index);
+}
+
+int get_device_count() {
+    pthread_mutex_lock(&devices_mutex);
+    int count = registry_used_count();
+    pthread_mutex_unlock(&devices_mutex);
+    return count;
+}
+
+// Number of slots to iterate with get_device(); released slots have in_use == 0.
+int get_device_slot_count() {
+    return registry_slot_count();
+}
+
+DeviceHandle get_device_handle(int index) {
+    pthread_mutex_lock(&devices_mutex);
+    DeviceHandle handle = registry_handle(index);
+    pthread_mutex_unlock(&devices_mutex);
+    return handle;
+}
+
+// Like get_device(), but returns NULL once the device behind the handle is gone.
+const Device* get_device_checked(DeviceHandle handle) {
+    pthread_mutex_lock(&devices_mutex);
+    const Device *device = registry_resolve(handle);
+    pthread_mutex_unlock(&devices_mutex);
+    return device;
+}
+
+// Copies the identity of an in-use slot; -1 for a free or unknown slot.
+int get_device_info(int index, DeviceInfo* info) {
+    int res = -1;
+    pthread_mutex_lock(&devices_mutex);
+    Device *device = registry_get(index);
+    if (device != NULL && device->in_use) {
+        memset(info, 0, sizeof(DeviceInfo));
+        info->device_index = device->device_index;
+        info->backend = device->backend;
+        info->vendor_id = device->vendor_id;
+        info->product_id = device->product_id;
+        info->handle = registry_handle(index);
+        memcpy(info->device_name, device->device_name, sizeof(info->device_name));
+        memcpy(info->key, device->key, sizeof(info->key));
+        res = 0;
+    }
+    pthread_mutex_unlock(&devices_mutex);
+    return res;
+}
+
+// Cached static metadata of an in-use slot. The pointer stays valid after the
+// device disconnects; NULL for free slots and replayed or simulated devices.
+const DeviceMetadata* get_device_metadata(int index) {
+    const DeviceMetadata *metadata = NULL;
+    pthread_mutex_lock(&devices_mutex);
+    Device *device = registry_get(index);
+    if (device != NULL && device->in_use) {
+        metadata = device->metadata;
+    }
+    pthread_mutex_unlock(&devices_mutex);
+    return metadata;
+}
+
+// Per-device counters and latency percentiles for an in-use slot.
+int device_manager_get_stats(int index, DeviceStatsSnapshot* stats) {
+    int res = -1;
+    pthread_mutex_lock(&devices_mutex);
+    Device *device = registry_get(index);
+    if (device != NULL && device->in_use) {
+        stats_snapshot(&device->stats, monotonic_ns(), stats);
+        res = 0;
+    }
+    pthread_mutex_unlock(&devices_mutex);
+    return res;
+}
+
+// Print the stats of every connected device to stderr every interval_ms (0 disables).
+void device_manager_set_stats_dump(int interval_ms) {
+    stats_dump_ms = interval_ms > 0 ? interval_ms : 0;
+    wake_monitor();
+}
+
+// Records every dispatched event (including replayed ones) until stopped.
+int device_manager_start_capture(const char* path) {
+    pthread_mutex_lock(&capture_mutex);
+    if (capture_enabled) {
+        capture_writer_close(&capture_writer);
+        capture_enabled = 0;
+    }
+    int res = capture_writer_open(&capture_writer, path, monotonic_ns());
+    capture_enabled = res == 0;
+    pthread_mutex_unlock(&capture_mutex);
+    return res;
+}
+
+void device_manager_stop_capture() {
+    pthread_mutex_lock(&capture_mutex);
+    if (capture_enabled) {
+        capture_writer_close(&capture_writer);
+        capture_enabled = 0;
+    }
+    pthread_mutex_unlock(&capture_mutex);
+}
+
+// Replayed and simulated devices live in the registry like real ones, just
+// without a USB handle, so events take exactly the same dispatch path.
+// Registers a device and delivers its connect event. Returns the slot, or
+// -1 if a device with the same key is already connected.
+static int register_device(Device *candidate, int note_reconnect) {
+    pthread_mutex_lock(&devices_mutex);
+    int slot = -1;
+    if (registry_find_key(candidate->key) < 0) {
+        if (note_reconnect) {
+            candidate->stats.reconnects = stats_note_connect(candidate->key);
+        }
+        slot = registry_insert(candidate);
+    }
+    pthread_mutex_unlock(&devices_mutex);
+    if (slot < 0) {
+        return -1;
+    }
+
+    DeviceRawEvent connect_event;
+    init_event(&connect_event, registry_get(slot), DEVICE_EVENT_CONNECTED);
+    dispatch_event(&connect_event);
+    return slot;
+}
+
+static int add_virtual_device(const char *prefix, uint16_t vendor_id, uint16_t product_id) {
+    Device candidate;
+    memset(&candidate, 0, sizeof(Device));
+    candidate.vendor_id = vendor_id;
+    candidate.product_id = product_id;
+    candidate.fd = -1;
+    snprintf(candidate.device_name, sizeof(candidate.device_name), "%04x:%04x", vendor_id, product_id);
+    snprintf(candidate.key, sizeof(candidate.key), "%s-%u", prefix,
+             atomic_fetch_add_explicit(&virtual_devices, 1, memory_order_relaxed));
+    candidate.stats.connected_ns = monotonic_ns();
+    return register_device(&candidate, 0);
+}
+
+static void remove_virtual_device(int slot) {
+    DeviceRawEvent disconnect_event;
+    init_event(&disconnect_event, registry_get(slot), DEVICE_EVENT_DISCONNECTED);
+    dispatch_event(&disconnect_event);
+
+    pthread_mutex_lock(&devices_mutex);
+    registry_release(slot);
+    pthread_mutex_unlock(&devices_mutex);
+}
+
+// Entry points for the backends in other files, see device_backend.h.
+// The registry takes over the interface allocations of the candidate, also when it fails.
+int backend_add_device(const Device* candidate) {
+    Device device = *candidate;
+    device.stats.connected_ns = monotonic_ns();
+    int created;
+    DeviceMetadata *metadata = device_cache_get(&device, -1, &created);
+    if (metadata != NULL) {
+        for (int i = 0; i < device.interface_count; ++i) {
+            device_cache_adopt(metadata, &device.interfaces[i]);
+        }
+    }
+    device.metadata = metadata;
+    if (default_filters_set) {
+        for (int i = 0; i < device.interface_count; ++i) {
+            configure_interface_filters(&device.interfaces[i], default_filters, -1);
+        }
+    }
+    int slot = register_device(&device, 1);
+    if (slot < 0) {
+        free_interfaces(&device);
+    }
+    return slot;
+}
+
+// length is the size of the report as read, event->length may be truncated.
+void backend_report(Device* device, DeviceRawEvent* event, size_t length) {
+    deliver_report(device, event, length);
+}
+
+void backend_remove_device(int slot) {
+    DeviceRawEvent disconnect_event;
+    init_event(&disconnect_event, registry_get(slot), DEVICE_EVENT_DISCONNECTED);
+    dispatch_event(&disconnect_event);
+
+    pthread_mutex_lock(&devices_mutex);
+    free_interfaces(registry_get(slot));
+    registry_release(slot);
+    pthread_mutex_unlock(&devices_mutex);
+}
+
+void backend_init_event(DeviceRawEvent* event, Device* device, DeviceEventKind kind) {
+    init_event(event, device, kind);
+}
+
+uint64_t backend_time_ns() {
+    return monotonic_ns();
+}
+
+static void sleep_until(uint64_t deadline_ns) {
+    struct timespec ts;
+    ts.tv_sec = (time_t)(deadline_ns / 1000000000ull);
+    ts.tv_nsec = (long)(deadline_ns % 1000000000ull);
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {
+    }
+}
+
+// Feeds a capture file through the same delivery path as live reports (stats,
+// state, dedup, filters) on the calling thread.
+// Events are re-stamped with the current time so latency stats stay
+// meaningful. Returns the number of records replayed, or -1.
+long device_manager_replay(const char* path, DeviceReplayMode mode) {
+    CaptureFile capture;
+    if (capture_map(&capture, path) < 0) {
+        return -1;
+    }
+    int *slots = malloc(DEVICE_REGISTRY_MAX * sizeof(int));
+    if (slots == NULL) {
+        capture_unmap(&capture);
+        return -1;
+    }
+    for (int i = 0; i < DEVICE_REGISTRY_MAX; i++) {
+        slots[i] = -1;
+    }
+
+    uint64_t start = monotonic_ns();
+    uint64_t first = capture.record_count > 0 ? capture.records[0].timestamp_ns : 0;
+    long replayed = 0;
+    for (uint64_t i = 0; i < capture.record_count; i++) {
+        const CaptureRecord *record = &capture.records[i];
+        if (record->device_id < 0 || record->device_id >= DEVICE_REGISTRY_MAX) {
+            continue;
+        }
+        if (mode == DEVICE_REPLAY_REALTIME && record->timestamp_ns > first) {
+            sleep_until(start + (record->timestamp_ns - first));
+        }
+
+        int *slot = &slots[record->device_id];
+        if (record->kind == CAPTURE_KIND_DISCONNECTED) {
+            if (*slot >= 0) {
+                remove_virtual_device(*slot);
+                *slot = -1;
+            }
+            replayed++;
+            continue;
+        }
+        if (*slot < 0) {
+            // Captures may start while the device is already connected
+            *slot = add_virtual_device("replay", record->vendor_id, record->product_id);
+            if (*slot < 0) {
+                continue;
+            }
+        }
+        if (record->kind == CAPTURE_KIND_REPORT) {
+            Device *device = registry_get(*slot);
+            DeviceRawEvent event;
+            init_event(&event, device, DEVICE_EVENT_REPORT);
+            event.interface_number = record->interface_number;
+            event.endpoint = record->endpoint;
+            event.flags = record->flags;
+            if (record->source == CAPTURE_SOURCE_SDL) {
+                event.flags |= DEVICE_EVENT_SDL;
+            }
+            event.length = record->length < DEVICE_REPORT_MAX ? record->length : DEVICE_REPORT_MAX;
+            memcpy(event.data, record->data, event.length);
+            deliver_report(device, &event, record->length);
+        }
+        replayed++;
+    }
+
+    for (int i = 0; i < DEVICE_REGISTRY_MAX; i++) {
+        if (slots[i] >= 0) {
+            remove_virtual_device(slots[i]);
+        }
+    }
+    free(slots);
+    capture_unmap(&capture);
+    return replayed;
+}
+
+// Emulates device_count gamepads sending report_length-byte reports at
+// report_rate_hz each for duration_ms. Devices are phase-shifted so their
+// reports interleave like independent hardware. In DEVICE_REPLAY_FAST mode
+// the same reports are generated without sleeping. Returns the number of
+// reports dispatched, or -1.
+long device_manager_simulate(int device_count, int report_rate_hz, int report_length, int duration_ms, DeviceReplayMode mode) {
+    if (device_count <= 0 || report_rate_hz <= 0 || duration_ms <= 0) {
+        return -1;
+    }
+    if (report_length <= 0 || report_length > DEVICE_REPORT_MAX) {
+        report_length = DEVICE_REPORT_MAX;
+    }
+
+    int *slots = malloc((size_t)device_count * sizeof(int));
+    uint64_t *next = malloc((size_t)device_count * sizeof(uint64_t));
+    if (slots == NULL || next == NULL) {
+        free(slots);
+        free(next);
+        return -1;
+    }
+
+    uint64_t period = 1000000000ull / (uint64_t)report_rate_hz;
+    uint64_t start = monotonic_ns();
+    for (int i = 0; i < device_count; i++) {
+        slots[i] = add_virtual_device("simulated", 0xfeed, (uint16_t)i);
+        next[i] = period * (uint64_t)i / (uint64_t)device_count;
+    }
+
+    uint64_t end = (uint64_t)duration_ms * 1000000ull;
+    long reports = 0;
+    while (1) {
+        // Earliest due device; device counts are small enough for a linear scan
+        int due = 0;
+        for (int i = 1; i < device_count; i++) {
+            if (next[i] < next[due]) {
+                due = i;
+            }
+        }
+        if (next[due] >= end) {
+            break;
+        }
+        if (mode == DEVICE_REPLAY_REALTIME) {
+            sleep_until(start + next[due]);
+        }
+        next[due] += period;
+        if (slots[due] < 0) {
+            continue;
+        }
+
+        Device *device = registry_get(slots[due]);
+        DeviceRawEvent event;
+        init_event(&event, device, DEVICE_EVENT_REPORT);
+        event.length = (uint16_t)report_length;
+        // Slowly sweeping axes and a rotating button bit, like a held stick
+        for (int b = 0; b < report_length; b++) {
+            event.data[b] = (uint8_t)((event.sequence >> (b & 3)) + (uint32_t)b * 17u);
+        }
+        event.data[0] = (uint8_t)(1u << (event.sequence & 7));
+        deliver_report(device, &event, event.length);
+        reports++;
+    }
+
+    for (int i = 0; i < device_count; i++) {
+        if (slots[i] >= 0) {
+            remove_virtual_device(slots[i]);
+        }
+    }
+    free(slots);
+    free(next);
+    return reports;
 }
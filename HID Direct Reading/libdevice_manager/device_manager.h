@@ -7,19 +7,184 @@ extern "C" {
 
 #include <libusb-1.0/libusb.h>
 #include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "hid_parser.h"
+#include "device_stats.h"
+#include "axis_filter.h"
+#include "thread_sched.h"
 
-#define MAX_DEVICES 6
+#define DEVICE_REGISTRY_MAX 4096     // Upper bound on simultaneously known devices
+#define DEVICE_KEY_MAX 96
 #define HID_GET_DESCRIPTOR 0x06
 #define HID_REPORT_DESCRIPTOR 0x22
+#define HID_SET_REPORT 0x09
+#ifndef DEVICE_REPORT_MAX
+#define DEVICE_REPORT_MAX 64         // Report bytes carried inline by DeviceRawEvent
+#endif
+#define DEVICE_DESCRIPTOR_MAX 4096
+#define DEVICE_OUTPUT_MAX 64         // Bytes of an output or feature report, report ID included
+#define DEVICE_TRANSFERS 4           // Interrupt transfers queued per endpoint
+#define DEVICE_MAX_INTERFACES 8
+#define DEVICE_MAX_ENDPOINTS 8
+#define DEVICE_STATE_REPORTS 8       // Report kinds kept per device by device_manager_get_states()
+
+// Slot in the low 16 bits, slot generation in the high 16 bits. A handle stops
+// resolving as soon as its slot is released, even if the slot is reused.
+typedef uint32_t DeviceHandle;
+#define DEVICE_HANDLE_INVALID 0
+
+// A claimed HID-class interface.
+typedef struct {
+    uint8_t interface_number;
+    uint8_t kernel_driver_detached;
+    unsigned char* report_descriptor;
+    int report_descriptor_length;
+    HidLayout* layout;      // Decode table compiled from the report descriptor
+    int32_t* field_values;  // Last decoded value of every field
+    AxisFilterBank* filters;    // NULL until an axis filter is configured
+    int32_t* filtered_values;   // Field values after filtering, used with filters
+    struct DeviceRawEvent* axis_report; // Last report with axes, repeated when the filters catch up
+    struct AxisFilterUpdate* filter_update; // Configuration waiting for the reader thread
+    uint8_t cached;         // Descriptor and layout belong to the metadata cache, never freed
+    uint8_t out_endpoint;   // Interrupt OUT endpoint, 0 if output reports go through SET_REPORT
+} DeviceInterface;
+
+// An interrupt IN endpoint of a claimed interface.
+typedef struct {
+    uint8_t address;
+    uint8_t interface_number;
+    uint8_t interval;       // bInterval, the host controller polls at this rate
+    uint16_t max_packet_size;
+} DeviceEndpoint;
+
+// Where a device's reports come from. Chosen per device with
+// device_manager_set_backend(); one backend reads each device.
+typedef enum {
+    DEVICE_BACKEND_LIBUSB = 0,      // Raw HID reports through libusb (detaches the kernel driver)
+    DEVICE_BACKEND_EVDEV,           // Linux input events from /dev/input/event*
+    DEVICE_BACKEND_SDL,             // SDL joystick events; needs a build with -DDEVICE_WITH_SDL
+    DEVICE_BACKEND_HIDRAW,          // Raw HID reports from /dev/hidraw*, kernel driver stays attached
+    DEVICE_BACKEND_COUNT,
+} DeviceBackendKind;
+
+// Recovery of a device whose transfers failed without it being unplugged.
+typedef enum {
+    DEVICE_RECOVERY_NONE = 0,
+    DEVICE_RECOVERY_CLEAR_HALT,     // An endpoint stalled: clear the halt and resubmit
+    DEVICE_RECOVERY_RESET,          // Anything else: reset the device and resubmit
+} DeviceRecovery;
+
+typedef struct {
+    uint8_t interface_number;
+    int descriptor_length;
+    const unsigned char* descriptor;
+    const HidLayout* layout;        // NULL if the descriptor did not parse
+} DeviceMetadataInterface;
+
+// Static metadata of a device identity (its key, vendor, product and
+// release), read on the first connection and kept in an arena for the life
+// of the library. Reconnects of the same device reuse it, so they skip the
+// report descriptor requests.
+// Strings are empty when the device does not have them.
+typedef struct {
+    char key[DEVICE_KEY_MAX];
+    uint16_t vendor_id;
+    uint16_t product_id;
+    uint16_t bcd_device;            // Device release, 0 when the backend does not report it
+    uint8_t backend;                // DeviceBackendKind
+    uint8_t bus;
+    uint8_t speed;                  // enum libusb_speed
+    uint8_t port_depth;
+    uint8_t ports[8];               // Port path from the root hub
+    const char* manufacturer;
+    const char* product;
+    const char* serial;
+    char event_name[64];            // DeviceEvent.serial_number, formatted once
+    DeviceMetadataInterface interfaces[DEVICE_MAX_INTERFACES];
+    int interface_count;
+} DeviceMetadata;
 
 typedef struct {
     int device_index;
-    libusb_device_handle* handle;
+    libusb_device_handle* handle;   // NULL for devices that are not read through libusb
     char device_name[128];  // Nombre del dispositivo
     int vendor_id;
     int product_id;
+    DeviceInterface interfaces[DEVICE_MAX_INTERFACES];
+    int interface_count;
+    DeviceEndpoint endpoints[DEVICE_MAX_ENDPOINTS];
+    int endpoint_count;
+    uint32_t sequence;      // Siguiente número de secuencia de eventos
+    struct libusb_transfer* transfers[DEVICE_MAX_ENDPOINTS * DEVICE_TRANSFERS];
+    int pending_transfers;  // Transfers still owned by the event loop
+    int closing;            // Set once the device stops resubmitting
+    uint8_t recovery;       // DeviceRecovery, changed with devices_mutex held
+    uint8_t recovery_attempts;  // Failed recoveries since the last report
+    uint8_t halted_endpoints;   // Bit per endpoints[] entry waiting for a clear-halt
+    uint32_t parked_transfers;  // Bit per transfers[] entry taken out by an error, resubmitted after recovery
+    uint64_t recovery_ns;   // When the next recovery attempt is due
+    uint32_t generation;    // Bumped every time the slot is reused
+    int in_use;
+    uint64_t instance_id;   // Bus and address while connected
+    char key[DEVICE_KEY_MAX];  // Bus/port path and serial number
+    DeviceStats stats;
+    uint8_t backend;        // DeviceBackendKind
+    int fd;                 // Device node of evdev and hidraw devices
+    const DeviceMetadata* metadata;     // NULL for replayed and simulated devices
+    struct DeviceOutputQueue* output;   // Reports waiting to be written, libusb devices only
 } Device;
 
+// Stable, backend-independent view of a device for bindings such as ctypes,
+// which should not mirror the Device struct by hand.
+typedef struct {
+    int device_index;
+    int backend;            // DeviceBackendKind
+    int vendor_id;
+    int product_id;
+    DeviceHandle handle;
+    char device_name[128];
+    char key[DEVICE_KEY_MAX];
+} DeviceInfo;
+
+typedef enum {
+    DEVICE_EVENT_REPORT = 0,
+    DEVICE_EVENT_CONNECTED,
+    DEVICE_EVENT_DISCONNECTED,
+} DeviceEventKind;
+
+#define DEVICE_EVENT_TRUNCATED 0x01  // The report was longer than DEVICE_REPORT_MAX
+#define DEVICE_EVENT_SDL 0x02        // SDL input; data holds a CaptureSdlInput
+#define DEVICE_EVENT_EVDEV 0x04      // Input events of one evdev frame; data holds DeviceEvdevInput entries
+#define DEVICE_EVENT_REPEAT 0x08     // The last report again, with axis filters that caught up on an idle device
+
+// One evdev input event. A frame (everything up to SYN_REPORT) is delivered
+// as one report; larger frames are split over several events.
+typedef struct {
+    uint16_t type;          // EV_KEY, EV_ABS, ...
+    uint16_t code;
+    int32_t value;
+} DeviceEvdevInput;
+
+#define DEVICE_EVDEV_INPUTS (DEVICE_REPORT_MAX / (int)sizeof(DeviceEvdevInput))
+
+// Compact binary event. Reports are copied as raw bytes; the report
+// descriptors of a connected device are available through get_device().
+typedef struct DeviceRawEvent {
+    uint64_t timestamp_ns;  // CLOCK_MONOTONIC at capture time
+    uint32_t sequence;      // Per-device, increments on every event
+    int32_t device_id;      // Device slot
+    uint16_t vendor_id;
+    uint16_t product_id;
+    uint8_t kind;           // DeviceEventKind
+    uint8_t interface_number;
+    uint8_t endpoint;       // Endpoint address the report was read from
+    uint8_t flags;          // DEVICE_EVENT_*
+    uint16_t length;        // Valid bytes in data
+    uint16_t generation;    // Slot generation, device_id | generation << 16 is its DeviceHandle
+    uint8_t data[DEVICE_REPORT_MAX];
+} DeviceRawEvent;
+
 typedef struct {
     int device_id;
     int vendor_id;
@@ -30,14 +195,107 @@ typedef struct {
     char value[256];
 } DeviceEvent;
 
-extern Device devices[MAX_DEVICES];
+typedef enum {
+    DEVICE_QUEUE_DROP_OLDEST = 0,
+    DEVICE_QUEUE_DROP_NEWEST,
+    DEVICE_QUEUE_BLOCK,
+} DeviceQueueOverflow;
+
+// HID report types, as in the high byte of SET_REPORT's wValue.
+typedef enum {
+    DEVICE_REPORT_OUTPUT = 2,       // Rumble, LEDs, ...
+    DEVICE_REPORT_FEATURE = 3,
+} DeviceReportType;
+
+// What to do with a report identical to the previous one of the same kind.
+// Either way it is counted in the stats as a duplicate.
+typedef enum {
+    DEVICE_DEDUP_COUNT = 0,         // Deliver it anyway
+    DEVICE_DEDUP_SUPPRESS,          // Drop it
+} DeviceDedupMode;
+
+typedef struct {
+    uint64_t frames;        // Frames written to the socket
+    uint64_t bytes;
+    uint64_t suppressed;    // Unchanged reports skipped in change-only mode
+    uint64_t dropped;       // Lost to the send queue overflow policy
+    uint64_t reconnects;
+    int connected;
+} DeviceStreamStats;
+
+// Receives up to batch_size events at once; events is only valid during the call.
+typedef void (*DeviceBatchCallback)(const DeviceRawEvent* events, size_t count, void* user);
+
+// Everything that happened in one tick of the frame aggregator. Times are
+// CLOCK_MONOTONIC capture timestamps, like DeviceRawEvent.timestamp_ns.
+typedef struct {
+    uint64_t frame;             // Counts up from 0; a gap means windows were merged
+    uint64_t start_ns;          // Window [start_ns, end_ns)
+    uint64_t end_ns;
+    const DeviceRawEvent* states;   // Latest report of every device that sent one, as of end_ns
+    size_t state_count;
+    const DeviceRawEvent* events;   // Events captured in the window, by timestamp
+    size_t event_count;
+    size_t late;                // Events from an earlier window that missed its budget
+    uint64_t dropped;           // Events lost to a full frame, since the last frame
+    uint64_t delivery_ns;       // From end_ns to the callback
+} DeviceFrame;
+
+// frame and everything it points to is only valid during the call.
+typedef void (*DeviceFrameCallback)(const DeviceFrame* frame, void* user);
+
+typedef enum {
+    DEVICE_REPLAY_REALTIME = 0,     // Keep the original spacing between events
+    DEVICE_REPLAY_FAST,             // Dispatch as fast as the consumer allows
+} DeviceReplayMode;
+
 extern pthread_mutex_t devices_mutex;
 
 void clean_up_devices();
 void* read_device_data(void* arg);
 void detect_devices(void (*send_data_func)(DeviceEvent));
+int device_manager_start();
+void device_manager_stop();
+void device_manager_join();
+int device_manager_running();
+int device_manager_set_backend(int vendor_id, int product_id, DeviceBackendKind backend);
+int device_manager_backend_available(DeviceBackendKind backend);
+void detect_devices_raw(void (*send_raw_func)(const DeviceRawEvent*));
+void device_manager_set_callback(void (*send_data_func)(DeviceEvent));
+void device_manager_set_raw_callback(void (*send_raw_func)(const DeviceRawEvent*));
+int device_manager_start_capture(const char* path);
+void device_manager_stop_capture();
+long device_manager_replay(const char* path, DeviceReplayMode mode);
+long device_manager_simulate(int device_count, int report_rate_hz, int report_length, int duration_ms, DeviceReplayMode mode);
+int device_manager_enable_queue(size_t capacity, DeviceQueueOverflow overflow);
+size_t device_manager_poll(DeviceRawEvent* events, size_t max);
+int device_manager_set_batch_callback(DeviceBatchCallback callback, void* user, size_t batch_size, int deadline_us);
+int device_manager_set_frame_callback(DeviceFrameCallback callback, void* user, int rate_hz, size_t max_events, int budget_us);
+int device_manager_publish_shm(const char* name, size_t capacity, int mode);
+int device_manager_stream_connect(const char* host, int port, size_t capacity, DeviceQueueOverflow overflow, int change_only);
+int device_manager_stream_fd(int fd, size_t capacity, DeviceQueueOverflow overflow, int change_only);
+void device_manager_stream_stats(DeviceStreamStats* stats);
+uint64_t device_manager_dropped_events();
+void device_manager_set_decoding(int enabled);
+int device_manager_decode(const DeviceRawEvent* event, HidValue* values, int max);
+void device_manager_set_dedup(DeviceDedupMode mode);
+int device_manager_get_state(int index, DeviceRawEvent* state);
+int device_manager_get_states(int index, DeviceRawEvent* states, int max);
+int device_manager_write_report(int index, int interface_number, DeviceReportType type, const uint8_t* data, size_t length);
+int device_manager_set_axis_filter(int index, int axis, const AxisFilterConfig* filter);
+int device_manager_set_thread_config(DeviceThreadRole role, const DeviceThreadConfig* config);
+int device_manager_get_thread_status(DeviceThreadRole role, DeviceThreadStatus* status);
+int device_manager_lock_memory(int enable);
+int device_manager_memory_locked();
 const Device* get_device(int index);
 int get_device_count();
+int get_device_slot_count();
+DeviceHandle get_device_handle(int index);
+const Device* get_device_checked(DeviceHandle handle);
+int get_device_info(int index, DeviceInfo* info);
+const DeviceMetadata* get_device_metadata(int index);
+int device_manager_get_stats(int index, DeviceStatsSnapshot* stats);
+void device_manager_set_stats_dump(int interval_ms);
 
 #ifdef __cplusplus
 }
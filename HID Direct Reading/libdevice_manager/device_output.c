@@ -0,0 +1,56 @@
+#include "device_output.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+DeviceOutputQueue* device_output_create() {
+    DeviceOutputQueue* queue = calloc(1, sizeof(DeviceOutputQueue));
+    if (queue == NULL) {
+        return NULL;
+    }
+    queue->transfer = libusb_alloc_transfer(0);
+    if (queue->transfer == NULL) {
+        fprintf(stderr, "Failed to allocate output transfer\n");
+        free(queue);
+        return NULL;
+    }
+    return queue;
+}
+
+// The transfer must not be in flight.
+void device_output_destroy(DeviceOutputQueue* queue) {
+    if (queue == NULL) {
+        return;
+    }
+    libusb_free_transfer(queue->transfer);
+    free(queue);
+}
+
+// Returns 1 if the report replaced a queued one, 0 if it was appended and -1
+// if the queue is full of other reports.
+int device_output_push(DeviceOutputQueue* queue, const DeviceOutputReport* report) {
+    for (int i = 0; i < queue->count; ++i) {
+        DeviceOutputReport* queued = &queue->reports[(queue->head + i) % DEVICE_OUTPUT_QUEUE];
+        if (queued->type == report->type && queued->interface_number == report->interface_number &&
+            queued->data[0] == report->data[0]) {
+            memcpy(queued, report, sizeof(DeviceOutputReport));
+            return 1;
+        }
+    }
+    if (queue->count == DEVICE_OUTPUT_QUEUE) {
+        return -1;
+    }
+    memcpy(&queue->reports[(queue->head + queue->count) % DEVICE_OUTPUT_QUEUE], report, sizeof(DeviceOutputReport));
+    queue->count++;
+    return 0;
+}
+
+int device_output_pop(DeviceOutputQueue* queue, DeviceOutputReport* report) {
+    if (queue->count == 0) {
+        return -1;
+    }
+    memcpy(report, &queue->reports[queue->head], sizeof(DeviceOutputReport));
+    queue->head = (queue->head + 1) % DEVICE_OUTPUT_QUEUE;
+    queue->count--;
+    return 0;
+}
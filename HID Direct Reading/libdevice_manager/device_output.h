@@ -0,0 +1,44 @@
+#ifndef DEVICE_OUTPUT_H
+#define DEVICE_OUTPUT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "device_manager.h"
+
+#define DEVICE_OUTPUT_QUEUE 16      // Reports waiting per device
+
+// One queued output or feature report. data[0] is the report ID, 0 when
+// the interface does not use report IDs.
+typedef struct {
+    uint8_t type;                   // DeviceReportType
+    uint8_t interface_number;
+    uint16_t length;
+    uint8_t data[DEVICE_OUTPUT_MAX];
+} DeviceOutputReport;
+
+// FIFO of reports waiting for the device's single write transfer. A new
+// report replaces a queued one of the same type, interface and report ID, so
+// a slow device only ever gets the latest rumble or LED state.
+//
+// Must be used with devices_mutex held.
+typedef struct DeviceOutputQueue {
+    DeviceOutputReport reports[DEVICE_OUTPUT_QUEUE];
+    int head;
+    int count;
+    int in_flight;                  // The transfer is owned by the event loop
+    struct libusb_transfer* transfer;
+    unsigned char buffer[LIBUSB_CONTROL_SETUP_SIZE + DEVICE_OUTPUT_MAX];
+} DeviceOutputQueue;
+
+DeviceOutputQueue* device_output_create();
+void device_output_destroy(DeviceOutputQueue* queue);
+int device_output_push(DeviceOutputQueue* queue, const DeviceOutputReport* report);
+int device_output_pop(DeviceOutputQueue* queue, DeviceOutputReport* report);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // DEVICE_OUTPUT_H
@@ -0,0 +1,214 @@
+#include "device_registry.h"
+#include "device_state.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DEVICE_CHUNK_SIZE 16
+#define DEVICE_CHUNK_COUNT (DEVICE_REGISTRY_MAX / DEVICE_CHUNK_SIZE)
+
+typedef struct {
+    uint64_t hash;   // Key hash or instance ID
+    int slot;        // -1 when the entry is empty
+} IndexEntry;
+
+typedef struct {
+    IndexEntry* entries;
+    size_t size;     // Power of two
+    size_t used;
+} Index;
+
+static Device* chunks[DEVICE_CHUNK_COUNT];
+static _Atomic int slot_count = 0;
+static int used_count = 0;
+static int free_slots[DEVICE_REGISTRY_MAX];
+static int free_count = 0;
+static Index key_index;
+static Index instance_index;
+
+static uint64_t hash_key(const char* key) {
+    uint64_t hash = 14695981039346656037ull;  // FNV-1a
+    for (; *key; ++key) {
+        hash = (hash ^ (uint8_t)*key) * 1099511628211ull;
+    }
+    return hash;
+}
+
+static size_t index_position(const Index* index, uint64_t hash) {
+    return (size_t)((hash * 0x9e3779b97f4a7c15ull) >> 32) & (index->size - 1);
+}
+
+static void index_put(Index* index, uint64_t hash, int slot);
+
+static int index_grow(Index* index) {
+    size_t size = index->size ? index->size * 2 : 16;
+    IndexEntry* entries = malloc(size * sizeof(IndexEntry));
+    if (entries == NULL) {
+        return -1;
+    }
+    for (size_t i = 0; i < size; ++i) {
+        entries[i].slot = -1;
+    }
+
+    IndexEntry* old_entries = index->entries;
+    size_t old_size = index->size;
+    index->entries = entries;
+    index->size = size;
+    index->used = 0;
+    for (size_t i = 0; i < old_size; ++i) {
+        if (old_entries[i].slot >= 0) {
+            index_put(index, old_entries[i].hash, old_entries[i].slot);
+        }
+    }
+    free(old_entries);
+    return 0;
+}
+
+static void index_put(Index* index, uint64_t hash, int slot) {
+    if ((index->used + 1) * 2 > index->size && index_grow(index) < 0) {
+        return;
+    }
+    size_t pos = index_position(index, hash);
+    while (index->entries[pos].slot >= 0) {
+        pos = (pos + 1) & (index->size - 1);
+    }
+    index->entries[pos].hash = hash;
+    index->entries[pos].slot = slot;
+    index->used++;
+}
+
+// Linear probing removal: reinsert the rest of the cluster so lookups never stop early.
+static void index_remove(Index* index, uint64_t hash, int slot) {
+    if (index->size == 0) {
+        return;
+    }
+    size_t pos = index_position(index, hash);
+    while (index->entries[pos].slot >= 0) {
+        if (index->entries[pos].hash == hash && index->entries[pos].slot == slot) {
+            index->entries[pos].slot = -1;
+            index->used--;
+            pos = (pos + 1) & (index->size - 1);
+            while (index->entries[pos].slot >= 0) {
+                IndexEntry entry = index->entries[pos];
+                index->entries[pos].slot = -1;
+                index->used--;
+                index_put(index, entry.hash, entry.slot);
+                pos = (pos + 1) & (index->size - 1);
+            }
+            return;
+        }
+        pos = (pos + 1) & (index->size - 1);
+    }
+}
+
+Device* registry_get(int slot) {
+    if (slot < 0 || slot >= slot_count) {
+        return NULL;
+    }
+    return &chunks[slot / DEVICE_CHUNK_SIZE][slot % DEVICE_CHUNK_SIZE];
+}
+
+// Upper bound for iterating slots; freed slots stay in range with in_use == 0.
+int registry_slot_count() {
+    return slot_count;
+}
+
+int registry_used_count() {
+    return used_count;
+}
+
+// Copies device into a free slot and indexes it. Returns the slot or -1.
+int registry_insert(const Device* device) {
+    int slot;
+    if (free_count > 0) {
+        slot = free_slots[--free_count];
+    } else {
+        slot = slot_count;
+        if (slot >= DEVICE_REGISTRY_MAX) {
+            fprintf(stderr, "Device registry full\n");
+            return -1;
+        }
+        if (slot % DEVICE_CHUNK_SIZE == 0) {
+            chunks[slot / DEVICE_CHUNK_SIZE] = calloc(DEVICE_CHUNK_SIZE, sizeof(Device));
+            if (chunks[slot / DEVICE_CHUNK_SIZE] == NULL) {
+                return -1;
+            }
+        }
+        slot_count = slot + 1;
+    }
+
+    Device* entry = registry_get(slot);
+    uint32_t generation = entry->generation + 1;
+    if ((generation & 0xffff) == 0) {
+        generation++;  // Handles are never zero
+    }
+    *entry = *device;
+    entry->device_index = slot;
+    entry->generation = generation;
+    entry->in_use = 1;
+    used_count++;
+    device_state_reset(slot);
+
+    index_put(&key_index, hash_key(entry->key), slot);
+    index_put(&instance_index, entry->instance_id, slot);
+    return slot;
+}
+
+void registry_release(int slot) {
+    Device* entry = registry_get(slot);
+    if (entry == NULL || !entry->in_use) {
+        return;
+    }
+    index_remove(&key_index, hash_key(entry->key), slot);
+    index_remove(&instance_index, entry->instance_id, slot);
+    entry->in_use = 0;
+    used_count--;
+    free_slots[free_count++] = slot;
+}
+
+int registry_find_key(const char* key) {
+    if (key_index.size == 0) {
+        return -1;
+    }
+    uint64_t hash = hash_key(key);
+    size_t pos = index_position(&key_index, hash);
+    while (key_index.entries[pos].slot >= 0) {
+        if (key_index.entries[pos].hash == hash &&
+            strcmp(registry_get(key_index.entries[pos].slot)->key, key) == 0) {
+            return key_index.entries[pos].slot;
+        }
+        pos = (pos + 1) & (key_index.size - 1);
+    }
+    return -1;
+}
+
+int registry_find_instance(uint64_t instance_id) {
+    if (instance_index.size == 0) {
+        return -1;
+    }
+    size_t pos = index_position(&instance_index, instance_id);
+    while (instance_index.entries[pos].slot >= 0) {
+        if (instance_index.entries[pos].hash == instance_id) {
+            return instance_index.entries[pos].slot;
+        }
+        pos = (pos + 1) & (instance_index.size - 1);
+    }
+    return -1;
+}
+
+DeviceHandle registry_handle(int slot) {
+    Device* entry = registry_get(slot);
+    if (entry == NULL || !entry->in_use) {
+        return DEVICE_HANDLE_INVALID;
+    }
+    return ((entry->generation & 0xffff) << 16) | (uint32_t)slot;
+}
+
+// Returns the device only if the slot still holds the same connection.
+Device* registry_resolve(DeviceHandle handle) {
+    Device* entry = registry_get((int)(handle & 0xffff));
+    if (entry == NULL || !entry->in_use || (entry->generation & 0xffff) != handle >> 16) {
+        return NULL;
+    }
+    return entry;
+}
@@ -0,0 +1,31 @@
+#ifndef DEVICE_REGISTRY_H
+#define DEVICE_REGISTRY_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "device_manager.h"
+
+// Dynamically sized table of Device slots. Slots live in fixed-size chunks
+// that are never moved, so a Device* stays valid for the life of the library
+// and lookup by slot is a plain index. Connected devices are also indexed by
+// identity key (port path + serial) and by instance ID.
+//
+// Everything except registry_get() must be called with devices_mutex held.
+
+Device* registry_get(int slot);
+int registry_slot_count();
+int registry_used_count();
+int registry_insert(const Device* device);
+void registry_release(int slot);
+int registry_find_key(const char* key);
+int registry_find_instance(uint64_t instance_id);
+DeviceHandle registry_handle(int slot);
+Device* registry_resolve(DeviceHandle handle);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // DEVICE_REGISTRY_H
@@ -0,0 +1,161 @@
+#include "device_state.h"
+#include <sched.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define STATE_CHUNK_SIZE 16
+#define STATE_CHUNK_COUNT (DEVICE_REGISTRY_MAX / STATE_CHUNK_SIZE)
+
+typedef struct {
+    _Atomic uint32_t sequence;  // Odd while being written
+    uint8_t used;               // Written under the seqlock too, so readers see resets
+    uint8_t interface_number;
+    uint8_t endpoint;
+    uint8_t report_id;
+    DeviceRawEvent event;       // Bytes past event.length are zero
+} StateEntry;
+
+typedef struct {
+    StateEntry entries[DEVICE_STATE_REPORTS];   // Used entries come first
+    _Atomic int latest;         // Entry written last plus one, 0 before the first report
+    int next;                   // Entry to replace once all of them are used
+} DeviceState;
+
+static DeviceState* state_chunks[STATE_CHUNK_COUNT];
+
+static DeviceState* state_get(int slot) {
+    if (slot < 0 || slot >= DEVICE_REGISTRY_MAX) {
+        return NULL;
+    }
+    DeviceState* chunk = __atomic_load_n(&state_chunks[slot / STATE_CHUNK_SIZE], __ATOMIC_ACQUIRE);
+    return chunk != NULL ? &chunk[slot % STATE_CHUNK_SIZE] : NULL;
+}
+
+static void begin_write(StateEntry* entry) {
+    atomic_store_explicit(&entry->sequence, atomic_load_explicit(&entry->sequence, memory_order_relaxed) + 1,
+                          memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+}
+
+static void end_write(StateEntry* entry) {
+    atomic_store_explicit(&entry->sequence, atomic_load_explicit(&entry->sequence, memory_order_relaxed) + 1,
+                          memory_order_release);
+}
+
+// Sequences keep counting across resets, so a reader that raced with one
+// never mistakes the next connection's data for a consistent copy.
+int device_state_reset(int slot) {
+    if (slot < 0 || slot >= DEVICE_REGISTRY_MAX) {
+        return -1;
+    }
+    DeviceState** chunk = &state_chunks[slot / STATE_CHUNK_SIZE];
+    if (*chunk == NULL) {
+        DeviceState* states = calloc(STATE_CHUNK_SIZE, sizeof(DeviceState));
+        if (states == NULL) {
+            return -1;
+        }
+        __atomic_store_n(chunk, states, __ATOMIC_RELEASE);
+        return 0;
+    }
+
+    DeviceState* state = &(*chunk)[slot % STATE_CHUNK_SIZE];
+    atomic_store_explicit(&state->latest, 0, memory_order_release);
+    for (int i = 0; i < DEVICE_STATE_REPORTS && state->entries[i].used; ++i) {
+        StateEntry* entry = &state->entries[i];
+        begin_write(entry);
+        entry->used = 0;
+        end_write(entry);
+    }
+    state->next = 0;
+    return 0;
+}
+
+// A word at a time with no early exit, so the loop vectorizes.
+static int same_report(const DeviceRawEvent* stored, const DeviceRawEvent* event) {
+    if (stored->length != event->length || stored->flags != event->flags) {
+        return 0;
+    }
+    size_t words = event->length / sizeof(uint64_t);
+    uint64_t diff = 0;
+    for (size_t i = 0; i < words; ++i) {
+        uint64_t a, b;
+        memcpy(&a, stored->data + i * sizeof(uint64_t), sizeof(uint64_t));
+        memcpy(&b, event->data + i * sizeof(uint64_t), sizeof(uint64_t));
+        diff |= a ^ b;
+    }
+    for (size_t i = words * sizeof(uint64_t); i < event->length; ++i) {
+        diff |= (uint64_t)(stored->data[i] ^ event->data[i]);
+    }
+    return diff == 0;
+}
+
+// Stores the report as the state of its report kind. Returns 0 when it is
+// byte for byte the last report of that kind (the state is left alone), 1 otherwise.
+int device_state_update(int slot, const DeviceRawEvent* event, uint8_t report_id) {
+    DeviceState* state = state_get(slot);
+    if (state == NULL) {
+        return 1;
+    }
+
+    StateEntry* entry = NULL;
+    int index = 0;
+    for (; index < DEVICE_STATE_REPORTS && state->entries[index].used; ++index) {
+        StateEntry* candidate = &state->entries[index];
+        if (candidate->report_id == report_id && candidate->endpoint == event->endpoint &&
+            candidate->interface_number == event->interface_number) {
+            if (same_report(&candidate->event, event)) {
+                return 0;
+            }
+            entry = candidate;
+            break;
+        }
+    }
+    if (entry == NULL) {
+        if (index == DEVICE_STATE_REPORTS) {
+            index = state->next;
+            state->next = (state->next + 1) % DEVICE_STATE_REPORTS;
+        }
+        entry = &state->entries[index];
+    }
+
+    begin_write(entry);
+    entry->used = 1;
+    entry->interface_number = event->interface_number;
+    entry->endpoint = event->endpoint;
+    entry->report_id = report_id;
+    memcpy(&entry->event, event, offsetof(DeviceRawEvent, data) + event->length);
+    memset(entry->event.data + event->length, 0, DEVICE_REPORT_MAX - event->length);
+    end_write(entry);
+    atomic_store_explicit(&state->latest, index + 1, memory_order_release);
+    return 1;
+}
+
+// Consistent copy of one entry; -1 if it is empty.
+int device_state_read(int slot, int index, DeviceRawEvent* event) {
+    DeviceState* state = state_get(slot);
+    if (state == NULL || index < 0 || index >= DEVICE_STATE_REPORTS) {
+        return -1;
+    }
+    StateEntry* entry = &state->entries[index];
+    while (1) {
+        uint32_t before = atomic_load_explicit(&entry->sequence, memory_order_acquire);
+        if (before & 1) {
+            sched_yield();  // The writer copies less than 100 bytes, unless it was preempted
+            continue;
+        }
+        int used = entry->used;
+        memcpy(event, &entry->event, sizeof(DeviceRawEvent));
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&entry->sequence, memory_order_relaxed) == before) {
+            return used ? 0 : -1;
+        }
+    }
+}
+
+// Entry of the most recent report, -1 before the first one.
+int device_state_latest(int slot) {
+    DeviceState* state = state_get(slot);
+    return state != NULL ? atomic_load_explicit(&state->latest, memory_order_acquire) - 1 : -1;
+}
@@ -0,0 +1,27 @@
+#ifndef DEVICE_STATE_H
+#define DEVICE_STATE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "device_manager.h"
+
+// Last report of every report kind (interface, endpoint and report ID) of each
+// device slot, kept next to the registry. Only the reader thread of a device
+// writes its state; any thread can read it without locks since every entry is
+// a seqlock. Like registry chunks, the memory is never freed or moved.
+//
+// device_state_reset() must be called with devices_mutex held when a slot is
+// (re)used; the rest is lock-free.
+
+int device_state_reset(int slot);
+int device_state_update(int slot, const DeviceRawEvent* event, uint8_t report_id);
+int device_state_read(int slot, int entry, DeviceRawEvent* event);
+int device_state_latest(int slot);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // DEVICE_STATE_H
@@ -0,0 +1,145 @@
+#include "device_stats.h"
+#include <string.h>
+
+#define RECONNECT_TABLE_SIZE 256
+
+typedef struct {
+    uint64_t hash;
+    uint32_t connections;
+} ReconnectEntry;
+
+static ReconnectEntry reconnect_table[RECONNECT_TABLE_SIZE];
+
+static int bucket_index(uint64_t value) {
+    if (value < STATS_SUB_BUCKETS) {
+        return (int)value;
+    }
+    int msb = 63 - __builtin_clzll(value);
+    int shift = msb - STATS_SUB_BUCKET_BITS;
+    int sub = (int)((value >> shift) & (STATS_SUB_BUCKETS - 1));
+    return (shift + 1) * STATS_SUB_BUCKETS + sub;
+}
+
+// Upper bound of the values that land in a bucket.
+static uint64_t bucket_value(int index) {
+    if (index < STATS_SUB_BUCKETS) {
+        return (uint64_t)index;
+    }
+    int shift = index / STATS_SUB_BUCKETS - 1;
+    uint64_t base = (uint64_t)(STATS_SUB_BUCKETS + index % STATS_SUB_BUCKETS) << shift;
+    return base + ((1ull << shift) - 1);
+}
+
+void stats_record(LatencyHistogram* histogram, uint64_t value_ns) {
+    atomic_fetch_add_explicit(&histogram->buckets[bucket_index(value_ns)], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&histogram->count, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&histogram->sum, value_ns, memory_order_relaxed);
+    uint64_t max = atomic_load_explicit(&histogram->max, memory_order_relaxed);
+    while (value_ns > max &&
+           !atomic_compare_exchange_weak_explicit(&histogram->max, &max, value_ns, memory_order_relaxed, memory_order_relaxed)) {
+    }
+}
+
+void stats_summarize(LatencyHistogram* histogram, DeviceLatencySummary* summary) {
+    uint32_t buckets[STATS_BUCKETS];
+    uint64_t total = 0;
+    for (int i = 0; i < STATS_BUCKETS; ++i) {
+        buckets[i] = atomic_load_explicit(&histogram->buckets[i], memory_order_relaxed);
+        total += buckets[i];
+    }
+
+    memset(summary, 0, sizeof(DeviceLatencySummary));
+    summary->count = total;
+    summary->max_ns = atomic_load_explicit(&histogram->max, memory_order_relaxed);
+    if (total == 0) {
+        return;
+    }
+    summary->mean_ns = atomic_load_explicit(&histogram->sum, memory_order_relaxed) / total;
+
+    // Rank thresholds for p50, p99 and p99.9
+    uint64_t ranks[3] = {(total * 500 + 999) / 1000, (total * 990 + 999) / 1000, (total * 999 + 999) / 1000};
+    uint64_t* outputs[3] = {&summary->p50_ns, &summary->p99_ns, &summary->p999_ns};
+    uint64_t seen = 0;
+    int next = 0;
+    for (int i = 0; i < STATS_BUCKETS && next < 3; ++i) {
+        seen += buckets[i];
+        while (next < 3 && seen >= ranks[next]) {
+            uint64_t value = bucket_value(i);
+            *outputs[next++] = value < summary->max_ns ? value : summary->max_ns;
+        }
+    }
+}
+
+void stats_snapshot(DeviceStats* stats, uint64_t now_ns, DeviceStatsSnapshot* snapshot) {
+    memset(snapshot, 0, sizeof(DeviceStatsSnapshot));
+    snapshot->reports = atomic_load_explicit(&stats->reports, memory_order_relaxed);
+    snapshot->bytes = atomic_load_explicit(&stats->bytes, memory_order_relaxed);
+    snapshot->dropped = atomic_load_explicit(&stats->dropped, memory_order_relaxed);
+    snapshot->truncated = atomic_load_explicit(&stats->truncated, memory_order_relaxed);
+    snapshot->filtered = atomic_load_explicit(&stats->filtered, memory_order_relaxed);
+    snapshot->duplicates = atomic_load_explicit(&stats->duplicates, memory_order_relaxed);
+    snapshot->writes = atomic_load_explicit(&stats->writes, memory_order_relaxed);
+    snapshot->coalesced = atomic_load_explicit(&stats->coalesced, memory_order_relaxed);
+    snapshot->errors = atomic_load_explicit(&stats->errors, memory_order_relaxed);
+    snapshot->timeouts = atomic_load_explicit(&stats->timeouts, memory_order_relaxed);
+    snapshot->recoveries = atomic_load_explicit(&stats->recoveries, memory_order_relaxed);
+    snapshot->reconnects = stats->reconnects;
+
+    uint64_t last_report = atomic_load_explicit(&stats->last_report_ns, memory_order_relaxed);
+    uint64_t since = last_report ? last_report : stats->connected_ns;
+    snapshot->last_report_age_ns = now_ns > since ? now_ns - since : 0;
+    if (now_ns > stats->connected_ns) {
+        snapshot->report_rate_hz = (double)snapshot->reports * 1e9 / (double)(now_ns - stats->connected_ns);
+    }
+
+    stats_summarize(&stats->dispatch_latency, &snapshot->dispatch_latency);
+    stats_summarize(&stats->callback_duration, &snapshot->callback_duration);
+    stats_summarize(&stats->report_interval, &snapshot->report_interval);
+}
+
+static void print_summary(FILE* out, const char* label, const DeviceLatencySummary* summary) {
+    fprintf(out, "  %-18s n=%llu mean=%lluus p50=%lluus p99=%lluus p99.9=%lluus max=%lluus\n", label,
+            (unsigned long long)summary->count, (unsigned long long)summary->mean_ns / 1000,
+            (unsigned long long)summary->p50_ns / 1000, (unsigned long long)summary->p99_ns / 1000,
+            (unsigned long long)summary->p999_ns / 1000, (unsigned long long)summary->max_ns / 1000);
+}
+
+void stats_print(FILE* out, const char* name, const DeviceStatsSnapshot* snapshot) {
+    fprintf(out, "%s: %llu reports (%.1f Hz), %llu bytes, %llu dropped, %llu truncated, %llu filtered, "
+                 "%llu duplicates, %llu errors, %llu timeouts, %llu recoveries, %u reconnects, last report %llums ago, "
+                 "%llu writes (%llu coalesced)\n",
+            name, (unsigned long long)snapshot->reports, snapshot->report_rate_hz,
+            (unsigned long long)snapshot->bytes, (unsigned long long)snapshot->dropped,
+            (unsigned long long)snapshot->truncated, (unsigned long long)snapshot->filtered,
+            (unsigned long long)snapshot->duplicates, (unsigned long long)snapshot->errors,
+            (unsigned long long)snapshot->timeouts, (unsigned long long)snapshot->recoveries, snapshot->reconnects,
+            (unsigned long long)snapshot->last_report_age_ns / 1000000,
+            (unsigned long long)snapshot->writes, (unsigned long long)snapshot->coalesced);
+    print_summary(out, "capture->dispatch", &snapshot->dispatch_latency);
+    print_summary(out, "callback", &snapshot->callback_duration);
+    print_summary(out, "report interval", &snapshot->report_interval);
+}
+
+// Returns how many times a device with this identity key connected before.
+// Called by every backend thread that registers devices, always with devices_mutex held.
+uint32_t stats_note_connect(const char* key) {
+    uint64_t hash = 14695981039346656037ull;  // FNV-1a
+    for (; *key; ++key) {
+        hash = (hash ^ (uint8_t)*key) * 1099511628211ull;
+    }
+    hash |= 1;  // Zero marks an empty entry
+
+    size_t pos = (size_t)(hash % RECONNECT_TABLE_SIZE);
+    for (int i = 0; i < RECONNECT_TABLE_SIZE; ++i) {
+        ReconnectEntry* entry = &reconnect_table[(pos + (size_t)i) % RECONNECT_TABLE_SIZE];
+        if (entry->hash == hash) {
+            return entry->connections++;
+        }
+        if (entry->hash == 0) {
+            entry->hash = hash;
+            entry->connections = 1;
+            return 0;
+        }
+    }
+    return 0;  // Table full, identities beyond this are not tracked
+}
@@ -0,0 +1,86 @@
+#ifndef DEVICE_STATS_H
+#define DEVICE_STATS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Log-linear histogram in the style of HdrHistogram: every power of two is
+// split into STATS_SUB_BUCKETS linear buckets, so the relative error of any
+// percentile stays below 1/STATS_SUB_BUCKETS for values up to 2^64 ns.
+#define STATS_SUB_BUCKET_BITS 3
+#define STATS_SUB_BUCKETS (1 << STATS_SUB_BUCKET_BITS)
+#define STATS_BUCKETS ((64 - STATS_SUB_BUCKET_BITS + 1) * STATS_SUB_BUCKETS)
+
+typedef struct {
+    _Atomic uint32_t buckets[STATS_BUCKETS];
+    _Atomic uint64_t count;
+    _Atomic uint64_t sum;
+    _Atomic uint64_t max;
+} LatencyHistogram;
+
+// Written lock-free by the event thread, read by device_manager_get_stats().
+typedef struct {
+    _Atomic uint64_t reports;
+    _Atomic uint64_t bytes;
+    _Atomic uint64_t dropped;       // Rejected or evicted by the event queue
+    _Atomic uint64_t truncated;
+    _Atomic uint64_t filtered;      // Reports with no change left after the axis filters
+    _Atomic uint64_t duplicates;    // Same bytes as the previous report of the same kind
+    _Atomic uint64_t writes;        // Output and feature reports sent
+    _Atomic uint64_t coalesced;     // Queued writes replaced by a newer one with the same report ID
+    _Atomic uint64_t errors;        // Failed transfers and resubmissions
+    _Atomic uint64_t timeouts;
+    _Atomic uint64_t recoveries;    // Halts cleared and resets done without a disconnect
+    _Atomic uint64_t last_report_ns;
+    uint64_t connected_ns;
+    uint32_t reconnects;            // Earlier connections with the same identity key
+    LatencyHistogram dispatch_latency;  // Capture to callback return (or enqueue)
+    LatencyHistogram callback_duration;
+    LatencyHistogram report_interval;   // Time between consecutive reports
+} DeviceStats;
+
+typedef struct {
+    uint64_t count;
+    uint64_t mean_ns;
+    uint64_t max_ns;
+    uint64_t p50_ns;
+    uint64_t p99_ns;
+    uint64_t p999_ns;
+} DeviceLatencySummary;
+
+typedef struct {
+    uint64_t reports;
+    uint64_t bytes;
+    uint64_t dropped;
+    uint64_t truncated;
+    uint64_t filtered;
+    uint64_t duplicates;
+    uint64_t writes;
+    uint64_t coalesced;
+    uint64_t errors;
+    uint64_t timeouts;
+    uint64_t recoveries;
+    uint32_t reconnects;
+    double report_rate_hz;          // Average since the device connected
+    uint64_t last_report_age_ns;    // Large values point at a stalled reader
+    DeviceLatencySummary dispatch_latency;
+    DeviceLatencySummary callback_duration;
+    DeviceLatencySummary report_interval;
+} DeviceStatsSnapshot;
+
+void stats_record(LatencyHistogram* histogram, uint64_t value_ns);
+void stats_summarize(LatencyHistogram* histogram, DeviceLatencySummary* summary);
+void stats_snapshot(DeviceStats* stats, uint64_t now_ns, DeviceStatsSnapshot* snapshot);
+void stats_print(FILE* out, const char* name, const DeviceStatsSnapshot* snapshot);
+uint32_t stats_note_connect(const char* key);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // DEVICE_STATS_H
@@ -0,0 +1,245 @@
+#define _GNU_SOURCE
+
+#include "device_backend.h"
+#include "device_registry.h"
+#include "node_watcher.h"
+#include <errno.h>
+#include <linux/input.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <time.h>
+#include <unistd.h>
+
+// Reads /dev/input/event* nodes from the epoll thread of a node watcher.
+// Devices are opened read-only and never grabbed, so the desktop keeps
+// seeing them and no root is needed, only read access to the nodes (usually
+// the "input" group). New nodes are picked up through inotify.
+
+#define EVDEV_READ_BATCH 64         // input_events per read()
+#define EVDEV_LONG_BITS (8 * (int)sizeof(unsigned long))
+#define EVDEV_LONGS(bits) (((bits) + EVDEV_LONG_BITS - 1) / EVDEV_LONG_BITS)
+
+typedef struct {
+    WatchedNode base;
+    int dropping;                   // SYN_DROPPED seen, skip until the next SYN_REPORT
+    DeviceRawEvent frame;           // Inputs of the frame being read
+    // Key and axis state as delivered, compared with the kernel's after a SYN_DROPPED
+    unsigned long keys[EVDEV_LONGS(KEY_CNT)];
+    unsigned long abs_bits[EVDEV_LONGS(ABS_CNT)];
+    int32_t abs[ABS_CNT];
+} EvdevDevice;
+
+static NodeWatcher watcher;
+
+static int test_bit(const unsigned long *bits, int bit) {
+    return (bits[bit / EVDEV_LONG_BITS] >> (bit % EVDEV_LONG_BITS)) & 1;
+}
+
+// Multitouch axes only report their current slot through EVIOCGABS, so they are not tracked
+static int tracked_abs(const EvdevDevice *evdev, int code) {
+    return code < ABS_MT_SLOT && test_bit(evdev->abs_bits, code);
+}
+
+static void track_input(EvdevDevice *evdev, const DeviceEvdevInput *input) {
+    if (input->type == EV_KEY && input->code < KEY_CNT) {
+        unsigned long bit = 1ul << (input->code % EVDEV_LONG_BITS);
+        if (input->value) {
+            evdev->keys[input->code / EVDEV_LONG_BITS] |= bit;
+        } else {
+            evdev->keys[input->code / EVDEV_LONG_BITS] &= ~bit;
+        }
+    } else if (input->type == EV_ABS && input->code < ABS_CNT && tracked_abs(evdev, input->code)) {
+        evdev->abs[input->code] = input->value;
+    }
+}
+
+static void flush_frame(EvdevDevice *evdev) {
+    Device *device = registry_get(evdev->base.slot);
+    if (evdev->frame.length == 0 || device == NULL) {
+        return;
+    }
+    for (size_t pos = 0; pos < evdev->frame.length; pos += sizeof(DeviceEvdevInput)) {
+        DeviceEvdevInput input;
+        memcpy(&input, evdev->frame.data + pos, sizeof(DeviceEvdevInput));
+        track_input(evdev, &input);
+    }
+    DeviceRawEvent event;
+    backend_init_event(&event, device, DEVICE_EVENT_REPORT);
+    event.timestamp_ns = evdev->frame.timestamp_ns;
+    event.flags = DEVICE_EVENT_EVDEV;
+    event.length = evdev->frame.length;
+    memcpy(event.data, evdev->frame.data, event.length);
+    evdev->frame.length = 0;
+    backend_report(device, &event, event.length);
+}
+
+static void append_input(EvdevDevice *evdev, const struct input_event *input) {
+    if (evdev->frame.length + sizeof(DeviceEvdevInput) > DEVICE_REPORT_MAX) {
+        flush_frame(evdev);
+    }
+    if (evdev->frame.length == 0) {
+        // The kernel stamps events with CLOCK_MONOTONIC (EVIOCSCLOCKID)
+        evdev->frame.timestamp_ns = (uint64_t)input->input_event_sec * 1000000000ull +
+                                    (uint64_t)input->input_event_usec * 1000ull;
+    }
+    DeviceEvdevInput entry;
+    entry.type = input->type;
+    entry.code = input->code;
+    entry.value = input->value;
+    memcpy(evdev->frame.data + evdev->frame.length, &entry, sizeof(DeviceEvdevInput));
+    evdev->frame.length += sizeof(DeviceEvdevInput);
+}
+
+// Key and axis state as the kernel has it now; what cannot be read keeps the tracked value.
+static void read_state(const EvdevDevice *evdev, unsigned long *keys, int32_t *abs) {
+    if (ioctl(evdev->base.fd, EVIOCGKEY(sizeof(evdev->keys)), keys) < 0 && keys != evdev->keys) {
+        memcpy(keys, evdev->keys, sizeof(evdev->keys));
+    }
+    for (int code = 0; code < ABS_CNT; ++code) {
+        struct input_absinfo info;
+        abs[code] = tracked_abs(evdev, code) && ioctl(evdev->base.fd, EVIOCGABS(code), &info) == 0 ? info.value
+                                                                                               : evdev->abs[code];
+    }
+}
+
+// After a SYN_DROPPED, delivers every key and axis that changed while events
+// were lost as one frame, stamped with the SYN_REPORT that ended them.
+static void resync_state(EvdevDevice *evdev, const struct input_event *report) {
+    unsigned long keys[EVDEV_LONGS(KEY_CNT)];
+    int32_t abs[ABS_CNT];
+    read_state(evdev, keys, abs);
+
+    struct input_event input;
+    memset(&input, 0, sizeof(input));
+    input.input_event_sec = report->input_event_sec;
+    input.input_event_usec = report->input_event_usec;
+    evdev->frame.length = 0;
+    input.type = EV_KEY;
+    for (int code = 0; code < KEY_CNT; ++code) {
+        if (test_bit(keys, code) != test_bit(evdev->keys, code)) {
+            input.code = (uint16_t)code;
+            input.value = test_bit(keys, code);
+            append_input(evdev, &input);
+        }
+    }
+    input.type = EV_ABS;
+    for (int code = 0; code < ABS_CNT; ++code) {
+        if (abs[code] != evdev->abs[code]) {
+            input.code = (uint16_t)code;
+            input.value = abs[code];
+            append_input(evdev, &input);
+        }
+    }
+    flush_frame(evdev);
+}
+
+// Takes a node if it is an external (USB or Bluetooth) input device assigned to this backend.
+static WatchedNode* open_evdev(int fd, const char *node) {
+    struct input_id id;
+    if (ioctl(fd, EVIOCGID, &id) < 0 || (id.bustype != BUS_USB && id.bustype != BUS_BLUETOOTH) ||
+        device_backend_for(id.vendor, id.product) != DEVICE_BACKEND_EVDEV) {
+        return NULL;
+    }
+    int clock = CLOCK_MONOTONIC;
+    ioctl(fd, EVIOCSCLOCKID, &clock);
+
+    Device candidate;
+    memset(&candidate, 0, sizeof(Device));
+    candidate.vendor_id = id.vendor;
+    candidate.product_id = id.product;
+    candidate.backend = DEVICE_BACKEND_EVDEV;
+    candidate.fd = fd;
+    if (ioctl(fd, EVIOCGNAME(sizeof(candidate.device_name)), candidate.device_name) < 0) {
+        snprintf(candidate.device_name, sizeof(candidate.device_name), "%04x:%04x", id.vendor, id.product);
+    }
+    candidate.device_name[sizeof(candidate.device_name) - 1] = '\0';
+    // Physical path and unique ID survive reconnects, like the bus/port key of
+    // libusb devices; the name tells apart nodes of the same device (e.g. motion sensors)
+    char phys[64] = "";
+    char uniq[64] = "";
+    ioctl(fd, EVIOCGPHYS(sizeof(phys) - 1), phys);
+    ioctl(fd, EVIOCGUNIQ(sizeof(uniq) - 1), uniq);
+    snprintf(candidate.key, sizeof(candidate.key), "evdev:%.32s/%.24s/%.24s", phys[0] ? phys : node, uniq,
+             candidate.device_name);
+
+    EvdevDevice *evdev = calloc(1, sizeof(EvdevDevice));
+    if (evdev == NULL) {
+        return NULL;
+    }
+    evdev->base.fd = fd;
+    ioctl(fd, EVIOCGBIT(EV_ABS, sizeof(evdev->abs_bits)), evdev->abs_bits);
+    read_state(evdev, evdev->keys, evdev->abs);
+    evdev->base.slot = backend_add_device(&candidate);
+    if (evdev->base.slot < 0) {
+        free(evdev);
+        return NULL;
+    }
+    return &evdev->base;
+}
+
+// Reads everything the device has queued; returns -1 once the device is gone.
+static int read_evdev(WatchedNode *node) {
+    EvdevDevice *evdev = (EvdevDevice*)node;
+    struct input_event inputs[EVDEV_READ_BATCH];
+    while (1) {
+        ssize_t length = read(evdev->base.fd, inputs, sizeof(inputs));
+        if (length < 0) {
+            return errno == EAGAIN || errno == EINTR ? 0 : -1;
+        }
+        if (length == 0) {
+            return -1;
+        }
+        int count = (int)(length / (ssize_t)sizeof(struct input_event));
+        for (int i = 0; i < count; ++i) {
+            const struct input_event *input = &inputs[i];
+            if (input->type == EV_SYN && input->code == SYN_DROPPED) {
+                // The kernel buffer overflowed; this frame is incomplete and
+                // the state is read back once the next SYN_REPORT arrives
+                evdev->dropping = 1;
+                evdev->frame.length = 0;
+                Device *device = registry_get(evdev->base.slot);
+                if (device != NULL) {
+                    atomic_fetch_add_explicit(&device->stats.dropped, 1, memory_order_relaxed);
+                }
+            } else if (input->type == EV_SYN && input->code == SYN_REPORT) {
+                if (evdev->dropping) {
+                    resync_state(evdev, input);
+                } else {
+                    flush_frame(evdev);
+                }
+                evdev->dropping = 0;
+            } else if (!evdev->dropping && input->type != EV_SYN && input->type != EV_MSC) {
+                append_input(evdev, input);
+            }
+        }
+        if (count < EVDEV_READ_BATCH) {
+            return 0;
+        }
+    }
+}
+
+static const NodeWatcherOps evdev_ops = {
+    "evdev", "/dev/input", "event", open_evdev, read_evdev, NULL,
+};
+
+static int evdev_available() {
+    return node_watcher_available(&evdev_ops);
+}
+
+static int evdev_start() {
+    return node_watcher_start(&watcher, &evdev_ops);
+}
+
+static void evdev_stop() {
+    node_watcher_stop(&watcher);
+}
+
+static void evdev_join() {
+    node_watcher_join(&watcher);
+}
+
+const DeviceBackend evdev_backend = {
+    DEVICE_BACKEND_EVDEV, "evdev", evdev_available, evdev_start, evdev_stop, evdev_join,
+};
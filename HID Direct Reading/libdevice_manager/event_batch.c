@@ -0,0 +1,129 @@
+#include "event_batch.h"
+#include "thread_sched.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static uint64_t monotonic_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static void* deliver_batches(void* arg) {
+    EventBatcher* batcher = (EventBatcher*)arg;
+    thread_sched_apply(DEVICE_THREAD_DELIVERY);
+    pthread_mutex_lock(&batcher->mutex);
+    while (1) {
+        while (batcher->running && batcher->count == 0) {
+            pthread_cond_wait(&batcher->ready, &batcher->mutex);
+        }
+        if (batcher->count == 0) {
+            break;  // Stopped and everything was delivered
+        }
+
+        // Hold the batch open until it fills or the oldest event hits the deadline
+        while (batcher->running && batcher->count < batcher->capacity) {
+            uint64_t deadline = batcher->first_ns + batcher->deadline_ns;
+            if (monotonic_ns() >= deadline) {
+                break;
+            }
+            struct timespec ts;
+            ts.tv_sec = (time_t)(deadline / 1000000000ull);
+            ts.tv_nsec = (long)(deadline % 1000000000ull);
+            pthread_cond_timedwait(&batcher->ready, &batcher->mutex, &ts);
+        }
+
+        DeviceRawEvent* batch = batcher->buffers[batcher->filling];
+        size_t count = batcher->count;
+        batcher->filling ^= 1;
+        batcher->count = 0;
+        pthread_cond_broadcast(&batcher->space);
+
+        pthread_mutex_unlock(&batcher->mutex);
+        batcher->callback(batch, count, batcher->user);
+        pthread_mutex_lock(&batcher->mutex);
+    }
+    pthread_mutex_unlock(&batcher->mutex);
+    thread_sched_forget(DEVICE_THREAD_DELIVERY);
+    return NULL;
+}
+
+int event_batcher_start(EventBatcher* batcher, DeviceBatchCallback callback, void* user, size_t capacity, uint64_t deadline_ns) {
+    memset(batcher, 0, sizeof(EventBatcher));
+    if (capacity == 0) {
+        capacity = 1;
+    }
+    batcher->buffers[0] = malloc(capacity * sizeof(DeviceRawEvent));
+    batcher->buffers[1] = malloc(capacity * sizeof(DeviceRawEvent));
+    if (batcher->buffers[0] == NULL || batcher->buffers[1] == NULL) {
+        fprintf(stderr, "Failed to allocate event batches\n");
+        free(batcher->buffers[0]);
+        free(batcher->buffers[1]);
+        return -1;
+    }
+    batcher->callback = callback;
+    batcher->user = user;
+    batcher->capacity = capacity;
+    batcher->deadline_ns = deadline_ns;
+    batcher->running = 1;
+
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_mutex_init(&batcher->mutex, NULL);
+    pthread_cond_init(&batcher->ready, &attr);
+    pthread_cond_init(&batcher->space, &attr);
+    pthread_condattr_destroy(&attr);
+
+    if (pthread_create(&batcher->thread, NULL, deliver_batches, batcher) != 0) {
+        fprintf(stderr, "Failed to create batch delivery thread\n");
+        batcher->running = 0;
+        free(batcher->buffers[0]);
+        free(batcher->buffers[1]);
+        return -1;
+    }
+    return 0;
+}
+
+// Blocks while both buffers are full, which only happens when the callback
+// is slower than the producers. Returns 0 if the batcher is stopped.
+int event_batcher_push(EventBatcher* batcher, const DeviceRawEvent* event) {
+    pthread_mutex_lock(&batcher->mutex);
+    while (batcher->running && batcher->count == batcher->capacity) {
+        pthread_cond_wait(&batcher->space, &batcher->mutex);
+    }
+    if (!batcher->running) {
+        pthread_mutex_unlock(&batcher->mutex);
+        return 0;
+    }
+    if (batcher->count == 0) {
+        batcher->first_ns = monotonic_ns();
+    }
+    batcher->buffers[batcher->filling][batcher->count++] = *event;
+    if (batcher->count == 1 || batcher->count == batcher->capacity) {
+        pthread_cond_signal(&batcher->ready);
+    }
+    pthread_mutex_unlock(&batcher->mutex);
+    return 1;
+}
+
+// Delivers whatever is still pending, then joins the delivery thread.
+void event_batcher_stop(EventBatcher* batcher) {
+    pthread_mutex_lock(&batcher->mutex);
+    if (!batcher->running) {
+        pthread_mutex_unlock(&batcher->mutex);
+        return;
+    }
+    batcher->running = 0;
+    pthread_cond_broadcast(&batcher->ready);
+    pthread_cond_broadcast(&batcher->space);
+    pthread_mutex_unlock(&batcher->mutex);
+
+    pthread_join(batcher->thread, NULL);
+    free(batcher->buffers[0]);
+    free(batcher->buffers[1]);
+    batcher->buffers[0] = NULL;
+    batcher->buffers[1] = NULL;
+}
@@ -0,0 +1,41 @@
+#ifndef EVENT_BATCH_H
+#define EVENT_BATCH_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "device_manager.h"
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Collects events into fixed-size batches that a delivery thread hands to the
+// callback once a batch is full or its oldest event has waited deadline_ns.
+// Two buffers alternate: producers fill one while the callback reads the
+// other, so the callback runs without the batcher lock held.
+typedef struct {
+    DeviceBatchCallback callback;
+    void* user;
+    DeviceRawEvent* buffers[2];
+    size_t capacity;
+    size_t count;               // Events in buffers[filling]
+    int filling;
+    uint64_t first_ns;          // Arrival of the oldest pending event
+    uint64_t deadline_ns;
+    int running;
+    pthread_mutex_t mutex;
+    pthread_cond_t ready;       // Delivery thread: events pending
+    pthread_cond_t space;       // Producers: filling buffer was swapped out
+    pthread_t thread;
+} EventBatcher;
+
+int event_batcher_start(EventBatcher* batcher, DeviceBatchCallback callback, void* user, size_t capacity, uint64_t deadline_ns);
+int event_batcher_push(EventBatcher* batcher, const DeviceRawEvent* event);
+void event_batcher_stop(EventBatcher* batcher);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // EVENT_BATCH_H
@@ -0,0 +1,251 @@
+#include "event_frame.h"
+#include "thread_sched.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static uint64_t monotonic_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+// Events arrive almost in timestamp order, so insertion sort is close to linear.
+static void sort_events(DeviceRawEvent* events, size_t count) {
+    for (size_t i = 1; i < count; ++i) {
+        if (events[i].timestamp_ns >= events[i - 1].timestamp_ns) {
+            continue;
+        }
+        DeviceRawEvent event = events[i];
+        size_t j = i;
+        while (j > 0 && events[j - 1].timestamp_ns > event.timestamp_ns) {
+            events[j] = events[j - 1];
+            --j;
+        }
+        events[j] = event;
+    }
+}
+
+static int grow_states(EventFramer* framer, size_t slot) {
+    if (slot < framer->latest_size) {
+        return 0;
+    }
+    size_t size = framer->latest_size ? framer->latest_size : 16;
+    while (size <= slot) {
+        size *= 2;
+    }
+    DeviceRawEvent* latest = realloc(framer->latest, size * sizeof(DeviceRawEvent));
+    if (latest != NULL) {
+        framer->latest = latest;
+    }
+    uint8_t* has_latest = realloc(framer->has_latest, size);
+    if (has_latest != NULL) {
+        framer->has_latest = has_latest;
+    }
+    DeviceRawEvent* states = realloc(framer->states, size * sizeof(DeviceRawEvent));
+    if (states != NULL) {
+        framer->states = states;
+    }
+    if (latest == NULL || has_latest == NULL || states == NULL) {
+        return -1;  // Whatever was reallocated is kept, the size stays the old one
+    }
+    memset(framer->has_latest + framer->latest_size, 0, size - framer->latest_size);
+    framer->latest_size = size;
+    return 0;
+}
+
+// Builds and delivers the frame of [start, end) from the carried-over events
+// and those taken from the producers.
+static void deliver_frame(EventFramer* framer, uint64_t frame, uint64_t start, uint64_t end,
+                          const DeviceRawEvent* taken, size_t taken_count, uint64_t dropped) {
+    DeviceRawEvent* carry = framer->carry[framer->carry_index];
+    DeviceRawEvent* next_carry = framer->carry[framer->carry_index ^ 1];
+    size_t carry_count = framer->carry_count;
+    size_t next_count = 0;
+    size_t event_count = 0;
+    size_t late = 0;
+
+    for (size_t i = 0; i < carry_count + taken_count; ++i) {
+        const DeviceRawEvent* event = i < carry_count ? &carry[i] : &taken[i - carry_count];
+        if (event->timestamp_ns >= end) {
+            if (next_count < framer->capacity) {
+                next_carry[next_count++] = *event;
+            } else {
+                dropped++;
+            }
+        } else if (event_count < framer->capacity) {
+            late += event->timestamp_ns < start;
+            framer->events[event_count++] = *event;
+        } else {
+            dropped++;
+        }
+    }
+    framer->carry_index ^= 1;
+    framer->carry_count = next_count;
+    sort_events(framer->events, event_count);
+
+    for (size_t i = 0; i < event_count; ++i) {
+        const DeviceRawEvent* event = &framer->events[i];
+        if (event->device_id < 0 || grow_states(framer, (size_t)event->device_id) < 0) {
+            continue;
+        }
+        if (event->kind == DEVICE_EVENT_REPORT) {
+            framer->latest[event->device_id] = *event;
+            framer->has_latest[event->device_id] = 1;
+        } else if (event->kind == DEVICE_EVENT_DISCONNECTED) {
+            framer->has_latest[event->device_id] = 0;
+        }
+    }
+    size_t state_count = 0;
+    for (size_t i = 0; i < framer->latest_size; ++i) {
+        if (framer->has_latest[i]) {
+            framer->states[state_count++] = framer->latest[i];
+        }
+    }
+
+    DeviceFrame result;
+    result.frame = frame;
+    result.start_ns = start;
+    result.end_ns = end;
+    result.states = framer->states;
+    result.state_count = state_count;
+    result.events = framer->events;
+    result.event_count = event_count;
+    result.late = late;
+    result.dropped = dropped;
+    uint64_t now = monotonic_ns();
+    result.delivery_ns = now > end ? now - end : 0;
+    framer->callback(&result, framer->user);
+}
+
+static void* run_frames(void* arg) {
+    EventFramer* framer = (EventFramer*)arg;
+    thread_sched_apply(DEVICE_THREAD_DELIVERY);
+    uint64_t frame = 0;
+    uint64_t start = monotonic_ns();
+    uint64_t end = start + framer->period_ns;
+
+    pthread_mutex_lock(&framer->mutex);
+    while (1) {
+        // Wait out the window and its latency budget
+        uint64_t due = end + framer->budget_ns;
+        while (framer->running && monotonic_ns() < due) {
+            struct timespec ts;
+            ts.tv_sec = (time_t)(due / 1000000000ull);
+            ts.tv_nsec = (long)(due % 1000000000ull);
+            pthread_cond_timedwait(&framer->stop, &framer->mutex, &ts);
+        }
+        int stopping = !framer->running;
+        DeviceRawEvent* taken = framer->incoming[framer->filling];
+        size_t taken_count = framer->incoming_count;
+        uint64_t dropped = framer->dropped;
+        framer->filling ^= 1;
+        framer->incoming_count = 0;
+        framer->dropped = 0;
+        pthread_mutex_unlock(&framer->mutex);
+
+        if (stopping) {
+            end = UINT64_MAX;  // Last frame: everything still pending goes in
+        }
+        deliver_frame(framer, frame, start, end, taken, taken_count, dropped);
+        if (stopping) {
+            break;
+        }
+
+        // A callback slower than the period merges the windows it missed, so
+        // frames never queue up behind it
+        start = end;
+        end = start + framer->period_ns;
+        frame++;
+        uint64_t now = monotonic_ns();
+        if (now > end + framer->budget_ns) {
+            uint64_t windows = (now - framer->budget_ns - start) / framer->period_ns;
+            end = start + windows * framer->period_ns;
+            frame += windows - 1;
+        }
+        pthread_mutex_lock(&framer->mutex);
+    }
+    thread_sched_forget(DEVICE_THREAD_DELIVERY);
+    return NULL;
+}
+
+static void free_buffers(EventFramer* framer) {
+    free(framer->incoming[0]);
+    free(framer->incoming[1]);
+    free(framer->carry[0]);
+    free(framer->carry[1]);
+    free(framer->events);
+    free(framer->latest);
+    free(framer->has_latest);
+    free(framer->states);
+}
+
+int event_framer_start(EventFramer* framer, DeviceFrameCallback callback, void* user, int rate_hz, size_t capacity, uint64_t budget_ns) {
+    memset(framer, 0, sizeof(EventFramer));
+    if (rate_hz <= 0 || capacity == 0) {
+        return -1;
+    }
+    framer->incoming[0] = malloc(capacity * sizeof(DeviceRawEvent));
+    framer->incoming[1] = malloc(capacity * sizeof(DeviceRawEvent));
+    framer->carry[0] = malloc(capacity * sizeof(DeviceRawEvent));
+    framer->carry[1] = malloc(capacity * sizeof(DeviceRawEvent));
+    framer->events = malloc(capacity * sizeof(DeviceRawEvent));
+    if (framer->incoming[0] == NULL || framer->incoming[1] == NULL || framer->carry[0] == NULL ||
+        framer->carry[1] == NULL || framer->events == NULL || grow_states(framer, 0) < 0) {
+        fprintf(stderr, "Failed to allocate frame buffers\n");
+        free_buffers(framer);
+        return -1;
+    }
+    framer->callback = callback;
+    framer->user = user;
+    framer->period_ns = 1000000000ull / (uint64_t)rate_hz;
+    framer->budget_ns = budget_ns;
+    framer->capacity = capacity;
+    framer->running = 1;
+
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_mutex_init(&framer->mutex, NULL);
+    pthread_cond_init(&framer->stop, &attr);
+    pthread_condattr_destroy(&attr);
+
+    if (pthread_create(&framer->thread, NULL, run_frames, framer) != 0) {
+        fprintf(stderr, "Failed to create frame thread\n");
+        framer->running = 0;
+        free_buffers(framer);
+        return -1;
+    }
+    return 0;
+}
+
+// Never waits for the frame thread; returns 0 if the event was dropped
+// because the window already holds capacity events.
+int event_framer_push(EventFramer* framer, const DeviceRawEvent* event) {
+    pthread_mutex_lock(&framer->mutex);
+    int stored = framer->running && framer->incoming_count < framer->capacity;
+    if (stored) {
+        framer->incoming[framer->filling][framer->incoming_count++] = *event;
+    } else if (framer->running) {
+        framer->dropped++;
+    }
+    pthread_mutex_unlock(&framer->mutex);
+    return stored;
+}
+
+// Delivers a last frame with everything still pending, then joins the thread.
+void event_framer_stop(EventFramer* framer) {
+    pthread_mutex_lock(&framer->mutex);
+    if (!framer->running) {
+        pthread_mutex_unlock(&framer->mutex);
+        return;
+    }
+    framer->running = 0;
+    pthread_cond_broadcast(&framer->stop);
+    pthread_mutex_unlock(&framer->mutex);
+
+    pthread_join(framer->thread, NULL);
+    free_buffers(framer);
+    memset(framer, 0, sizeof(EventFramer));
+}
@@ -0,0 +1,53 @@
+#ifndef EVENT_FRAME_H
+#define EVENT_FRAME_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "device_manager.h"
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Fixed-rate aggregation of every device into one DeviceFrame per tick.
+// Events are placed in the window of their capture timestamp, not of their
+// arrival; a window is delivered budget_ns after it closes so events still on
+// their way through the dispatch path make it into the right frame. Producers
+// only append to a buffer under the mutex; sorting, per-device state and the
+// callback run on the frame thread.
+typedef struct {
+    DeviceFrameCallback callback;
+    void* user;
+    uint64_t period_ns;
+    uint64_t budget_ns;
+    size_t capacity;            // Events per frame, also per incoming and carry buffer
+    // Shared with producers, under mutex
+    DeviceRawEvent* incoming[2];
+    size_t incoming_count;
+    int filling;
+    uint64_t dropped;
+    int running;
+    pthread_mutex_t mutex;
+    pthread_cond_t stop;
+    // Frame thread only
+    DeviceRawEvent* carry[2];   // Events that belong to a later window
+    size_t carry_count;
+    int carry_index;
+    DeviceRawEvent* events;
+    DeviceRawEvent* latest;     // Latest report per device slot
+    uint8_t* has_latest;
+    DeviceRawEvent* states;
+    size_t latest_size;
+    pthread_t thread;
+} EventFramer;
+
+int event_framer_start(EventFramer* framer, DeviceFrameCallback callback, void* user, int rate_hz, size_t capacity, uint64_t budget_ns);
+int event_framer_push(EventFramer* framer, const DeviceRawEvent* event);
+void event_framer_stop(EventFramer* framer);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // EVENT_FRAME_H
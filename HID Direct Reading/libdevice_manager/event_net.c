@@ -0,0 +1,482 @@
+#define _GNU_SOURCE
+
+#include "event_net.h"
+#include "thread_sched.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sched.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#define RECONNECT_MIN_MS 100
+#define RECONNECT_MAX_MS 5000
+
+static void put_u16(uint8_t* out, uint16_t value) {
+    out[0] = (uint8_t)value;
+    out[1] = (uint8_t)(value >> 8);
+}
+
+static void put_u32(uint8_t* out, uint32_t value) {
+    for (int i = 0; i < 4; ++i) {
+        out[i] = (uint8_t)(value >> (8 * i));
+    }
+}
+
+static void put_u64(uint8_t* out, uint64_t value) {
+    for (int i = 0; i < 8; ++i) {
+        out[i] = (uint8_t)(value >> (8 * i));
+    }
+}
+
+static uint16_t get_u16(const uint8_t* in) {
+    return (uint16_t)(in[0] | (in[1] << 8));
+}
+
+static uint32_t get_u32(const uint8_t* in) {
+    uint32_t value = 0;
+    for (int i = 0; i < 4; ++i) {
+        value |= (uint32_t)in[i] << (8 * i);
+    }
+    return value;
+}
+
+static uint64_t get_u64(const uint8_t* in) {
+    uint64_t value = 0;
+    for (int i = 0; i < 8; ++i) {
+        value |= (uint64_t)in[i] << (8 * i);
+    }
+    return value;
+}
+
+static void reset_states(EventNetState* states) {
+    for (int i = 0; i < EVENT_NET_STATES; ++i) {
+        states[i].device_id = -1;
+    }
+}
+
+static EventNetState* find_state(EventNetState* states, int32_t device_id) {
+    return &states[(uint32_t)device_id % EVENT_NET_STATES];
+}
+
+// Patches that turn prev into cur. Short runs of equal bytes between two
+// changes are absorbed, since a new patch costs two bytes. Returns 0 when the
+// delta would not be smaller than the full report.
+static size_t encode_delta(const uint8_t* prev, const uint8_t* cur, size_t length, uint8_t* out) {
+    if (length > 255) {
+        return 0;
+    }
+    size_t pos = 0;
+    size_t i = 0;
+    while (i < length) {
+        if (prev[i] == cur[i]) {
+            i++;
+            continue;
+        }
+        size_t start = i;
+        size_t end = i + 1;
+        while (end < length) {
+            if (cur[end] != prev[end]) {
+                end++;
+                continue;
+            }
+            size_t equal = 0;
+            while (end + equal < length && equal < 3 && cur[end + equal] == prev[end + equal]) {
+                equal++;
+            }
+            if (equal > 2 || end + equal >= length) {
+                break;
+            }
+            end += equal + 1;
+        }
+        size_t count = end - start;
+        if (pos + 2 + count >= length) {
+            return 0;
+        }
+        out[pos++] = (uint8_t)start;
+        out[pos++] = (uint8_t)count;
+        memcpy(out + pos, cur + start, count);
+        pos += count;
+        i = end;
+    }
+    return pos;
+}
+
+static void encode_header(uint8_t* out, const DeviceRawEvent* event, EventNetEncoding encoding, size_t payload) {
+    put_u16(out, (uint16_t)(EVENT_NET_HEADER_SIZE - 2 + payload));
+    out[2] = (uint8_t)encoding;
+    out[3] = event->kind;
+    put_u16(out + 4, (uint16_t)event->device_id);
+    out[6] = event->interface_number;
+    out[7] = event->endpoint;
+    out[8] = event->flags;
+    out[9] = 0;
+    put_u32(out + 10, event->sequence);
+    put_u64(out + 14, event->timestamp_ns);
+}
+
+// sendmsg() instead of writev() so a closed peer returns EPIPE instead of raising SIGPIPE.
+// The socket is non-blocking: a full socket waits in poll() together with
+// the eventfd, so event_net_stop() never has to touch the socket itself.
+static int send_frames(EventNetStream* stream, struct iovec* iov, int count) {
+    while (count > 0) {
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = (size_t)count;
+        ssize_t sent = sendmsg(stream->fd, &msg, MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                return -1;
+            }
+            struct pollfd fds[2];
+            fds[0].fd = stream->fd;
+            fds[0].events = POLLOUT;
+            fds[1].fd = stream->wake_fd;
+            fds[1].events = POLLIN;
+            poll(fds, 2, -1);
+            if (fds[1].revents & POLLIN) {
+                uint64_t value;
+                if (read(stream->wake_fd, &value, sizeof(value)) < 0 && errno != EAGAIN) {
+                    return -1;
+                }
+            }
+            if (!atomic_load(&stream->running)) {
+                errno = ECANCELED;
+                return -1;
+            }
+            continue;
+        }
+        while (count > 0 && (size_t)sent >= iov->iov_len) {
+            sent -= (ssize_t)iov->iov_len;
+            iov++;
+            count--;
+        }
+        if (count > 0) {
+            iov->iov_base = (uint8_t*)iov->iov_base + sent;
+            iov->iov_len -= (size_t)sent;
+        }
+    }
+    return 0;
+}
+
+static int connect_stream(const char* host, int port) {
+    char service[16];
+    snprintf(service, sizeof(service), "%d", port);
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    struct addrinfo* addresses;
+    if (getaddrinfo(host, service, &hints, &addresses) != 0) {
+        return -1;
+    }
+    int fd = -1;
+    for (struct addrinfo* address = addresses; address != NULL; address = address->ai_next) {
+        fd = socket(address->ai_family, address->ai_socktype | SOCK_CLOEXEC, address->ai_protocol);
+        if (fd < 0) {
+            continue;
+        }
+        if (connect(fd, address->ai_addr, address->ai_addrlen) == 0) {
+            int one = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            break;
+        }
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(addresses);
+    return fd;
+}
+
+static void sleep_while_running(EventNetStream* stream, int ms) {
+    for (int waited = 0; waited < ms && atomic_load(&stream->running); waited += 50) {
+        usleep(50000);
+    }
+}
+
+// Returns 0 once the stream is stopping and should exit.
+static int wait_for_events(EventNetStream* stream) {
+    struct pollfd fd;
+    fd.fd = stream->wake_fd;
+    fd.events = POLLIN;
+    poll(&fd, 1, -1);
+    uint64_t value;
+    if (read(stream->wake_fd, &value, sizeof(value)) < 0 && errno != EAGAIN) {
+        return 0;
+    }
+    return atomic_load(&stream->running);
+}
+
+static void* send_events(void* arg) {
+    EventNetStream* stream = (EventNetStream*)arg;
+    DeviceRawEvent batch[EVENT_NET_BATCH];
+    uint8_t headers[EVENT_NET_BATCH][EVENT_NET_HEADER_SIZE];
+    uint8_t deltas[EVENT_NET_BATCH][DEVICE_REPORT_MAX];
+    struct iovec iov[2 * EVENT_NET_BATCH];
+    int backoff = RECONNECT_MIN_MS;
+    thread_sched_apply(DEVICE_THREAD_DELIVERY);
+
+    while (atomic_load(&stream->running)) {
+        if (stream->fd < 0) {
+            if (stream->host[0] == '\0') {
+                break;  // Caller-provided socket is gone; nothing to reconnect to
+            }
+            stream->fd = connect_stream(stream->host, stream->port);
+            if (stream->fd >= 0) {
+                fcntl(stream->fd, F_SETFL, fcntl(stream->fd, F_GETFL) | O_NONBLOCK);
+            }
+            if (stream->fd < 0) {
+                sleep_while_running(stream, backoff);
+                backoff = backoff * 2 < RECONNECT_MAX_MS ? backoff * 2 : RECONNECT_MAX_MS;
+                continue;
+            }
+            // The peer starts without state, so deltas restart from full reports
+            reset_states(stream->states);
+            atomic_store(&stream->connected, 1);
+            backoff = RECONNECT_MIN_MS;
+        }
+
+        size_t count = event_queue_pop(&stream->queue, batch, EVENT_NET_BATCH);
+        if (count == 0) {
+            atomic_store(&stream->wake_pending, 0);
+            count = event_queue_pop(&stream->queue, batch, EVENT_NET_BATCH);
+            if (count == 0) {
+                if (!wait_for_events(stream)) {
+                    break;
+                }
+                continue;
+            }
+        }
+
+        int iov_count = 0;
+        size_t bytes = 0;
+        uint64_t frames = 0;
+        for (size_t i = 0; i < count; ++i) {
+            DeviceRawEvent* event = &batch[i];
+            EventNetState* state = find_state(stream->states, event->device_id);
+            int known = state->device_id == event->device_id && state->endpoint == event->endpoint;
+            EventNetEncoding encoding = EVENT_NET_FULL;
+            const uint8_t* payload = event->data;
+            size_t payload_length = event->length;
+
+            if (event->kind != DEVICE_EVENT_REPORT) {
+                if (state->device_id == event->device_id) {
+                    state->device_id = -1;
+                }
+                payload_length = 0;
+            } else if (stream->change_only) {
+                if (known && state->length == event->length) {
+                    if (memcmp(state->data, event->data, event->length) == 0) {
+                        atomic_fetch_add_explicit(&stream->suppressed, 1, memory_order_relaxed);
+                        continue;
+                    }
+                    size_t delta = encode_delta(state->data, event->data, event->length, deltas[i]);
+                    if (delta > 0) {
+                        encoding = EVENT_NET_DELTA;
+                        payload = deltas[i];
+                        payload_length = delta;
+                    }
+                }
+                state->device_id = event->device_id;
+                state->endpoint = event->endpoint;
+                state->length = event->length;
+                memcpy(state->data, event->data, event->length);
+            }
+
+            encode_header(headers[i], event, encoding, payload_length);
+            iov[iov_count].iov_base = headers[i];
+            iov[iov_count++].iov_len = EVENT_NET_HEADER_SIZE;
+            if (payload_length > 0) {
+                iov[iov_count].iov_base = (void*)payload;
+                iov[iov_count++].iov_len = payload_length;
+            }
+            bytes += EVENT_NET_HEADER_SIZE + payload_length;
+            frames++;
+        }
+
+        if (iov_count > 0 && send_frames(stream, iov, iov_count) < 0) {
+            if (atomic_load(&stream->running)) {
+                fprintf(stderr, "Event stream send failed: %s\n", strerror(errno));
+            }
+            close(stream->fd);
+            stream->fd = -1;
+            atomic_store(&stream->connected, 0);
+            atomic_fetch_add_explicit(&stream->reconnects, 1, memory_order_relaxed);
+            continue;
+        }
+        atomic_fetch_add_explicit(&stream->frames, frames, memory_order_relaxed);
+        atomic_fetch_add_explicit(&stream->bytes, bytes, memory_order_relaxed);
+    }
+
+    if (stream->fd >= 0) {
+        close(stream->fd);
+        stream->fd = -1;
+    }
+    atomic_store(&stream->connected, 0);
+    atomic_store(&stream->finished, 1);
+    thread_sched_forget(DEVICE_THREAD_DELIVERY);
+    return NULL;
+}
+
+// Streams to host:port, reconnecting with exponential backoff, or to an
+// already connected socket fd (host NULL) that the stream then owns.
+int event_net_start(EventNetStream* stream, const char* host, int port, int fd,
+                    size_t capacity, DeviceQueueOverflow overflow, int change_only) {
+    atomic_store(&stream->finished, 1);
+    memset(stream, 0, offsetof(EventNetStream, finished));
+    if (event_queue_init(&stream->queue, capacity, overflow) < 0) {
+        return -1;
+    }
+    stream->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (stream->wake_fd < 0) {
+        event_queue_destroy(&stream->queue);
+        return -1;
+    }
+    if (host != NULL) {
+        snprintf(stream->host, sizeof(stream->host), "%s", host);
+        stream->fd = -1;
+    } else {
+        stream->fd = fd;
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+        atomic_store(&stream->connected, 1);
+    }
+    stream->port = port;
+    stream->change_only = change_only;
+    reset_states(stream->states);
+    atomic_store(&stream->running, 1);
+    atomic_store(&stream->finished, 0);
+
+    if (pthread_create(&stream->thread, NULL, send_events, stream) != 0) {
+        fprintf(stderr, "Failed to create event stream thread\n");
+        atomic_store(&stream->finished, 1);
+        while (atomic_load(&stream->pushing) > 0) {
+            sched_yield();
+        }
+        close(stream->wake_fd);
+        event_queue_destroy(&stream->queue);
+        return -1;
+    }
+    return 0;
+}
+
+// Never blocks on the socket; the overflow policy decides what happens when
+// the sender falls behind. One eventfd write wakes the sender per burst.
+void event_net_push(EventNetStream* stream, const DeviceRawEvent* event) {
+    atomic_fetch_add(&stream->pushing, 1);
+    if (atomic_load(&stream->finished)) {
+        atomic_fetch_sub(&stream->pushing, 1);
+        return;
+    }
+    event_queue_push(&stream->queue, event, NULL);
+    if (!atomic_exchange(&stream->wake_pending, 1)) {
+        uint64_t one = 1;
+        if (write(stream->wake_fd, &one, sizeof(one)) < 0) {
+            atomic_store(&stream->wake_pending, 0);
+        }
+    }
+    atomic_fetch_sub(&stream->pushing, 1);
+}
+
+// Joins the sender, which closes the socket, then waits for the producers
+// still inside event_net_push() before freeing the queue and the eventfd.
+void event_net_stop(EventNetStream* stream) {
+    if (!atomic_exchange(&stream->running, 0)) {
+        return;
+    }
+    uint64_t one = 1;
+    if (write(stream->wake_fd, &one, sizeof(one)) < 0) {
+        fprintf(stderr, "Could not wake the event stream thread\n");
+    }
+    pthread_join(stream->thread, NULL);
+
+    atomic_store(&stream->finished, 1);
+    while (atomic_load(&stream->pushing) > 0) {
+        DeviceRawEvent drained[16];
+        event_queue_pop(&stream->queue, drained, 16);  // Releases DEVICE_QUEUE_BLOCK producers
+        sched_yield();
+    }
+    close(stream->wake_fd);
+    stream->wake_fd = -1;
+    event_queue_destroy(&stream->queue);
+}
+
+void event_net_decoder_init(EventNetDecoder* decoder) {
+    reset_states(decoder->states);
+}
+
+// Decodes every complete frame at the start of data into events. consumed is
+// set to the bytes used; keep the rest and call again once more data arrived.
+size_t event_net_decode(EventNetDecoder* decoder, const uint8_t* data, size_t length,
+                        DeviceRawEvent* events, size_t max, size_t* consumed) {
+    size_t pos = 0;
+    size_t count = 0;
+    while (count < max && pos + EVENT_NET_HEADER_SIZE <= length) {
+        size_t size = get_u16(data + pos);
+        if (size < EVENT_NET_HEADER_SIZE - 2 || size > EVENT_NET_FRAME_MAX - 2) {
+            break;  // Corrupt stream
+        }
+        if (pos + 2 + size > length) {
+            break;
+        }
+        const uint8_t* frame = data + pos;
+        const uint8_t* payload = frame + EVENT_NET_HEADER_SIZE;
+        size_t payload_length = size + 2 - EVENT_NET_HEADER_SIZE;
+        pos += 2 + size;
+
+        DeviceRawEvent* event = &events[count];
+        memset(event, 0, sizeof(DeviceRawEvent) - DEVICE_REPORT_MAX);
+        event->kind = frame[3];
+        event->device_id = get_u16(frame + 4);
+        event->interface_number = frame[6];
+        event->endpoint = frame[7];
+        event->flags = frame[8];
+        event->sequence = get_u32(frame + 10);
+        event->timestamp_ns = get_u64(frame + 14);
+
+        EventNetState* state = find_state(decoder->states, event->device_id);
+        if (event->kind != DEVICE_EVENT_REPORT) {
+            if (state->device_id == event->device_id) {
+                state->device_id = -1;
+            }
+            count++;
+            continue;
+        }
+
+        if (frame[2] == EVENT_NET_DELTA) {
+            if (state->device_id != event->device_id || state->endpoint != event->endpoint) {
+                continue;  // Delta without a base; cannot happen on a stream read from its start
+            }
+            for (size_t i = 0; i + 2 <= payload_length;) {
+                size_t offset = payload[i];
+                size_t patch = payload[i + 1];
+                if (i + 2 + patch > payload_length || offset + patch > state->length) {
+                    break;
+                }
+                memcpy(state->data + offset, payload + i + 2, patch);
+                i += 2 + patch;
+            }
+        } else {
+            state->device_id = event->device_id;
+            state->endpoint = event->endpoint;
+            state->length = (uint16_t)payload_length;
+            memcpy(state->data, payload, payload_length);
+        }
+        event->length = state->length;
+        memcpy(event->data, state->data, state->length);
+        count++;
+    }
+    *consumed = pos;
+    return count;
+}
@@ -0,0 +1,84 @@
+#ifndef EVENT_NET_H
+#define EVENT_NET_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "device_manager.h"
+#include "event_queue.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Wire format, all fields little-endian. Every frame starts with a 22-byte
+// header:
+//   u16 size       bytes after this field
+//   u8  encoding   EVENT_NET_FULL or EVENT_NET_DELTA
+//   u8  kind       DeviceEventKind
+//   u16 device_id
+//   u8  interface_number, u8 endpoint, u8 flags, u8 reserved
+//   u32 sequence
+//   u64 timestamp_ns
+// A FULL payload is the report itself. A DELTA payload is a list of
+// (u8 offset, u8 count, count bytes) patches against the previous report of
+// the same device and endpoint, which keeps its length. With change-only
+// streaming, reports identical to the previous one are not sent at all.
+#define EVENT_NET_HEADER_SIZE 22
+#define EVENT_NET_FRAME_MAX (EVENT_NET_HEADER_SIZE + DEVICE_REPORT_MAX)
+#define EVENT_NET_STATES 256        // Devices tracked for delta encoding
+#define EVENT_NET_BATCH 64          // Frames per writev()
+
+typedef enum {
+    EVENT_NET_FULL = 0,
+    EVENT_NET_DELTA,
+} EventNetEncoding;
+
+// Last report seen per device and endpoint, on either side of the stream.
+typedef struct {
+    int32_t device_id;              // -1 when unused
+    uint8_t endpoint;
+    uint16_t length;
+    uint8_t data[DEVICE_REPORT_MAX];
+} EventNetState;
+
+typedef struct {
+    EventQueue queue;
+    int change_only;
+    int fd;                         // Sender thread only: connected socket, -1 while reconnecting
+    char host[256];                 // Empty when streaming to a caller-provided fd
+    int port;
+    int wake_fd;                    // eventfd that wakes the sender thread
+    _Atomic int wake_pending;
+    _Atomic int running;
+    pthread_t thread;
+    EventNetState states[EVENT_NET_STATES];
+    _Atomic uint64_t frames;
+    _Atomic uint64_t bytes;
+    _Atomic uint64_t suppressed;    // Unchanged reports not sent
+    _Atomic uint64_t reconnects;
+    _Atomic int connected;
+    // Kept across event_net_start(), producers of a stopped stream may still be on their way out
+    _Atomic int finished;           // Sender thread exited; pushes are ignored
+    _Atomic uint32_t pushing;       // Producers inside event_net_push()
+} EventNetStream;
+
+typedef struct {
+    EventNetState states[EVENT_NET_STATES];
+} EventNetDecoder;
+
+int event_net_start(EventNetStream* stream, const char* host, int port, int fd,
+                    size_t capacity, DeviceQueueOverflow overflow, int change_only);
+void event_net_push(EventNetStream* stream, const DeviceRawEvent* event);
+void event_net_stop(EventNetStream* stream);
+
+void event_net_decoder_init(EventNetDecoder* decoder);
+size_t event_net_decode(EventNetDecoder* decoder, const uint8_t* data, size_t length,
+                        DeviceRawEvent* events, size_t max, size_t* consumed);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // EVENT_NET_H
@@ -0,0 +1,146 @@
+#include "event_queue.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <sched.h>
+
+int event_queue_init(EventQueue* queue, size_t capacity, int overflow) {
+    size_t size = 2;
+    while (size < capacity) {
+        size <<= 1;
+    }
+
+    queue->cells = malloc(size * sizeof(EventQueueCell));
+    if (queue->cells == NULL) {
+        fprintf(stderr, "Failed to allocate event queue\n");
+        return -1;
+    }
+    for (size_t i = 0; i < size; ++i) {
+        atomic_init(&queue->cells[i].sequence, i);
+    }
+    queue->mask = size - 1;
+    queue->overflow = overflow;
+    atomic_init(&queue->head, 0);
+    atomic_init(&queue->tail, 0);
+    atomic_init(&queue->dropped, 0);
+    atomic_init(&queue->closed, 0);
+    atomic_store(&queue->destroyed, 0);  // users is left alone, like a late push of the old queue
+    return 0;
+}
+
+// Waits for the producers and consumers still inside push or pop before freeing.
+void event_queue_destroy(EventQueue* queue) {
+    atomic_store(&queue->destroyed, 1);
+    while (atomic_load(&queue->users) > 0) {
+        sched_yield();
+    }
+    free(queue->cells);
+    queue->cells = NULL;
+}
+
+// A closed queue still takes events while it has room, but a full one drops
+// them even with DEVICE_QUEUE_BLOCK, so a producer never waits for a consumer
+// that has stopped polling.
+void event_queue_close(EventQueue* queue, int closed) {
+    atomic_store(&queue->closed, closed);
+}
+
+static int try_push(EventQueue* queue, const DeviceRawEvent* event) {
+    size_t pos = atomic_load_explicit(&queue->head, memory_order_relaxed);
+    EventQueueCell* cell;
+    while (1) {
+        cell = &queue->cells[pos & queue->mask];
+        size_t sequence = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+        intptr_t diff = (intptr_t)sequence - (intptr_t)pos;
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&queue->head, &pos, pos + 1,
+                                                      memory_order_relaxed, memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            return 0;  // Full
+        } else {
+            pos = atomic_load_explicit(&queue->head, memory_order_relaxed);
+        }
+    }
+    cell->event = *event;
+    atomic_store_explicit(&cell->sequence, pos + 1, memory_order_release);
+    return 1;
+}
+
+static int try_pop(EventQueue* queue, DeviceRawEvent* event) {
+    size_t pos = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+    EventQueueCell* cell;
+    while (1) {
+        cell = &queue->cells[pos & queue->mask];
+        size_t sequence = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+        intptr_t diff = (intptr_t)sequence - (intptr_t)(pos + 1);
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&queue->tail, &pos, pos + 1,
+                                                      memory_order_relaxed, memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            return 0;  // Empty
+        } else {
+            pos = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+        }
+    }
+    if (event != NULL) {
+        *event = cell->event;
+    }
+    atomic_store_explicit(&cell->sequence, pos + queue->mask + 1, memory_order_release);
+    return 1;
+}
+
+// Returns 1 if the event was queued, 0 if it (or an older one) was dropped.
+int event_queue_push(EventQueue* queue, const DeviceRawEvent* event, int32_t* dropped_device) {
+    DeviceRawEvent evicted;
+    if (dropped_device) {
+        *dropped_device = -1;
+    }
+    atomic_fetch_add(&queue->users, 1);
+    if (atomic_load(&queue->destroyed)) {
+        atomic_fetch_sub(&queue->users, 1);
+        return 0;
+    }
+    while (!try_push(queue, event)) {
+        int overflow = queue->overflow;
+        if (overflow == DEVICE_QUEUE_BLOCK && atomic_load(&queue->closed)) {
+            overflow = DEVICE_QUEUE_DROP_NEWEST;
+        }
+        switch (overflow) {
+            case DEVICE_QUEUE_DROP_NEWEST:
+                atomic_fetch_add_explicit(&queue->dropped, 1, memory_order_relaxed);
+                if (dropped_device) {
+                    *dropped_device = event->device_id;
+                }
+                atomic_fetch_sub(&queue->users, 1);
+                return 0;
+            case DEVICE_QUEUE_DROP_OLDEST:
+                if (try_pop(queue, &evicted)) {
+                    atomic_fetch_add_explicit(&queue->dropped, 1, memory_order_relaxed);
+                    if (dropped_device) {
+                        *dropped_device = evicted.device_id;
+                    }
+                }
+                break;
+            case DEVICE_QUEUE_BLOCK:
+                sched_yield();  // Wait for the consumer to drain, or for event_queue_close()
+                break;
+        }
+    }
+    atomic_fetch_sub(&queue->users, 1);
+    return 1;
+}
+
+size_t event_queue_pop(EventQueue* queue, DeviceRawEvent* events, size_t max) {
+    size_t count = 0;
+    atomic_fetch_add(&queue->users, 1);
+    if (!atomic_load(&queue->destroyed)) {
+        while (count < max && try_pop(queue, &events[count])) {
+            count++;
+        }
+    }
+    atomic_fetch_sub(&queue->users, 1);
+    return count;
+}
@@ -0,0 +1,44 @@
+#ifndef EVENT_QUEUE_H
+#define EVENT_QUEUE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "device_manager.h"
+#include <stdatomic.h>
+#include <stddef.h>
+
+// Bounded lock-free MPMC ring of preallocated events. Every cell carries a
+// sequence number that tells producers and consumers whose turn it is, so
+// neither side ever takes a lock.
+typedef struct {
+    _Atomic size_t sequence;
+    DeviceRawEvent event;
+} EventQueueCell;
+
+typedef struct {
+    EventQueueCell* cells;
+    size_t mask;
+    int overflow;                       // DeviceQueueOverflow
+    _Alignas(64) _Atomic size_t head;   // Next position to write
+    _Alignas(64) _Atomic size_t tail;   // Next position to read
+    _Alignas(64) _Atomic uint64_t dropped;
+    _Atomic int closed;                 // DEVICE_QUEUE_BLOCK drops instead of waiting
+    _Atomic int destroyed;              // Push and pop do nothing, cells are being freed
+    _Atomic uint32_t users;             // Threads inside push or pop
+} EventQueue;
+
+int event_queue_init(EventQueue* queue, size_t capacity, int overflow);
+void event_queue_destroy(EventQueue* queue);
+void event_queue_close(EventQueue* queue, int closed);
+// Returns 0 if the event itself was dropped. dropped_device (optional) gets
+// the device_id of whichever event was discarded, or -1.
+int event_queue_push(EventQueue* queue, const DeviceRawEvent* event, int32_t* dropped_device);
+size_t event_queue_pop(EventQueue* queue, DeviceRawEvent* events, size_t max);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // EVENT_QUEUE_H
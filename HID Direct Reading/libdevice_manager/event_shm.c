@@ -0,0 +1,270 @@
+#define _GNU_SOURCE
+
+#include "event_shm.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sched.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+static long futex(_Atomic uint32_t* word, int op, uint32_t value, const struct timespec* timeout) {
+    return syscall(SYS_futex, (uint32_t*)word, op, value, timeout, NULL, 0);
+}
+
+static size_t shm_size(size_t capacity) {
+    return sizeof(EventShmHeader) + capacity * sizeof(EventShmSlot);
+}
+
+// publishing is left alone: a late event_shm_publish() of the previous
+// segment may still be on its way out.
+int event_shm_create(EventShmPublisher* publisher, const char* name, size_t capacity, int mode) {
+    publisher->header = NULL;
+    publisher->slots = NULL;
+    publisher->map_size = 0;
+    publisher->mask = 0;
+    size_t size = 2;
+    while (size < capacity) {
+        size <<= 1;
+    }
+
+    // Start from a fresh segment so stale readers of an old one see it unlinked
+    shm_unlink(name);
+    int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR | O_CLOEXEC, (mode_t)mode);
+    if (fd < 0) {
+        fprintf(stderr, "Could not create shared memory %s: %s\n", name, strerror(errno));
+        return -1;
+    }
+    fchmod(fd, (mode_t)mode);  // Not narrowed by the umask
+    size_t map_size = shm_size(size);
+    if (ftruncate(fd, (off_t)map_size) < 0) {
+        fprintf(stderr, "Could not size shared memory %s: %s\n", name, strerror(errno));
+        close(fd);
+        shm_unlink(name);
+        return -1;
+    }
+    void* map = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        fprintf(stderr, "Could not map shared memory %s: %s\n", name, strerror(errno));
+        shm_unlink(name);
+        return -1;
+    }
+
+    EventShmHeader* header = (EventShmHeader*)map;
+    header->version = EVENT_SHM_VERSION;
+    header->capacity = (uint32_t)size;
+    header->slot_size = sizeof(EventShmSlot);
+    atomic_init(&header->head, 0);
+    atomic_init(&header->notify, 0);
+    atomic_init(&header->waiters, 0);
+    atomic_init(&header->closed, 0);
+    publisher->header = header;
+    publisher->slots = (EventShmSlot*)((uint8_t*)map + sizeof(EventShmHeader));
+    publisher->map_size = map_size;
+    publisher->mask = size - 1;
+    snprintf(publisher->name, sizeof(publisher->name), "%s", name);
+
+    // The magic goes in last: readers refuse a segment without it
+    atomic_thread_fence(memory_order_release);
+    memcpy(header->magic, EVENT_SHM_MAGIC, sizeof(EVENT_SHM_MAGIC));
+    atomic_store(&publisher->live, 1);
+    return 0;
+}
+
+// Safe to call from several threads; each claims its own position. Does
+// nothing once event_shm_destroy() started.
+void event_shm_publish(EventShmPublisher* publisher, const DeviceRawEvent* event) {
+    atomic_fetch_add(&publisher->publishing, 1);
+    if (!atomic_load(&publisher->live)) {
+        atomic_fetch_sub(&publisher->publishing, 1);
+        return;
+    }
+    EventShmHeader* header = publisher->header;
+    uint64_t position = atomic_fetch_add_explicit(&header->head, 1, memory_order_relaxed);
+    EventShmSlot* slot = &publisher->slots[position & publisher->mask];
+
+    atomic_store_explicit(&slot->sequence, 2 * position + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    memcpy(&slot->event, event, sizeof(DeviceRawEvent));
+    atomic_store_explicit(&slot->sequence, 2 * position + 2, memory_order_release);
+
+    // waiters only decides whether to wake; a wrong value costs a syscall
+    atomic_fetch_add(&header->notify, 1);
+    if (atomic_load(&header->waiters) > 0) {
+        futex(&header->notify, FUTEX_WAKE, INT32_MAX, NULL);
+    }
+    atomic_fetch_sub(&publisher->publishing, 1);
+}
+
+// Waits for the threads still inside event_shm_publish() (replay, simulate or
+// a backend racing clean_up_devices()) before unmapping.
+void event_shm_destroy(EventShmPublisher* publisher) {
+    if (publisher->header == NULL) {
+        return;
+    }
+    atomic_store(&publisher->live, 0);
+    while (atomic_load(&publisher->publishing) > 0) {
+        sched_yield();
+    }
+    // Wake blocked readers so they notice the segment is gone
+    atomic_store(&publisher->header->closed, 1);
+    atomic_fetch_add(&publisher->header->notify, 1);
+    futex(&publisher->header->notify, FUTEX_WAKE, INT32_MAX, NULL);
+    munmap(publisher->header, publisher->map_size);
+    shm_unlink(publisher->name);
+    publisher->header = NULL;
+    publisher->slots = NULL;
+    publisher->map_size = 0;
+}
+
+// Starts at the current head, so only events published after opening are read.
+int device_shm_open(DeviceShmReader* reader, const char* name) {
+    memset(reader, 0, sizeof(DeviceShmReader));
+    int fd = shm_open(name, O_RDWR | O_CLOEXEC, 0);
+    reader->writable = fd >= 0;
+    if (fd < 0) {
+        fd = shm_open(name, O_RDONLY | O_CLOEXEC, 0);
+    }
+    if (fd < 0) {
+        fprintf(stderr, "Could not open shared memory %s: %s\n", name, strerror(errno));
+        return -1;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(EventShmHeader)) {
+        close(fd);
+        return -1;
+    }
+    int prot = reader->writable ? PROT_READ | PROT_WRITE : PROT_READ;
+    void* map = mmap(NULL, (size_t)st.st_size, prot, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return -1;
+    }
+
+    EventShmHeader* header = (EventShmHeader*)map;
+    uint32_t capacity = *(volatile uint32_t*)&header->capacity;  // Read once, then validated
+    if (memcmp(header->magic, EVENT_SHM_MAGIC, sizeof(EVENT_SHM_MAGIC)) != 0 ||
+        header->version != EVENT_SHM_VERSION || header->slot_size != sizeof(EventShmSlot) ||
+        capacity == 0 || (capacity & (capacity - 1)) != 0 || shm_size(capacity) > (size_t)st.st_size) {
+        fprintf(stderr, "%s is not a compatible event ring\n", name);
+        munmap(map, (size_t)st.st_size);
+        return -1;
+    }
+    reader->header = header;
+    reader->slots = (EventShmSlot*)((uint8_t*)map + sizeof(EventShmHeader));
+    reader->map_size = (size_t)st.st_size;
+    reader->capacity = capacity;
+    reader->position = atomic_load_explicit(&header->head, memory_order_acquire);
+    return 0;
+}
+
+// Copies up to max events. lost (optional) is incremented by the number of
+// events that were overwritten before this reader got to them.
+size_t device_shm_read(DeviceShmReader* reader, DeviceRawEvent* events, size_t max, uint64_t* lost) {
+    EventShmHeader* header = reader->header;
+    uint64_t capacity = reader->capacity;  // Not the header's, other readers may write to it
+    uint64_t head = atomic_load_explicit(&header->head, memory_order_acquire);
+    uint64_t skipped = 0;
+    if (head - reader->position > capacity) {
+        skipped += head - capacity - reader->position;
+        reader->position = head - capacity;
+    }
+
+    size_t count = 0;
+    while (count < max && reader->position < head) {
+        EventShmSlot* slot = &reader->slots[reader->position & (capacity - 1)];
+        uint64_t expected = 2 * reader->position + 2;
+        uint64_t before = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+        if (before < expected) {
+            break;  // Claimed but not written yet
+        }
+        if (before == expected) {
+            memcpy(&events[count], &slot->event, sizeof(DeviceRawEvent));
+            atomic_thread_fence(memory_order_acquire);
+            if (atomic_load_explicit(&slot->sequence, memory_order_relaxed) == expected) {
+                count++;
+                reader->position++;
+                continue;
+            }
+        }
+        skipped++;  // Overwritten by a later lap
+        reader->position++;
+    }
+    if (lost != NULL) {
+        *lost += skipped;
+    }
+    return count;
+}
+
+// closed is stored before the last notify bump, so it is checked first:
+// events published before it are still read.
+static int shm_ready(DeviceShmReader* reader) {
+    EventShmHeader* header = reader->header;
+    int closed = atomic_load(&header->closed) != 0;
+    if (reader->position < atomic_load(&header->head)) {
+        return 1;
+    }
+    return closed ? -1 : 0;
+}
+
+// timeout_ms < 0 waits forever, or until the publisher closes the ring.
+int device_shm_wait(DeviceShmReader* reader, int timeout_ms) {
+    EventShmHeader* header = reader->header;
+    int ready = shm_ready(reader);
+    if (ready != 0) {
+        return ready;
+    }
+    if (!reader->writable) {
+        // Cannot register as a waiter; poll instead
+        uint64_t deadline = (uint64_t)(timeout_ms < 0 ? 0 : timeout_ms);
+        for (uint64_t waited = 0; timeout_ms < 0 || waited < deadline; waited++) {
+            usleep(1000);
+            ready = shm_ready(reader);
+            if (ready != 0) {
+                return ready;
+            }
+        }
+        return 0;
+    }
+
+    // A wake-up can belong to an event that was already read, so keep waiting
+    // on an absolute deadline until something new is published
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += timeout_ms / 1000;
+    deadline.tv_nsec += (long)(timeout_ms % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+    atomic_fetch_add(&header->waiters, 1);
+    while (1) {
+        uint32_t seen = atomic_load(&header->notify);
+        ready = shm_ready(reader);
+        if (ready != 0) {
+            break;
+        }
+        long res = syscall(SYS_futex, (uint32_t*)&header->notify, FUTEX_WAIT_BITSET, seen,
+                           timeout_ms < 0 ? NULL : &deadline, NULL, FUTEX_BITSET_MATCH_ANY);
+        if (res < 0 && errno == ETIMEDOUT) {
+            ready = shm_ready(reader);
+            break;
+        }
+    }
+    atomic_fetch_sub(&header->waiters, 1);
+    return ready;
+}
+
+void device_shm_close(DeviceShmReader* reader) {
+    if (reader->header != NULL) {
+        munmap(reader->header, reader->map_size);
+    }
+    memset(reader, 0, sizeof(DeviceShmReader));
+}
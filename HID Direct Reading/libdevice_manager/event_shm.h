@@ -0,0 +1,76 @@
+#ifndef EVENT_SHM_H
+#define EVENT_SHM_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "device_manager.h"
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Event ring in POSIX shared memory for out-of-process readers. The
+// publisher never waits for readers: every slot is a seqlock, so a reader
+// that falls more than a ring behind notices it was overwritten and skips
+// ahead. Readers that want to block register in `waiters`; the publisher only
+// calls FUTEX_WAKE when someone is waiting.
+#define EVENT_SHM_MAGIC "DEVSHM1"
+#define EVENT_SHM_VERSION 3
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t capacity;                  // Slots, power of two
+    uint32_t slot_size;
+    uint32_t reserved;
+    _Alignas(64) _Atomic uint64_t head; // Next position to publish
+    _Alignas(64) _Atomic uint32_t notify;   // Futex word, bumped on every publish
+    _Atomic uint32_t waiters;
+    _Atomic uint32_t closed;            // Set by the publisher before it unmaps, no more events follow
+} EventShmHeader;
+
+typedef struct {
+    _Atomic uint64_t sequence;          // 2 * position + 1 while writing, + 2 once written
+    DeviceRawEvent event;
+} EventShmSlot;
+
+// Publisher side, used by device_manager.c. Readers may have write access to
+// the segment, so nothing in the header is trusted: the ring size is kept here.
+typedef struct {
+    EventShmHeader* header;
+    EventShmSlot* slots;
+    size_t map_size;
+    uint64_t mask;                      // Slots - 1
+    char name[64];
+    _Atomic uint32_t publishing;        // Threads inside event_shm_publish()
+    _Atomic int live;                   // Set last by create, cleared first by destroy
+} EventShmPublisher;
+
+int event_shm_create(EventShmPublisher* publisher, const char* name, size_t capacity, int mode);
+void event_shm_publish(EventShmPublisher* publisher, const DeviceRawEvent* event);
+void event_shm_destroy(EventShmPublisher* publisher);
+
+// Reader side. Needs only read access to the segment; write access lets
+// device_shm_wait() sleep on the futex instead of polling.
+typedef struct {
+    EventShmHeader* header;
+    EventShmSlot* slots;
+    size_t map_size;
+    uint64_t position;
+    uint64_t capacity;                  // As validated by device_shm_open()
+    int writable;
+} DeviceShmReader;
+
+int device_shm_open(DeviceShmReader* reader, const char* name);
+size_t device_shm_read(DeviceShmReader* reader, DeviceRawEvent* events, size_t max, uint64_t* lost);
+// 1 when events are available, 0 on timeout, -1 once the publisher closed
+// the ring and every event it published was read.
+int device_shm_wait(DeviceShmReader* reader, int timeout_ms);
+void device_shm_close(DeviceShmReader* reader);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // EVENT_SHM_H
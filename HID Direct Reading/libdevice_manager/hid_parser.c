@@ -0,0 +1,298 @@
+#include "hid_parser.h"
+#include <stdio.h>
+#include <string.h>
+
+// Item prefix: bits 0-1 size, bits 2-3 type, bits 4-7 tag
+#define HID_ITEM_MAIN 0
+#define HID_ITEM_GLOBAL 1
+#define HID_ITEM_LOCAL 2
+#define HID_ITEM_LONG 0xfe
+
+#define HID_MAIN_INPUT 0x8
+#define HID_MAIN_OUTPUT 0x9
+#define HID_MAIN_COLLECTION 0xa
+#define HID_MAIN_FEATURE 0xb
+#define HID_MAIN_END_COLLECTION 0xc
+
+#define HID_GLOBAL_USAGE_PAGE 0x0
+#define HID_GLOBAL_LOGICAL_MIN 0x1
+#define HID_GLOBAL_LOGICAL_MAX 0x2
+#define HID_GLOBAL_REPORT_SIZE 0x7
+#define HID_GLOBAL_REPORT_ID 0x8
+#define HID_GLOBAL_REPORT_COUNT 0x9
+#define HID_GLOBAL_PUSH 0xa
+#define HID_GLOBAL_POP 0xb
+
+#define HID_LOCAL_USAGE 0x0
+#define HID_LOCAL_USAGE_MIN 0x1
+#define HID_LOCAL_USAGE_MAX 0x2
+
+#define HID_INPUT_CONSTANT 0x01
+#define HID_INPUT_VARIABLE 0x02
+
+#define HID_MAX_USAGES 64
+#define HID_MAX_REPORT_IDS 256
+
+typedef struct {
+    uint32_t usage_page;
+    int32_t logical_min;
+    int32_t logical_max;
+    uint32_t report_size;
+    uint32_t report_count;
+    uint32_t report_id;
+} HidGlobalState;
+
+typedef struct {
+    uint32_t usages[HID_MAX_USAGES];
+    int usage_count;
+    uint32_t usage_min;
+    uint32_t usage_max;
+    int has_range;
+} HidLocalState;
+
+static uint32_t item_unsigned(const uint8_t* data, int size) {
+    uint32_t value = 0;
+    for (int i = 0; i < size; ++i) {
+        value |= (uint32_t)data[i] << (8 * i);
+    }
+    return value;
+}
+
+static int32_t item_signed(const uint8_t* data, int size) {
+    uint32_t value = item_unsigned(data, size);
+    if (size > 0 && size < 4 && (value & (1u << (8 * size - 1)))) {
+        value |= ~0u << (8 * size);
+    }
+    return (int32_t)value;
+}
+
+// Usage for the n-th element of a main item; a 32-bit usage carries its own page.
+static uint32_t local_usage(const HidLocalState* local, const HidGlobalState* global, uint32_t n) {
+    uint32_t usage = 0;
+    if (local->has_range) {
+        usage = local->usage_min + n;
+        if (usage > local->usage_max) {
+            usage = local->usage_max;
+        }
+    } else if (local->usage_count > 0) {
+        usage = local->usages[n < (uint32_t)local->usage_count ? n : (uint32_t)local->usage_count - 1];
+    }
+    if ((usage >> 16) == 0) {
+        usage |= global->usage_page << 16;
+    }
+    return usage;
+}
+
+static void add_input_fields(HidLayout* layout, const HidGlobalState* global, const HidLocalState* local,
+                             uint32_t flags, uint32_t bit_offset) {
+    if (flags & HID_INPUT_CONSTANT) {
+        return;  // Padding
+    }
+    if (global->report_size == 0 || global->report_size > 32) {
+        return;
+    }
+
+    for (uint32_t n = 0; n < global->report_count && layout->field_count < HID_MAX_FIELDS; ++n) {
+        uint32_t usage = local_usage(local, global, (flags & HID_INPUT_VARIABLE) ? n : 0);
+        uint32_t offset = bit_offset + n * global->report_size;
+
+        HidField* field = &layout->fields[layout->field_count];
+        memset(field, 0, sizeof(HidField));
+        field->report_id = (uint8_t)global->report_id;
+        field->bit_size = (uint8_t)global->report_size;
+        field->byte_offset = (uint16_t)(offset / 8);
+        field->shift = (uint8_t)(offset % 8);
+        field->mask = global->report_size == 32 ? 0xffffffffu : (1u << global->report_size) - 1;
+        field->is_signed = global->logical_min < 0;
+        field->logical_min = global->logical_min;
+        field->logical_max = global->logical_max;
+        field->usage_page = (uint16_t)(usage >> 16);
+        field->usage = (uint16_t)usage;
+
+        if (!(flags & HID_INPUT_VARIABLE)) {
+            field->kind = HID_FIELD_ARRAY;
+            field->index = (uint16_t)n;
+        } else if (field->usage_page == HID_PAGE_BUTTON) {
+            field->kind = HID_FIELD_BUTTON;
+            field->index = (uint16_t)layout->button_count++;
+        } else if (field->usage_page == HID_PAGE_GENERIC_DESKTOP && field->usage == HID_USAGE_HAT_SWITCH) {
+            field->kind = HID_FIELD_HAT;
+            field->index = (uint16_t)layout->hat_count++;
+        } else {
+            field->kind = HID_FIELD_AXIS;
+            field->index = (uint16_t)layout->axis_count++;
+        }
+        layout->field_count++;
+    }
+}
+
+// Parses the descriptor once and compiles the input fields into layout.
+// Returns the number of fields or -1 if the descriptor is malformed.
+int hid_parse_report_descriptor(const uint8_t* descriptor, size_t length, HidLayout* layout) {
+    HidGlobalState global;
+    HidGlobalState stack[HID_STACK_DEPTH];
+    HidLocalState local;
+    int stack_depth = 0;
+    uint32_t offsets[HID_MAX_REPORT_IDS];  // Running input bit offset per report ID
+
+    memset(layout, 0, sizeof(HidLayout));
+    memset(&global, 0, sizeof(global));
+    memset(&local, 0, sizeof(local));
+    memset(offsets, 0, sizeof(offsets));
+
+    size_t pos = 0;
+    while (pos < length) {
+        uint8_t prefix = descriptor[pos];
+        if (prefix == HID_ITEM_LONG) {
+            if (pos + 2 >= length) {
+                return -1;
+            }
+            pos += 3 + descriptor[pos + 1];
+            continue;
+        }
+
+        int size = prefix & 0x03;
+        if (size == 3) {
+            size = 4;
+        }
+        int type = (prefix >> 2) & 0x03;
+        int tag = prefix >> 4;
+        if (pos + 1 + (size_t)size > length) {
+            fprintf(stderr, "Truncated HID report descriptor\n");
+            return -1;
+        }
+        const uint8_t* data = &descriptor[pos + 1];
+        pos += 1 + (size_t)size;
+
+        switch (type) {
+            case HID_ITEM_MAIN:
+                if (tag == HID_MAIN_INPUT) {
+                    uint32_t* offset = &offsets[global.report_id & 0xff];
+                    add_input_fields(layout, &global, &local, item_unsigned(data, size), *offset);
+                    *offset += global.report_size * global.report_count;
+                }
+                // Output, feature and collection items only reset the local state
+                memset(&local, 0, sizeof(local));
+                break;
+            case HID_ITEM_GLOBAL:
+                switch (tag) {
+                    case HID_GLOBAL_USAGE_PAGE: global.usage_page = item_unsigned(data, size); break;
+                    case HID_GLOBAL_LOGICAL_MIN: global.logical_min = item_signed(data, size); break;
+                    case HID_GLOBAL_LOGICAL_MAX:
+                        // A positive maximum is unsigned unless the minimum is negative
+                        global.logical_max = global.logical_min < 0 ? item_signed(data, size) : (int32_t)item_unsigned(data, size);
+                        break;
+                    case HID_GLOBAL_REPORT_SIZE: global.report_size = item_unsigned(data, size); break;
+                    case HID_GLOBAL_REPORT_COUNT: global.report_count = item_unsigned(data, size); break;
+                    case HID_GLOBAL_REPORT_ID:
+                        global.report_id = item_unsigned(data, size);
+                        layout->uses_report_ids = 1;
+                        break;
+                    case HID_GLOBAL_PUSH:
+                        if (stack_depth < HID_STACK_DEPTH) {
+                            stack[stack_depth++] = global;
+                        }
+                        break;
+                    case HID_GLOBAL_POP:
+                        if (stack_depth > 0) {
+                            global = stack[--stack_depth];
+                        }
+                        break;
+                }
+                break;
+            case HID_ITEM_LOCAL:
+                switch (tag) {
+                    case HID_LOCAL_USAGE:
+                        if (local.usage_count < HID_MAX_USAGES) {
+                            local.usages[local.usage_count++] = item_unsigned(data, size);
+                        }
+                        break;
+                    case HID_LOCAL_USAGE_MIN:
+                        local.usage_min = item_unsigned(data, size);
+                        local.has_range = 1;
+                        break;
+                    case HID_LOCAL_USAGE_MAX:
+                        local.usage_max = item_unsigned(data, size);
+                        local.has_range = 1;
+                        break;
+                }
+                break;
+        }
+    }
+
+    return layout->field_count;
+}
+
+// Decodes one interrupt report using the compiled layout. Returns the number of values written.
+int hid_decode_report(const HidLayout* layout, const uint8_t* report, size_t length, HidValue* values, int max) {
+    uint8_t report_id = 0;
+    if (layout->uses_report_ids) {
+        if (length == 0) {
+            return 0;
+        }
+        report_id = report[0];
+        report++;
+        length--;
+    }
+
+    int count = 0;
+    for (int i = 0; i < layout->field_count && count < max; ++i) {
+        const HidField* field = &layout->fields[i];
+        if (field->report_id != report_id) {
+            continue;
+        }
+        size_t bytes = ((size_t)field->shift + field->bit_size + 7) / 8;
+        if ((size_t)field->byte_offset + bytes > length) {
+            continue;
+        }
+
+        uint64_t raw = 0;
+        for (size_t b = 0; b < bytes; ++b) {
+            raw |= (uint64_t)report[field->byte_offset + b] << (8 * b);
+        }
+        uint32_t bits = (uint32_t)(raw >> field->shift) & field->mask;
+        int32_t value = (int32_t)bits;
+        if (field->is_signed && field->bit_size < 32 && (bits & (1u << (field->bit_size - 1)))) {
+            value = (int32_t)(bits | ~field->mask);
+        }
+
+        values[count].kind = field->kind;
+        values[count].index = field->index;
+        values[count].field = (uint16_t)i;
+        values[count].value = value;
+        count++;
+    }
+    return count;
+}
+
+// Maps a logical value to the ranges SDL reports: axes in [-32768, 32767],
+// hats as SDL_HAT_* bit masks, buttons as 0/1.
+int32_t hid_normalize_value(const HidField* field, int32_t value) {
+    static const int32_t hat_masks[8] = {0x01, 0x03, 0x02, 0x06, 0x04, 0x0c, 0x08, 0x09};
+    int64_t range = (int64_t)field->logical_max - field->logical_min;
+
+    switch (field->kind) {
+        case HID_FIELD_AXIS:
+            if (range <= 0) {
+                return value;
+            }
+            if (value < field->logical_min) {
+                value = field->logical_min;
+            } else if (value > field->logical_max) {
+                value = field->logical_max;
+            }
+            return (int32_t)(((int64_t)value - field->logical_min) * 65535 / range - 32768);
+        case HID_FIELD_HAT: {
+            int64_t position = (int64_t)value - field->logical_min;
+            if (position < 0 || position > range || position >= 8) {
+                return 0;  // Null state, centered
+            }
+            // Hats with four positions step by 90 degrees
+            return range == 3 ? hat_masks[position * 2] : hat_masks[position];
+        }
+        case HID_FIELD_BUTTON:
+            return value != 0;
+        default:
+            return value;
+    }
+}
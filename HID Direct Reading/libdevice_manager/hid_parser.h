@@ -0,0 +1,67 @@
+#ifndef HID_PARSER_H
+#define HID_PARSER_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define HID_MAX_FIELDS 128
+#define HID_STACK_DEPTH 4
+
+#define HID_PAGE_GENERIC_DESKTOP 0x01
+#define HID_PAGE_BUTTON 0x09
+#define HID_USAGE_HAT_SWITCH 0x39
+
+typedef enum {
+    HID_FIELD_AXIS = 0,
+    HID_FIELD_BUTTON,
+    HID_FIELD_HAT,
+    HID_FIELD_ARRAY,        // Array item (keyboard style), value is the selected usage
+} HidFieldKind;
+
+// One input field of the compiled decode table. Offsets are resolved at
+// parse time so decoding is a load, a shift and a mask.
+typedef struct {
+    uint8_t report_id;
+    uint8_t kind;           // HidFieldKind
+    uint8_t bit_size;
+    uint8_t is_signed;
+    uint16_t byte_offset;   // Relative to the payload (after the report ID byte)
+    uint8_t shift;
+    uint8_t reserved;
+    uint32_t mask;
+    uint16_t usage_page;
+    uint16_t usage;
+    uint16_t index;         // Axis/button/hat number within the device
+    int32_t logical_min;
+    int32_t logical_max;
+} HidField;
+
+typedef struct {
+    HidField fields[HID_MAX_FIELDS];
+    int field_count;
+    int uses_report_ids;
+    int axis_count;
+    int button_count;
+    int hat_count;
+} HidLayout;
+
+typedef struct {
+    uint8_t kind;           // HidFieldKind
+    uint16_t index;
+    uint16_t field;         // Position of the field in the layout
+    int32_t value;          // Logical value
+} HidValue;
+
+int hid_parse_report_descriptor(const uint8_t* descriptor, size_t length, HidLayout* layout);
+int hid_decode_report(const HidLayout* layout, const uint8_t* report, size_t length, HidValue* values, int max);
+int32_t hid_normalize_value(const HidField* field, int32_t value);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // HID_PARSER_H
@@ -0,0 +1,154 @@
+#define _GNU_SOURCE
+
+#include "device_backend.h"
+#include "device_registry.h"
+#include "node_watcher.h"
+#include <errno.h>
+#include <linux/hidraw.h>
+#include <linux/input.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/uio.h>
+
+// Reads /dev/hidraw* nodes from the epoll thread of a node watcher. The
+// kernel HID driver stays bound, so nothing is detached and no root is
+// needed, only read access to the nodes. The report descriptor comes from HIDIOCGRDESC instead
+// of a GET_DESCRIPTOR control transfer.
+//
+// hidraw returns one report per read(), so each wakeup drains up to
+// HIDRAW_READ_BATCH reports per device. readv() puts the first
+// DEVICE_REPORT_MAX bytes straight into the event and the rest in a spill
+// buffer, which only serves to measure truncated reports.
+
+#define HIDRAW_READ_BATCH 32
+#define HIDRAW_SPILL_SIZE 4096
+
+static uint8_t spill[HIDRAW_SPILL_SIZE];
+static NodeWatcher watcher;
+
+// Reads the report descriptor into the single interface of a hidraw device.
+static void read_descriptor(int fd, DeviceInterface *interface) {
+    int size = 0;
+    if (ioctl(fd, HIDIOCGRDESCSIZE, &size) < 0 || size <= 0) {
+        return;
+    }
+    struct hidraw_report_descriptor descriptor;
+    descriptor.size = (uint32_t)size < HID_MAX_DESCRIPTOR_SIZE ? (uint32_t)size : HID_MAX_DESCRIPTOR_SIZE;
+    if (ioctl(fd, HIDIOCGRDESC, &descriptor) < 0) {
+        return;
+    }
+    interface->report_descriptor = malloc(descriptor.size);
+    if (interface->report_descriptor == NULL) {
+        return;
+    }
+    memcpy(interface->report_descriptor, descriptor.value, descriptor.size);
+    interface->report_descriptor_length = (int)descriptor.size;
+    backend_compile_layout(interface);
+}
+
+// Takes a node if it is an external (USB or Bluetooth) device assigned to this backend.
+static WatchedNode* open_hidraw(int fd, const char *node) {
+    struct hidraw_devinfo info;
+    if (ioctl(fd, HIDIOCGRAWINFO, &info) < 0 || (info.bustype != BUS_USB && info.bustype != BUS_BLUETOOTH) ||
+        device_backend_for((uint16_t)info.vendor, (uint16_t)info.product) != DEVICE_BACKEND_HIDRAW) {
+        return NULL;
+    }
+
+    Device candidate;
+    memset(&candidate, 0, sizeof(Device));
+    candidate.vendor_id = (uint16_t)info.vendor;
+    candidate.product_id = (uint16_t)info.product;
+    candidate.backend = DEVICE_BACKEND_HIDRAW;
+    candidate.fd = fd;
+    if (ioctl(fd, HIDIOCGRAWNAME(sizeof(candidate.device_name)), candidate.device_name) < 0) {
+        snprintf(candidate.device_name, sizeof(candidate.device_name), "%04x:%04x", candidate.vendor_id, candidate.product_id);
+    }
+    candidate.device_name[sizeof(candidate.device_name) - 1] = '\0';
+    // The physical path ends in the interface ("usb-...-2/input0"), like the libusb port key
+    char phys[64] = "";
+    char uniq[64] = "";
+    ioctl(fd, HIDIOCGRAWPHYS(sizeof(phys) - 1), phys);
+#ifdef HIDIOCGRAWUNIQ
+    ioctl(fd, HIDIOCGRAWUNIQ(sizeof(uniq) - 1), uniq);
+#endif
+    snprintf(candidate.key, sizeof(candidate.key), "hidraw:%.47s/%.40s", phys[0] ? phys : node, uniq);
+    candidate.interface_count = 1;
+    read_descriptor(fd, &candidate.interfaces[0]);
+
+    WatchedNode *hidraw = calloc(1, sizeof(WatchedNode));
+    if (hidraw == NULL) {
+        free(candidate.interfaces[0].report_descriptor);
+        free(candidate.interfaces[0].layout);
+        free(candidate.interfaces[0].field_values);
+        return NULL;
+    }
+    hidraw->slot = backend_add_device(&candidate);
+    if (hidraw->slot < 0) {
+        free(hidraw);
+        return NULL;
+    }
+    return hidraw;
+}
+
+// Reads up to HIDRAW_READ_BATCH queued reports; returns -1 once the device is gone.
+static int read_hidraw(WatchedNode *hidraw) {
+    Device *device = registry_get(hidraw->slot);
+    if (device == NULL) {
+        return -1;
+    }
+    DeviceRawEvent event;
+    struct iovec iov[2];
+    iov[0].iov_base = event.data;
+    iov[0].iov_len = DEVICE_REPORT_MAX;
+    iov[1].iov_base = spill;
+    iov[1].iov_len = sizeof(spill);
+    for (int i = 0; i < HIDRAW_READ_BATCH; ++i) {
+        ssize_t length = readv(hidraw->fd, iov, 2);
+        if (length < 0) {
+            return errno == EAGAIN || errno == EINTR ? 0 : -1;
+        }
+        if (length == 0) {
+            return -1;
+        }
+        backend_init_event(&event, device, DEVICE_EVENT_REPORT);
+        if (length > DEVICE_REPORT_MAX) {
+            event.length = DEVICE_REPORT_MAX;
+            event.flags |= DEVICE_EVENT_TRUNCATED;
+        } else {
+            event.length = (uint16_t)length;
+        }
+        backend_report(device, &event, (size_t)length);
+    }
+    return 0;
+}
+
+// Axis filters of idle devices are flushed between waits
+static int hidraw_timeout() {
+    return backend_flush_filters(DEVICE_BACKEND_HIDRAW);
+}
+
+static const NodeWatcherOps hidraw_ops = {
+    "hidraw", "/dev", "hidraw", open_hidraw, read_hidraw, hidraw_timeout,
+};
+
+static int hidraw_available() {
+    return node_watcher_available(&hidraw_ops);
+}
+
+static int hidraw_start() {
+    return node_watcher_start(&watcher, &hidraw_ops);
+}
+
+static void hidraw_stop() {
+    node_watcher_stop(&watcher);
+}
+
+static void hidraw_join() {
+    node_watcher_join(&watcher);
+}
+
+const DeviceBackend hidraw_backend = {
+    DEVICE_BACKEND_HIDRAW, "hidraw", hidraw_available, hidraw_start, hidraw_stop, hidraw_join,
+};
@@ -0,0 +1,215 @@
+#define _GNU_SOURCE
+
+#include "node_watcher.h"
+#include "device_backend.h"
+#include "thread_sched.h"
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#define NODE_WATCHER_TAG_WAKE ((uint64_t)-1)
+#define NODE_WATCHER_TAG_INOTIFY ((uint64_t)-2)
+
+int node_watcher_available(const NodeWatcherOps* ops) {
+    DIR *dir = opendir(ops->dir);
+    if (dir == NULL) {
+        return 0;
+    }
+    size_t prefix = strlen(ops->prefix);
+    int readable = 0;
+    struct dirent *entry;
+    while (!readable && (entry = readdir(dir)) != NULL) {
+        char path[300];
+        snprintf(path, sizeof(path), "%s/%s", ops->dir, entry->d_name);
+        readable = strncmp(entry->d_name, ops->prefix, prefix) == 0 && access(path, R_OK) == 0;
+    }
+    closedir(dir);
+    return readable;
+}
+
+static int find_node(NodeWatcher *watcher, const char *node) {
+    for (int i = 0; i < NODE_WATCHER_MAX; ++i) {
+        if (watcher->nodes[i] != NULL && strcmp(watcher->nodes[i]->node, node) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static void close_node(NodeWatcher *watcher, int index) {
+    WatchedNode *node = watcher->nodes[index];
+    epoll_ctl(watcher->epoll_fd, EPOLL_CTL_DEL, node->fd, NULL);
+    close(node->fd);
+    fprintf(stderr, "Device %d disconnected\n", node->slot);
+    backend_remove_device(node->slot);
+    free(node);
+    watcher->nodes[index] = NULL;
+}
+
+static void open_node(NodeWatcher *watcher, const char *name) {
+    const NodeWatcherOps *ops = watcher->ops;
+    if (strncmp(name, ops->prefix, strlen(ops->prefix)) != 0 || strlen(name) >= sizeof(((WatchedNode*)0)->node) ||
+        find_node(watcher, name) >= 0) {
+        return;
+    }
+    int index = 0;
+    while (index < NODE_WATCHER_MAX && watcher->nodes[index] != NULL) {
+        ++index;
+    }
+    if (index == NODE_WATCHER_MAX) {
+        return;
+    }
+
+    char path[300];
+    snprintf(path, sizeof(path), "%s/%s", ops->dir, name);
+    int fd = open(path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0) {
+        return;  // Not readable yet (udev sets permissions after creating the node) or not ours
+    }
+    WatchedNode *node = ops->open_node(fd, name);
+    if (node == NULL) {
+        close(fd);
+        return;
+    }
+    node->fd = fd;
+    snprintf(node->node, sizeof(node->node), "%s", name);
+
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.u64 = (uint64_t)index;
+    watcher->nodes[index] = node;
+    if (epoll_ctl(watcher->epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+        fprintf(stderr, "Could not watch %s\n", path);
+        close_node(watcher, index);
+    }
+}
+
+static void scan_nodes(NodeWatcher *watcher) {
+    DIR *dir = opendir(watcher->ops->dir);
+    if (dir == NULL) {
+        return;
+    }
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        open_node(watcher, entry->d_name);
+    }
+    closedir(dir);
+}
+
+static void drain_inotify(NodeWatcher *watcher) {
+    char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    ssize_t length;
+    while ((length = read(watcher->inotify_fd, buffer, sizeof(buffer))) > 0) {
+        for (ssize_t pos = 0; pos < length;) {
+            const struct inotify_event *event = (const struct inotify_event*)(buffer + pos);
+            if (event->len > 0) {
+                open_node(watcher, event->name);
+            }
+            pos += (ssize_t)sizeof(struct inotify_event) + event->len;
+        }
+    }
+}
+
+static void* watch_nodes(void* arg) {
+    NodeWatcher *watcher = (NodeWatcher*)arg;
+    const NodeWatcherOps *ops = watcher->ops;
+    thread_sched_apply(DEVICE_THREAD_READER);
+    scan_nodes(watcher);
+    struct epoll_event events[NODE_WATCHER_EPOLL_BATCH];
+    while (atomic_load(&watcher->running)) {
+        int timeout = ops->timeout != NULL ? ops->timeout() : -1;
+        int ready = epoll_wait(watcher->epoll_fd, events, NODE_WATCHER_EPOLL_BATCH, timeout);
+        for (int i = 0; i < ready; ++i) {
+            uint64_t tag = events[i].data.u64;
+            if (tag == NODE_WATCHER_TAG_WAKE) {
+                uint64_t value;
+                if (read(watcher->wake_fd, &value, sizeof(value)) < 0) {
+                    // Already drained
+                }
+            } else if (tag == NODE_WATCHER_TAG_INOTIFY) {
+                drain_inotify(watcher);
+            } else if (watcher->nodes[tag] != NULL) {
+                if (ops->read_node(watcher->nodes[tag]) < 0 || (events[i].events & (EPOLLHUP | EPOLLERR))) {
+                    close_node(watcher, (int)tag);
+                }
+            }
+        }
+    }
+    thread_sched_forget(DEVICE_THREAD_READER);
+    return NULL;
+}
+
+static int watch_fd(NodeWatcher *watcher, int fd, uint64_t tag) {
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.u64 = tag;
+    return epoll_ctl(watcher->epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+}
+
+static void close_fds(NodeWatcher *watcher) {
+    if (watcher->inotify_fd >= 0) {
+        close(watcher->inotify_fd);
+    }
+    if (watcher->wake_fd >= 0) {
+        close(watcher->wake_fd);
+    }
+    if (watcher->epoll_fd >= 0) {
+        close(watcher->epoll_fd);
+    }
+    watcher->epoll_fd = watcher->inotify_fd = watcher->wake_fd = -1;
+}
+
+int node_watcher_start(NodeWatcher* watcher, const NodeWatcherOps* ops) {
+    watcher->ops = ops;
+    watcher->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    watcher->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    watcher->inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (watcher->epoll_fd < 0 || watcher->wake_fd < 0 || watch_fd(watcher, watcher->wake_fd, NODE_WATCHER_TAG_WAKE) < 0) {
+        fprintf(stderr, "Failed to set up the %s reader\n", ops->name);
+        close_fds(watcher);
+        return -1;
+    }
+    // Without inotify only the devices present at start are read
+    if (watcher->inotify_fd >= 0 &&
+        (inotify_add_watch(watcher->inotify_fd, ops->dir, IN_CREATE | IN_ATTRIB) < 0 ||
+         watch_fd(watcher, watcher->inotify_fd, NODE_WATCHER_TAG_INOTIFY) < 0)) {
+        close(watcher->inotify_fd);
+        watcher->inotify_fd = -1;
+    }
+
+    atomic_store(&watcher->running, 1);
+    if (pthread_create(&watcher->thread, NULL, watch_nodes, watcher) != 0) {
+        fprintf(stderr, "Failed to create %s reader thread\n", ops->name);
+        atomic_store(&watcher->running, 0);
+        close_fds(watcher);
+        return -1;
+    }
+    return 0;
+}
+
+void node_watcher_stop(NodeWatcher* watcher) {
+    atomic_store(&watcher->running, 0);
+    uint64_t one = 1;
+    if (watcher->wake_fd >= 0 && write(watcher->wake_fd, &one, sizeof(one)) < 0) {
+        // The counter is already nonzero, the reader wakes up anyway
+    }
+}
+
+// Disconnects every device of the watcher once its thread is gone.
+void node_watcher_join(NodeWatcher* watcher) {
+    pthread_join(watcher->thread, NULL);
+    for (int i = 0; i < NODE_WATCHER_MAX; ++i) {
+        if (watcher->nodes[i] != NULL) {
+            close_node(watcher, i);
+        }
+    }
+    close_fds(watcher);
+}
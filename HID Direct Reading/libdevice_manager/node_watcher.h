@@ -0,0 +1,58 @@
+#ifndef NODE_WATCHER_H
+#define NODE_WATCHER_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+// Reader thread shared by the backends that read device nodes (hidraw,
+// evdev): finds the nodes of a directory by prefix, picks up new ones
+// through inotify and reads all of them from a single epoll loop. The
+// backend only says how to open a node and how to read it.
+
+#define NODE_WATCHER_MAX 256
+#define NODE_WATCHER_EPOLL_BATCH 32
+
+// Start of every backend node; the backend allocates its own struct around it.
+typedef struct {
+    int fd;
+    int slot;
+    char node[32];                  // "hidrawN", "eventN"
+} WatchedNode;
+
+typedef struct {
+    const char* name;               // For messages
+    const char* dir;
+    const char* prefix;
+    // Checks an opened node and registers its device. Returns a calloc'ed node
+    // with the slot set, or NULL if the node is not for this backend.
+    WatchedNode* (*open_node)(int fd, const char* node);
+    // Reads what the node has queued; -1 once the device is gone.
+    int (*read_node)(WatchedNode* node);
+    // epoll timeout in ms before each wait, -1 to wait for input. Optional.
+    int (*timeout)(void);
+} NodeWatcherOps;
+
+typedef struct {
+    const NodeWatcherOps* ops;
+    WatchedNode* nodes[NODE_WATCHER_MAX];
+    int epoll_fd;
+    int inotify_fd;
+    int wake_fd;
+    pthread_t thread;
+    _Atomic int running;
+} NodeWatcher;
+
+int node_watcher_available(const NodeWatcherOps* ops);
+int node_watcher_start(NodeWatcher* watcher, const NodeWatcherOps* ops);
+void node_watcher_stop(NodeWatcher* watcher);
+void node_watcher_join(NodeWatcher* watcher);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // NODE_WATCHER_H
@@ -0,0 +1,201 @@
+// SDL joystick backend. Only built with -DDEVICE_WITH_SDL (and -lSDL2),
+// so the library does not depend on SDL otherwise.
+#ifdef DEVICE_WITH_SDL
+
+#include "device_backend.h"
+#include "device_capture.h"
+#include "device_registry.h"
+#include "thread_sched.h"
+#include <SDL2/SDL.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+
+#define SDL_BACKEND_MAX_DEVICES 64
+
+typedef struct {
+    SDL_Joystick* joystick;     // NULL when the entry is free
+    SDL_JoystickID instance_id;
+    int slot;
+} SdlDevice;
+
+static SdlDevice sdl_devices[SDL_BACKEND_MAX_DEVICES];
+static pthread_t reader_thread;
+static _Atomic int running = 0;
+
+static int sdl_available() {
+    return 1;
+}
+
+static SdlDevice* find_instance(SDL_JoystickID instance_id) {
+    for (int i = 0; i < SDL_BACKEND_MAX_DEVICES; ++i) {
+        if (sdl_devices[i].joystick != NULL && sdl_devices[i].instance_id == instance_id) {
+            return &sdl_devices[i];
+        }
+    }
+    return NULL;
+}
+
+static void open_joystick(int device_index) {
+    SdlDevice *entry = NULL;
+    for (int i = 0; entry == NULL && i < SDL_BACKEND_MAX_DEVICES; ++i) {
+        if (sdl_devices[i].joystick == NULL) {
+            entry = &sdl_devices[i];
+        }
+    }
+    if (entry == NULL) {
+        return;
+    }
+    SDL_Joystick *joystick = SDL_JoystickOpen(device_index);
+    if (joystick == NULL) {
+        fprintf(stderr, "No se pudo abrir el joystick %d: %s\n", device_index, SDL_GetError());
+        return;
+    }
+    if (find_instance(SDL_JoystickInstanceID(joystick)) != NULL ||
+        device_backend_for(SDL_JoystickGetVendor(joystick), SDL_JoystickGetProduct(joystick)) != DEVICE_BACKEND_SDL) {
+        SDL_JoystickClose(joystick);
+        return;
+    }
+
+    Device candidate;
+    memset(&candidate, 0, sizeof(Device));
+    candidate.vendor_id = SDL_JoystickGetVendor(joystick);
+    candidate.product_id = SDL_JoystickGetProduct(joystick);
+    candidate.backend = DEVICE_BACKEND_SDL;
+    candidate.fd = -1;
+    const char *name = SDL_JoystickName(joystick);
+    const char *serial = SDL_JoystickGetSerial(joystick);
+    snprintf(candidate.device_name, sizeof(candidate.device_name), "%s", name != NULL ? name : "Unknown");
+    // SDL has no port path; without a serial, the instance ID keeps keys unique
+    if (serial != NULL && serial[0] != '\0') {
+        snprintf(candidate.key, sizeof(candidate.key), "sdl:%04x:%04x/%.64s", candidate.vendor_id, candidate.product_id, serial);
+    } else {
+        snprintf(candidate.key, sizeof(candidate.key), "sdl:%04x:%04x/#%d", candidate.vendor_id, candidate.product_id,
+                 (int)SDL_JoystickInstanceID(joystick));
+    }
+
+    int slot = backend_add_device(&candidate);
+    if (slot < 0) {
+        SDL_JoystickClose(joystick);
+        return;
+    }
+    entry->joystick = joystick;
+    entry->instance_id = SDL_JoystickInstanceID(joystick);
+    entry->slot = slot;
+}
+
+static void close_joystick(SdlDevice *entry) {
+    SDL_JoystickClose(entry->joystick);
+    entry->joystick = NULL;
+    fprintf(stderr, "Device %d disconnected\n", entry->slot);
+    backend_remove_device(entry->slot);
+}
+
+// Same CaptureSdlInput payload as SDL captures, so replays and live input look alike.
+static void report_input(const SDL_Event *event) {
+    SdlDevice *entry = find_instance(event->jaxis.which);
+    Device *device = entry != NULL ? registry_get(entry->slot) : NULL;
+    if (device == NULL) {
+        return;
+    }
+    CaptureSdlInput input;
+    memset(&input, 0, sizeof(CaptureSdlInput));
+    switch (event->type) {
+        case SDL_JOYAXISMOTION:
+            input.type = CAPTURE_SDL_AXIS;
+            input.index = event->jaxis.axis;
+            input.value = event->jaxis.value;
+            break;
+        case SDL_JOYBUTTONDOWN:
+        case SDL_JOYBUTTONUP:
+            input.type = CAPTURE_SDL_BUTTON;
+            input.index = event->jbutton.button;
+            input.value = event->type == SDL_JOYBUTTONDOWN;
+            break;
+        default:
+            input.type = CAPTURE_SDL_HAT;
+            input.index = event->jhat.hat;
+            input.value = event->jhat.value;
+            break;
+    }
+
+    DeviceRawEvent raw;
+    backend_init_event(&raw, device, DEVICE_EVENT_REPORT);
+    raw.flags = DEVICE_EVENT_SDL;
+    raw.length = sizeof(CaptureSdlInput);
+    memcpy(raw.data, &input, sizeof(CaptureSdlInput));
+    backend_report(device, &raw, raw.length);
+}
+
+static void* read_sdl_events(void* /*arg*/) {
+    thread_sched_apply(DEVICE_THREAD_READER);
+    while (atomic_load(&running)) {
+        SDL_Event event;
+        // sdl_stop() pushes a user event, so the timeout is only a fallback
+        if (!SDL_WaitEventTimeout(&event, 100)) {
+            continue;
+        }
+        do {
+            switch (event.type) {
+                case SDL_JOYAXISMOTION:
+                case SDL_JOYBUTTONDOWN:
+                case SDL_JOYBUTTONUP:
+                case SDL_JOYHATMOTION:
+                    report_input(&event);
+                    break;
+                case SDL_JOYDEVICEADDED:
+                    open_joystick(event.jdevice.which);
+                    break;
+                case SDL_JOYDEVICEREMOVED: {
+                    SdlDevice *entry = find_instance(event.jdevice.which);
+                    if (entry != NULL) {
+                        close_joystick(entry);
+                    }
+                    break;
+                }
+            }
+        } while (atomic_load(&running) && SDL_PollEvent(&event));
+    }
+    for (int i = 0; i < SDL_BACKEND_MAX_DEVICES; ++i) {
+        if (sdl_devices[i].joystick != NULL) {
+            close_joystick(&sdl_devices[i]);
+        }
+    }
+    thread_sched_forget(DEVICE_THREAD_READER);
+    return NULL;
+}
+
+static int sdl_start() {
+    if (SDL_InitSubSystem(SDL_INIT_JOYSTICK) < 0) {
+        fprintf(stderr, "No se pudo inicializar SDL: %s\n", SDL_GetError());
+        return -1;
+    }
+    atomic_store(&running, 1);
+    if (pthread_create(&reader_thread, NULL, read_sdl_events, NULL) != 0) {
+        fprintf(stderr, "Failed to create SDL reader thread\n");
+        atomic_store(&running, 0);
+        SDL_QuitSubSystem(SDL_INIT_JOYSTICK);
+        return -1;
+    }
+    return 0;
+}
+
+static void sdl_stop() {
+    atomic_store(&running, 0);
+    SDL_Event wake;
+    memset(&wake, 0, sizeof(wake));
+    wake.type = SDL_USEREVENT;
+    SDL_PushEvent(&wake);
+}
+
+static void sdl_join() {
+    pthread_join(reader_thread, NULL);
+    SDL_QuitSubSystem(SDL_INIT_JOYSTICK);
+}
+
+const DeviceBackend sdl_backend = {
+    DEVICE_BACKEND_SDL, "SDL", sdl_available, sdl_start, sdl_stop, sdl_join,
+};
+
+#endif // DEVICE_WITH_SDL
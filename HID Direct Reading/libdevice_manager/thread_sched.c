@@ -0,0 +1,215 @@
+#define _GNU_SOURCE
+
+#include "thread_sched.h"
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+
+// Several threads share a role (every backend has a reader, batches, frames
+// and the network sender all deliver), so each role keeps all of them
+#define THREAD_SCHED_MAX_THREADS 16
+
+typedef struct {
+    pthread_t thread;
+    DeviceThreadStatus status;
+} RoleThread;
+
+typedef struct {
+    DeviceThreadConfig config;
+    int configured;
+    RoleThread threads[THREAD_SCHED_MAX_THREADS];
+    int thread_count;
+} ThreadRoleState;
+
+static ThreadRoleState roles[DEVICE_THREAD_ROLES];
+static pthread_mutex_t sched_mutex = PTHREAD_MUTEX_INITIALIZER;
+static int memory_lock_flags = 0;
+
+static const char* role_name(DeviceThreadRole role) {
+    switch (role) {
+        case DEVICE_THREAD_READER: return "reader";
+        case DEVICE_THREAD_MONITOR: return "monitor";
+        default: return "delivery";
+    }
+}
+
+static int set_policy(pthread_t thread, int policy, int priority) {
+    struct sched_param param;
+    memset(&param, 0, sizeof(param));
+    if (policy != SCHED_FIFO && policy != SCHED_RR) {
+        return pthread_setschedparam(thread, policy, &param);
+    }
+    int min = sched_get_priority_min(policy);
+    int max = sched_get_priority_max(policy);
+    param.sched_priority = priority < min ? min : priority > max ? max : priority;
+    int res = pthread_setschedparam(thread, policy, &param);
+    if (res == EPERM) {
+        // Unprivileged processes may still get real-time up to RLIMIT_RTPRIO
+        struct rlimit limit;
+        if (getrlimit(RLIMIT_RTPRIO, &limit) == 0 && limit.rlim_cur > 0) {
+            if ((rlim_t)param.sched_priority > limit.rlim_cur) {
+                param.sched_priority = (int)limit.rlim_cur;
+            }
+            if (pthread_setschedparam(thread, policy, &param) == 0) {
+                return 0;
+            }
+        }
+    }
+    return res;
+}
+
+// Called with sched_mutex held
+static void apply_to(DeviceThreadRole role, RoleThread* entry) {
+    ThreadRoleState *state = &roles[role];
+    DeviceThreadStatus *status = &entry->status;
+    pthread_t thread = entry->thread;
+    status->error = 0;
+
+    if (state->configured) {
+        const DeviceThreadConfig *config = &state->config;
+        if (config->cpu_mask != 0) {
+            cpu_set_t cpus;
+            CPU_ZERO(&cpus);
+            for (int cpu = 0; cpu < 64; cpu++) {
+                if (config->cpu_mask & (1ull << cpu)) {
+                    CPU_SET(cpu, &cpus);
+                }
+            }
+            int res = pthread_setaffinity_np(thread, sizeof(cpu_set_t), &cpus);
+            if (res != 0) {
+                fprintf(stderr, "Could not pin %s thread to CPU mask 0x%llx: %s\n", role_name(role),
+                        (unsigned long long)config->cpu_mask, strerror(res));
+                status->error = res;
+            }
+        }
+        int res = set_policy(thread, config->policy, config->priority);
+        if (res != 0) {
+            fprintf(stderr, "Could not set scheduling policy of %s thread: %s\n", role_name(role), strerror(res));
+            status->error = res;
+        }
+    }
+
+    // Report what the kernel actually gave the thread
+    struct sched_param param;
+    if (pthread_getschedparam(thread, &status->policy, &param) == 0) {
+        status->priority = param.sched_priority;
+    }
+    cpu_set_t cpus;
+    status->cpu_mask = 0;
+    if (pthread_getaffinity_np(thread, sizeof(cpu_set_t), &cpus) == 0) {
+        for (int cpu = 0; cpu < 64; cpu++) {
+            if (CPU_ISSET(cpu, &cpus)) {
+                status->cpu_mask |= 1ull << cpu;
+            }
+        }
+    }
+    status->running = 1;
+}
+
+// Stores the configuration of a role; a running thread of that role picks it up immediately.
+void thread_sched_configure(DeviceThreadRole role, const DeviceThreadConfig* config) {
+    if (role < 0 || role >= DEVICE_THREAD_ROLES) {
+        return;
+    }
+    pthread_mutex_lock(&sched_mutex);
+    ThreadRoleState *state = &roles[role];
+    state->config = *config;
+    state->configured = 1;
+    for (int i = 0; i < state->thread_count; i++) {
+        apply_to(role, &state->threads[i]);
+    }
+    pthread_mutex_unlock(&sched_mutex);
+}
+
+// Called by each thread as it starts.
+void thread_sched_apply(DeviceThreadRole role) {
+    pthread_mutex_lock(&sched_mutex);
+    ThreadRoleState *state = &roles[role];
+    RoleThread self;
+    memset(&self, 0, sizeof(RoleThread));
+    self.thread = pthread_self();
+    RoleThread *entry = &self;
+    if (state->thread_count < THREAD_SCHED_MAX_THREADS) {
+        entry = &state->threads[state->thread_count++];
+        *entry = self;
+    } else {
+        // Still configured, but a later thread_sched_configure() will not reach it
+        fprintf(stderr, "Too many %s threads, the new one is not tracked\n", role_name(role));
+    }
+    apply_to(role, entry);
+    pthread_mutex_unlock(&sched_mutex);
+}
+
+// Called by a thread before it exits, so its pthread_t is not used afterwards.
+void thread_sched_forget(DeviceThreadRole role) {
+    pthread_mutex_lock(&sched_mutex);
+    ThreadRoleState *state = &roles[role];
+    for (int i = 0; i < state->thread_count; i++) {
+        if (pthread_equal(state->threads[i].thread, pthread_self())) {
+            state->threads[i] = state->threads[--state->thread_count];
+            break;
+        }
+    }
+    pthread_mutex_unlock(&sched_mutex);
+}
+
+// Sums up every thread of the role: running is how many there are, the
+// policy and priority are those of the weakest one, cpu_mask is every CPU
+// any of them may use and error the first refusal any of them got.
+void thread_sched_status(DeviceThreadRole role, DeviceThreadStatus* status) {
+    memset(status, 0, sizeof(DeviceThreadStatus));
+    if (role < 0 || role >= DEVICE_THREAD_ROLES) {
+        return;
+    }
+    pthread_mutex_lock(&sched_mutex);
+    ThreadRoleState *state = &roles[role];
+    for (int i = 0; i < state->thread_count; i++) {
+        const DeviceThreadStatus *thread = &state->threads[i].status;
+        int realtime = thread->policy == SCHED_FIFO || thread->policy == SCHED_RR;
+        int weakest = status->policy == SCHED_FIFO || status->policy == SCHED_RR;
+        if (i == 0 || (weakest && (!realtime || thread->priority < status->priority))) {
+            status->policy = thread->policy;
+            status->priority = thread->priority;
+        }
+        status->cpu_mask |= thread->cpu_mask;
+        if (status->error == 0) {
+            status->error = thread->error;
+        }
+    }
+    status->running = state->thread_count;
+    pthread_mutex_unlock(&sched_mutex);
+}
+
+// Locks current and future pages so a page fault never stalls a reader.
+// Falls back to the pages mapped now when RLIMIT_MEMLOCK does not allow
+// future ones. Returns 0 when anything could be locked.
+int thread_sched_lock_memory(int enable) {
+    pthread_mutex_lock(&sched_mutex);
+    int res = 0;
+    if (!enable) {
+        munlockall();
+        memory_lock_flags = 0;
+    } else if (mlockall(MCL_CURRENT | MCL_FUTURE) == 0) {
+        memory_lock_flags = MCL_CURRENT | MCL_FUTURE;
+    } else if (mlockall(MCL_CURRENT) == 0) {
+        fprintf(stderr, "Could not lock future memory, only current pages are locked\n");
+        memory_lock_flags = MCL_CURRENT;
+    } else {
+        fprintf(stderr, "Could not lock memory: %s\n", strerror(errno));
+        res = -1;
+    }
+    pthread_mutex_unlock(&sched_mutex);
+    return res;
+}
+
+// MCL_* flags that are in effect, 0 when memory is not locked.
+int thread_sched_memory_locked() {
+    pthread_mutex_lock(&sched_mutex);
+    int flags = memory_lock_flags;
+    pthread_mutex_unlock(&sched_mutex);
+    return flags;
+}
@@ -0,0 +1,49 @@
+#ifndef THREAD_SCHED_H
+#define THREAD_SCHED_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+// Scheduling of the library's own threads. A configuration is stored per
+// role and applied by each thread when it starts, or right away to every
+// thread of that role that is already running. Nothing here fails hard: when the process lacks
+// the permission for a setting, the closest one it is allowed is used and
+// the status says what the thread really got. Only depends on libc, so the
+// SDL reader uses it too.
+
+typedef enum {
+    DEVICE_THREAD_READER = 0,   // libusb event loop / SDL event reader
+    DEVICE_THREAD_MONITOR,      // Hotplug and discovery
+    DEVICE_THREAD_DELIVERY,     // Batch and frame callbacks, network sender
+    DEVICE_THREAD_ROLES,
+} DeviceThreadRole;
+
+typedef struct {
+    int policy;                 // SCHED_OTHER, SCHED_FIFO or SCHED_RR
+    int priority;               // 1-99 for SCHED_FIFO and SCHED_RR, ignored otherwise
+    uint64_t cpu_mask;          // Bit n allows CPU n; 0 keeps the inherited affinity
+} DeviceThreadConfig;
+
+typedef struct {
+    int running;                // How many threads of this role have applied the configuration
+    int policy;                 // What the weakest of them runs with, read back from the kernel
+    int priority;
+    uint64_t cpu_mask;          // CPUs any of them may run on
+    int error;                  // errno of a setting that was refused, 0 if none
+} DeviceThreadStatus;
+
+void thread_sched_configure(DeviceThreadRole role, const DeviceThreadConfig* config);
+void thread_sched_apply(DeviceThreadRole role);
+void thread_sched_forget(DeviceThreadRole role);
+void thread_sched_status(DeviceThreadRole role, DeviceThreadStatus* status);
+int thread_sched_lock_memory(int enable);
+int thread_sched_memory_locked();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // THREAD_SCHED_H
@@ -23,6 +23,7 @@ class DeviceEvent(ctypes.Structure):
         ("event_type", ctypes.c_char * 32),
         ("type", ctypes.c_char * 32),
         ("value", ctypes.c_char * 256),
+        ("timestamp", ctypes.c_uint),
     ]
 
     def __str__(self):
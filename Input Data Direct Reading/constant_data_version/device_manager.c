@@ -3,13 +3,30 @@
 #include <string.h>
 #include <pthread.h>
 #include <SDL2/SDL.h>
+#include <stdlib.h>
 #include <unistd.h>
+#include <time.h>
 
 void (*send_data)(DeviceEvent event) = NULL;
 
 Device devices[MAX_DEVICES];
 pthread_mutex_t devices_mutex = PTHREAD_MUTEX_INITIALIZER;
 
+typedef struct {
+    int num_axes;
+    int num_buttons;
+    int num_hats;
+    Sint16 axes[MAX_AXES];
+    Uint8 buttons[MAX_BUTTONS];
+    Uint8 hats[MAX_HATS];
+} DeviceState;
+
+static ReportMode report_mode = REPORT_MODE_FULL;
+static int sample_rate_hz = 100;
+static int axis_deadband[MAX_AXES];
+static DeviceState reported[MAX_DEVICES];  // Last state sent to the callback
+static int reported_valid[MAX_DEVICES];
+
 void clean_up_devices() {
     pthread_mutex_lock(&devices_mutex);
     for (int i = 0; i < MAX_DEVICES; ++i) {
@@ -23,60 +40,226 @@ void clean_up_devices() {
     printf("Dispositivos limpiados y SDL cerrada.\n");
 }
 
+static void capture_state(SDL_Joystick* joystick, DeviceState* state) {
+    state->num_axes = SDL_JoystickNumAxes(joystick);
+    state->num_buttons = SDL_JoystickNumButtons(joystick);
+    state->num_hats = SDL_JoystickNumHats(joystick);
+    if (state->num_axes > MAX_AXES) {
+        state->num_axes = MAX_AXES;
+    }
+    if (state->num_buttons > MAX_BUTTONS) {
+        state->num_buttons = MAX_BUTTONS;
+    }
+    if (state->num_hats > MAX_HATS) {
+        state->num_hats = MAX_HATS;
+    }
+
+    for (int j = 0; j < state->num_axes; ++j) {
+        state->axes[j] = SDL_JoystickGetAxis(joystick, j);
+    }
+    for (int j = 0; j < state->num_buttons; ++j) {
+        state->buttons[j] = SDL_JoystickGetButton(joystick, j);
+    }
+    for (int j = 0; j < state->num_hats; ++j) {
+        state->hats[j] = SDL_JoystickGetHat(joystick, j);
+    }
+}
+
+// Opens joysticks that appeared and closes the ones that went away.
+// Must be called with devices_mutex held.
+static void refresh_joysticks() {
+    for (int i = 0; i < MAX_DEVICES; ++i) {
+        if (devices[i].joystick != NULL && !SDL_JoystickGetAttached(devices[i].joystick)) {
+            SDL_JoystickClose(devices[i].joystick);
+            devices[i].joystick = NULL;
+            reported_valid[i] = 0;
+        }
+    }
+
+    for (int index = 0; index < SDL_NumJoysticks(); ++index) {
+        SDL_JoystickID instance_id = SDL_JoystickGetDeviceInstanceID(index);
+        int already_open = 0;
+        for (int i = 0; i < MAX_DEVICES; ++i) {
+            if (devices[i].joystick != NULL && SDL_JoystickInstanceID(devices[i].joystick) == instance_id) {
+                already_open = 1;
+                break;
+            }
+        }
+        if (already_open) {
+            continue;
+        }
+
+        for (int i = 0; i < MAX_DEVICES; ++i) {
+            if (devices[i].joystick == NULL) {
+                SDL_Joystick* joystick = SDL_JoystickOpen(index);
+                if (joystick == NULL) {
+                    fprintf(stderr, "No se pudo abrir el joystick %d: %s\n", index, SDL_GetError());
+                    break;
+                }
+                const char* device_name = SDL_JoystickName(joystick);
+                snprintf(devices[i].device_name, sizeof(devices[i].device_name), "%s", device_name != NULL ? device_name : "Unknown");
+                devices[i].device_index = i;
+                devices[i].joystick = joystick;
+                devices[i].vendor_id = SDL_JoystickGetVendor(joystick);
+                devices[i].product_id = SDL_JoystickGetProduct(joystick);
+                reported_valid[i] = 0;
+                break;
+            }
+        }
+    }
+}
+
+static void init_event(DeviceEvent* device_event, const Device* device) {
+    memset(device_event, 0, sizeof(DeviceEvent));
+    device_event->device_id = device->device_index;
+    device_event->vendor_id = device->vendor_id;
+    device_event->product_id = device->product_id;
+    snprintf(device_event->serial_number, sizeof(device_event->serial_number), "%.63s", device->device_name);
+}
+
+static void send_value(const Device* device, const char* name, int index, int value) {
+    DeviceEvent device_event;
+    init_event(&device_event, device);
+    snprintf(device_event.event_type, sizeof(device_event.event_type), "%s %d", name, index);
+    snprintf(device_event.value, sizeof(device_event.value), "%d", value);
+    send_data(device_event);
+}
+
+// Packs the whole state as "a:<axes>;b:<buttons>;h:<hats>" in a single event.
+static void send_frame(const Device* device, const DeviceState* state) {
+    DeviceEvent device_event;
+    init_event(&device_event, device);
+    snprintf(device_event.event_type, sizeof(device_event.event_type), "Frame");
+    snprintf(device_event.type, sizeof(device_event.type), "State");
+
+    char* out = device_event.value;
+    size_t size = sizeof(device_event.value);
+    int pos = snprintf(out, size, "a:");
+    for (int j = 0; j < state->num_axes && (size_t)pos < size; ++j) {
+        pos += snprintf(out + pos, size - (size_t)pos, j ? ",%d" : "%d", state->axes[j]);
+    }
+    if ((size_t)pos < size) {
+        pos += snprintf(out + pos, size - (size_t)pos, ";b:");
+    }
+    for (int j = 0; j < state->num_buttons && (size_t)pos + 1 < size; ++j) {
+        out[pos++] = state->buttons[j] ? '1' : '0';
+        out[pos] = '\0';
+    }
+    if ((size_t)pos < size) {
+        pos += snprintf(out + pos, size - (size_t)pos, ";h:");
+    }
+    for (int j = 0; j < state->num_hats && (size_t)pos < size; ++j) {
+        pos += snprintf(out + pos, size - (size_t)pos, j ? ",%d" : "%d", state->hats[j]);
+    }
+    send_data(device_event);
+}
+
+// Compares the current state with the last reported one. Axes only count as
+// changed when they move further than their deadband; the reported value is
+// only advanced when a change is emitted, so slow drifts are not lost.
+static int emit_changes(const Device* device, const DeviceState* current, DeviceState* reported, int valid, int send) {
+    int changed = !valid ||
+                  current->num_axes != reported->num_axes ||
+                  current->num_buttons != reported->num_buttons ||
+                  current->num_hats != reported->num_hats;
+
+    for (int j = 0; j < current->num_axes; ++j) {
+        int delta = abs(current->axes[j] - reported->axes[j]);
+        if (changed || delta > axis_deadband[j]) {
+            if (send) {
+                send_value(device, "Axis", j, current->axes[j]);
+            }
+            reported->axes[j] = current->axes[j];
+            changed = 1;
+        }
+    }
+    for (int j = 0; j < current->num_buttons; ++j) {
+        if (!valid || current->buttons[j] != reported->buttons[j]) {
+            if (send) {
+                send_value(device, "Button", j, current->buttons[j]);
+            }
+            reported->buttons[j] = current->buttons[j];
+            changed = 1;
+        }
+    }
+    for (int j = 0; j < current->num_hats; ++j) {
+        if (!valid || current->hats[j] != reported->hats[j]) {
+            if (send) {
+                send_value(device, "Hat", j, current->hats[j]);
+            }
+            reported->hats[j] = current->hats[j];
+            changed = 1;
+        }
+    }
+    reported->num_axes = current->num_axes;
+    reported->num_buttons = current->num_buttons;
+    reported->num_hats = current->num_hats;
+    return changed;
+}
+
 void* read_device_data(void* /*arg*/) {
     printf("Hilo de lectura de datos de dispositivo iniciado.\n");
+    Device snapshot[MAX_DEVICES];
+    DeviceState current[MAX_DEVICES];
+    struct timespec next_tick;
+    clock_gettime(CLOCK_MONOTONIC, &next_tick);
+
     while (1) {
+        // Only the snapshot is taken under the lock, callbacks run without it
         pthread_mutex_lock(&devices_mutex);
+        SDL_JoystickUpdate();
+        refresh_joysticks();
         for (int i = 0; i < MAX_DEVICES; ++i) {
+            snapshot[i] = devices[i];
             if (devices[i].joystick != NULL) {
-                for (int j = 0; j < SDL_JoystickNumAxes(devices[i].joystick); ++j) {
-                    DeviceEvent device_event;
-                    memset(&device_event, 0, sizeof(DeviceEvent));
-                    device_event.device_id = devices[i].device_index;
-                    device_event.vendor_id = devices[i].vendor_id;
-                    device_event.product_id = devices[i].product_id;
-                    snprintf(device_event.serial_number, sizeof(device_event.serial_number), "%s", devices[i].device_name);
-                    snprintf(device_event.event_type, sizeof(device_event.event_type), "Axis %d", j);
-                    snprintf(device_event.value, sizeof(device_event.value), "%d", SDL_JoystickGetAxis(devices[i].joystick, j));
-
-                    if (send_data) {
-                        send_data(device_event);
-                    }
-                }
+                capture_state(devices[i].joystick, &current[i]);
+            }
+        }
+        pthread_mutex_unlock(&devices_mutex);
 
-                for (int j = 0; j < SDL_JoystickNumButtons(devices[i].joystick); ++j) {
-                    DeviceEvent device_event;
-                    memset(&device_event, 0, sizeof(DeviceEvent));
-                    device_event.device_id = devices[i].device_index;
-                    device_event.vendor_id = devices[i].vendor_id;
-                    device_event.product_id = devices[i].product_id;
-                    snprintf(device_event.serial_number, sizeof(device_event.serial_number), "%s", devices[i].device_name);
-                    snprintf(device_event.event_type, sizeof(device_event.event_type), "Button %d", j);
-                    snprintf(device_event.value, sizeof(device_event.value), "%d", SDL_JoystickGetButton(devices[i].joystick, j));
-
-                    if (send_data) {
-                        send_data(device_event);
+        for (int i = 0; i < MAX_DEVICES && send_data; ++i) {
+            if (snapshot[i].joystick == NULL) {
+                continue;
+            }
+            switch (report_mode) {
+                case REPORT_MODE_FULL:
+                    for (int j = 0; j < current[i].num_axes; ++j) {
+                        send_value(&snapshot[i], "Axis", j, current[i].axes[j]);
                     }
-                }
-
-                for (int j = 0; j < SDL_JoystickNumHats(devices[i].joystick); ++j) {
-                    DeviceEvent device_event;
-                    memset(&device_event, 0, sizeof(DeviceEvent));
-                    device_event.device_id = devices[i].device_index;
-                    device_event.vendor_id = devices[i].vendor_id;
-                    device_event.product_id = devices[i].product_id;
-                    snprintf(device_event.serial_number, sizeof(device_event.serial_number), "%s", devices[i].device_name);
-                    snprintf(device_event.event_type, sizeof(device_event.event_type), "Hat %d", j);
-                    snprintf(device_event.value, sizeof(device_event.value), "%d", SDL_JoystickGetHat(devices[i].joystick, j));
-
-                    if (send_data) {
-                        send_data(device_event);
+                    for (int j = 0; j < current[i].num_buttons; ++j) {
+                        send_value(&snapshot[i], "Button", j, current[i].buttons[j]);
                     }
-                }
+                    for (int j = 0; j < current[i].num_hats; ++j) {
+                        send_value(&snapshot[i], "Hat", j, current[i].hats[j]);
+                    }
+                    break;
+                case REPORT_MODE_CHANGES:
+                    emit_changes(&snapshot[i], &current[i], &reported[i], reported_valid[i], 1);
+                    reported_valid[i] = 1;
+                    break;
+                case REPORT_MODE_FRAME:
+                    if (emit_changes(&snapshot[i], &current[i], &reported[i], reported_valid[i], 0)) {
+                        send_frame(&snapshot[i], &current[i]);
+                    }
+                    reported_valid[i] = 1;
+                    break;
             }
         }
-        pthread_mutex_unlock(&devices_mutex);
-        usleep(10000);  // 10ms
+
+        // Absolute deadlines keep the sample rate free of drift
+        long interval_ns = 1000000000L / sample_rate_hz;
+        next_tick.tv_nsec += interval_ns;
+        while (next_tick.tv_nsec >= 1000000000L) {
+            next_tick.tv_nsec -= 1000000000L;
+            next_tick.tv_sec++;
+        }
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if (now.tv_sec > next_tick.tv_sec || (now.tv_sec == next_tick.tv_sec && now.tv_nsec > next_tick.tv_nsec)) {
+            next_tick = now;  // Fell behind, do not try to catch up
+        } else {
+            clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next_tick, NULL);
+        }
     }
     return NULL;
 }
@@ -110,6 +293,25 @@ void detect_devices(void (*send_data_func)(DeviceEvent)) {
     printf("Hilo de detección de dispositivos iniciado.\n");
 }
 
+void set_report_mode(ReportMode mode) {
+    report_mode = mode;
+}
+
+void set_sample_rate(int hz) {
+    if (hz > 0) {
+        sample_rate_hz = hz;
+    }
+}
+
+// Minimum movement before an axis counts as changed. axis < 0 sets every axis.
+void set_axis_deadband(int axis, int deadband) {
+    for (int j = 0; j < MAX_AXES; ++j) {
+        if (axis < 0 || axis == j) {
+            axis_deadband[j] = deadband;
+        }
+    }
+}
+
 const Device* get_device(int index) {
     if (index < 0 || index >= MAX_DEVICES) {
         return NULL;
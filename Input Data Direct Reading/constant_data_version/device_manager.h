@@ -9,6 +9,9 @@ extern "C" {
 #include <pthread.h>
 
 #define MAX_DEVICES 6
+#define MAX_AXES 16
+#define MAX_BUTTONS 64
+#define MAX_HATS 8
 
 typedef struct {
     int device_index;
@@ -28,12 +31,21 @@ typedef struct {
     char value[256];
 } DeviceEvent;
 
+typedef enum {
+    REPORT_MODE_FULL = 0,   // Every axis, button and hat on every tick
+    REPORT_MODE_CHANGES,    // Only the values that changed since the last tick
+    REPORT_MODE_FRAME,      // One packed "Frame" event per device when anything changed
+} ReportMode;
+
 extern Device devices[MAX_DEVICES];
 extern pthread_mutex_t devices_mutex;
 
 void clean_up_devices();
 void* read_device_data(void* arg);
 void detect_devices(void (*send_data_func)(DeviceEvent));
+void set_report_mode(ReportMode mode);
+void set_sample_rate(int hz);
+void set_axis_deadband(int axis, int deadband);
 const Device* get_device(int index);
 int get_device_count();
 
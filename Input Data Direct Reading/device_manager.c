@@ -1,16 +1,78 @@
 #include "device_manager.h"
+#include "device_capture.h"
 #include <stdio.h>
 #include <string.h>
 #include <pthread.h>
+#include <stdatomic.h>
 #include <SDL2/SDL.h>
 #include <unistd.h>
+#include <time.h>
+#include <math.h>
 
 void (*send_data)(DeviceEvent event) = NULL;
 
 Device devices[MAX_DEVICES];
 pthread_mutex_t devices_mutex = PTHREAD_MUTEX_INITIALIZER;
 
+#define INSTANCE_TABLE_SIZE 16  // Power of two, at least twice MAX_DEVICES
+
+typedef struct {
+    SDL_JoystickID instance_id;
+    int slot;                   // -1 when the entry is empty
+} InstanceEntry;
+
+static InstanceEntry instance_table[INSTANCE_TABLE_SIZE];
+static char event_names[MAX_DEVICES][64];  // device_name as DeviceEvent.serial_number, formatted on connect
+static ReaderMode reader_mode = READER_MODE_POLL;
+static pthread_mutex_t capture_mutex = PTHREAD_MUTEX_INITIALIZER;
+static CaptureWriter capture_writer;
+static int capture_enabled = 0;
+static uint32_t capture_sequence = 0;
+// Axis filters per slot, used with devices_mutex held. The reader thread
+// runs them on SDL_JOYAXISMOTION and flushes them while the stick is idle.
+static AxisFilterBank axis_filters[MAX_DEVICES];
+static int axis_filtered[MAX_DEVICES];
+static AxisFilterConfig default_filters[AXIS_FILTER_MAX];
+static int default_filters_set = 0;
+static pthread_mutex_t lifecycle_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t lifecycle_cond = PTHREAD_COND_INITIALIZER;
+static pthread_t reader_thread;
+static int reader_started = 0;          // Reader thread created and not joined yet
+static int reader_joining = 0;          // join_detection() waits for it without the mutex
+static _Atomic int reader_running = 0;  // Cleared by stop_detection()
+
+static uint64_t monotonic_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+// Same record format as the HID library, so its replay backend can play SDL captures back.
+static void capture_event(const DeviceEvent* device_event, CaptureKind kind, const CaptureSdlInput* input) {
+    CaptureRecord record;
+    memset(&record, 0, sizeof(CaptureRecord));
+    record.timestamp_ns = monotonic_ns();
+    record.device_id = device_event->device_id;
+    record.vendor_id = (uint16_t)device_event->vendor_id;
+    record.product_id = (uint16_t)device_event->product_id;
+    record.kind = (uint8_t)kind;
+    record.source = CAPTURE_SOURCE_SDL;
+    if (kind == CAPTURE_KIND_REPORT) {
+        record.length = sizeof(CaptureSdlInput);
+        memcpy(record.data, input, sizeof(CaptureSdlInput));
+    }
+
+    pthread_mutex_lock(&capture_mutex);
+    if (capture_enabled) {
+        record.sequence = capture_sequence++;
+        capture_writer_append(&capture_writer, &record);
+    }
+    pthread_mutex_unlock(&capture_mutex);
+}
+
 void clean_up_devices() {
+    stop_detection();
+    join_detection();
     pthread_mutex_lock(&devices_mutex);
     for (int i = 0; i < MAX_DEVICES; ++i) {
         if (devices[i].joystick != NULL) {
@@ -18,129 +80,299 @@ void clean_up_devices() {
             devices[i].joystick = NULL;
         }
     }
+    for (int i = 0; i < INSTANCE_TABLE_SIZE; ++i) {
+        instance_table[i].slot = -1;
+    }
     pthread_mutex_unlock(&devices_mutex);
     SDL_Quit();
     printf("Dispositivos limpiados y SDL cerrada.\n");
 }
 
+static int instance_hash(SDL_JoystickID instance_id) {
+    return (int)(((Uint32)instance_id * 2654435761u) & (INSTANCE_TABLE_SIZE - 1));
+}
+
+// Returns the slot of an open joystick, or -1. Must be called with devices_mutex held.
+static int find_instance_slot(SDL_JoystickID instance_id) {
+    for (int i = 0, pos = instance_hash(instance_id); i < INSTANCE_TABLE_SIZE; ++i, pos = (pos + 1) & (INSTANCE_TABLE_SIZE - 1)) {
+        if (instance_table[pos].slot < 0) {
+            return -1;
+        }
+        if (instance_table[pos].instance_id == instance_id) {
+            return instance_table[pos].slot;
+        }
+    }
+    return -1;
+}
+
+static void insert_instance_slot(SDL_JoystickID instance_id, int slot) {
+    int pos = instance_hash(instance_id);
+    while (instance_table[pos].slot >= 0) {
+        pos = (pos + 1) & (INSTANCE_TABLE_SIZE - 1);
+    }
+    instance_table[pos].instance_id = instance_id;
+    instance_table[pos].slot = slot;
+}
+
+// Linear probing removal: reinsert the rest of the cluster so lookups never stop early.
+static void remove_instance_slot(SDL_JoystickID instance_id) {
+    int pos = instance_hash(instance_id);
+    for (int i = 0; i < INSTANCE_TABLE_SIZE && instance_table[pos].slot >= 0; ++i) {
+        if (instance_table[pos].instance_id == instance_id) {
+            instance_table[pos].slot = -1;
+            pos = (pos + 1) & (INSTANCE_TABLE_SIZE - 1);
+            while (instance_table[pos].slot >= 0) {
+                InstanceEntry entry = instance_table[pos];
+                instance_table[pos].slot = -1;
+                insert_instance_slot(entry.instance_id, entry.slot);
+                pos = (pos + 1) & (INSTANCE_TABLE_SIZE - 1);
+            }
+            return;
+        }
+        pos = (pos + 1) & (INSTANCE_TABLE_SIZE - 1);
+    }
+}
+
+typedef struct {
+    int axis;
+    int value;
+} FilteredAxis;
+
+// Axes whose filtered value moved in the last run of the bank of slot i.
+static int filtered_axes(int i, FilteredAxis* out) {
+    AxisFilterBank* bank = &axis_filters[i];
+    int count = 0;
+    for (int axis = 0; axis < bank->count; ++axis) {
+        if (bank->changed[axis]) {
+            out[count].axis = axis;
+            out[count].value = (int)lrintf(fmaxf(bank->reported[axis] * 32767.0f, -32768.0f));
+            count++;
+        }
+    }
+    return count;
+}
+
+static void send_axis_events(DeviceEvent* device_event, const FilteredAxis* axes, int count) {
+    for (int j = 0; j < count; ++j) {
+        CaptureSdlInput input;
+        memset(&input, 0, sizeof(CaptureSdlInput));
+        snprintf(device_event->event_type, sizeof(device_event->event_type), "Axis %d", axes[j].axis);
+        snprintf(device_event->value, sizeof(device_event->value), "%d", axes[j].value);
+        input.type = CAPTURE_SDL_AXIS;
+        input.index = (uint8_t)axes[j].axis;
+        input.value = axes[j].value;
+        if (capture_enabled) {
+            capture_event(device_event, CAPTURE_KIND_REPORT, &input);
+        }
+        if (send_data) {
+            send_data(*device_event);
+        }
+    }
+}
+
+// Lets the filters of idle sticks catch up with their last position.
+// Returns the milliseconds until the next flush is due, -1 if none is.
+static int flush_axis_filters() {
+    uint64_t now = monotonic_ns();
+    uint64_t next = 0;
+    for (int i = 0; i < MAX_DEVICES; ++i) {
+        DeviceEvent device_event;
+        memset(&device_event, 0, sizeof(DeviceEvent));
+        FilteredAxis axes[AXIS_FILTER_MAX];
+        int count = 0;
+        pthread_mutex_lock(&devices_mutex);
+        uint64_t due = devices[i].joystick != NULL && axis_filtered[i] ? axis_filter_due(&axis_filters[i]) : 0;
+        if (due != 0 && due <= now && axis_filter_flush(&axis_filters[i], now) > 0) {
+            count = filtered_axes(i, axes);
+            device_event.timestamp = SDL_GetTicks();
+            device_event.device_id = devices[i].device_index;
+            device_event.vendor_id = devices[i].vendor_id;
+            device_event.product_id = devices[i].product_id;
+            memcpy(device_event.serial_number, event_names[i], sizeof(device_event.serial_number));
+        }
+        due = due != 0 ? axis_filter_due(&axis_filters[i]) : 0;
+        pthread_mutex_unlock(&devices_mutex);
+
+        send_axis_events(&device_event, axes, count);
+        next = due != 0 && (next == 0 || due < next) ? due : next;
+    }
+    if (next == 0) {
+        return -1;
+    }
+    return next > now ? (int)((next - now + 999999) / 1000000) : 0;
+}
+
+static void handle_event(const SDL_Event* event) {
+    DeviceEvent device_event;
+    memset(&device_event, 0, sizeof(DeviceEvent));
+    device_event.timestamp = event->common.timestamp;
+    int send = 0;
+    CaptureKind kind = CAPTURE_KIND_REPORT;
+    CaptureSdlInput input;
+    memset(&input, 0, sizeof(CaptureSdlInput));
+    FilteredAxis axes[AXIS_FILTER_MAX];
+    int filtered = -1;  // Axis events let through by the filters, -1 when not filtered
+
+    if (event->type == SDL_JOYAXISMOTION || event->type == SDL_JOYBUTTONDOWN || event->type == SDL_JOYBUTTONUP || event->type == SDL_JOYHATMOTION) {
+        pthread_mutex_lock(&devices_mutex);
+        int i = find_instance_slot(event->jaxis.which);
+        if (i >= 0) {
+            device_event.device_id = devices[i].device_index;
+            device_event.vendor_id = devices[i].vendor_id;
+            device_event.product_id = devices[i].product_id;
+            memcpy(device_event.serial_number, event_names[i], sizeof(device_event.serial_number));
+            send = 1;
+            if (event->type == SDL_JOYAXISMOTION && axis_filtered[i] && event->jaxis.axis < axis_filters[i].count) {
+                axis_filters[i].input[event->jaxis.axis] = fmaxf((float)event->jaxis.value / 32767.0f, -1.0f);
+                axis_filter_process(&axis_filters[i], monotonic_ns());
+                filtered = filtered_axes(i, axes);
+            }
+        }
+        pthread_mutex_unlock(&devices_mutex);
+
+        switch (event->type) {
+            case SDL_JOYAXISMOTION:
+                snprintf(device_event.event_type, sizeof(device_event.event_type), "Axis %d", event->jaxis.axis);
+                snprintf(device_event.value, sizeof(device_event.value), "%d", event->jaxis.value);
+                input.type = CAPTURE_SDL_AXIS;
+                input.index = event->jaxis.axis;
+                input.value = event->jaxis.value;
+                break;
+            case SDL_JOYBUTTONDOWN:
+                snprintf(device_event.event_type, sizeof(device_event.event_type), "Button %d Down", event->jbutton.button);
+                snprintf(device_event.value, sizeof(device_event.value), "Down");
+                input.type = CAPTURE_SDL_BUTTON;
+                input.index = event->jbutton.button;
+                input.value = 1;
+                break;
+            case SDL_JOYBUTTONUP:
+                snprintf(device_event.event_type, sizeof(device_event.event_type), "Button %d Up", event->jbutton.button);
+                snprintf(device_event.value, sizeof(device_event.value), "Up");
+                input.type = CAPTURE_SDL_BUTTON;
+                input.index = event->jbutton.button;
+                input.value = 0;
+                break;
+            case SDL_JOYHATMOTION:
+                snprintf(device_event.event_type, sizeof(device_event.event_type), "Hat %d", event->jhat.hat);
+                snprintf(device_event.value, sizeof(device_event.value), "%d", event->jhat.value);
+                input.type = CAPTURE_SDL_HAT;
+                input.index = event->jhat.hat;
+                input.value = event->jhat.value;
+                break;
+        }
+    } else if (event->type == SDL_JOYDEVICEADDED) {
+        pthread_mutex_lock(&devices_mutex);
+        int device_index = event->jdevice.which;
+        const char* device_name = SDL_JoystickNameForIndex(device_index);
+        SDL_Joystick* joystick = SDL_JoystickOpen(device_index);
+        if (joystick != NULL) {
+            int instance_id = SDL_JoystickInstanceID(joystick);
+            int vendor_id = SDL_JoystickGetVendor(joystick);
+            int product_id = SDL_JoystickGetProduct(joystick);
+
+            for (int i = 0; i < MAX_DEVICES; ++i) {
+                if (devices[i].joystick == NULL) {
+                    strncpy(devices[i].device_name, device_name != NULL ? device_name : "Unknown", sizeof(devices[i].device_name) - 1);
+                    devices[i].device_index = i;
+                    devices[i].joystick = joystick;
+                    devices[i].vendor_id = vendor_id;
+                    devices[i].product_id = product_id;
+                    insert_instance_slot(instance_id, i);
+                    axis_filtered[i] = default_filters_set;
+                    axis_filter_init(&axis_filters[i], SDL_JoystickNumAxes(joystick));
+                    for (int axis = 0; axis < axis_filters[i].count; ++axis) {
+                        axis_filter_configure(&axis_filters[i], axis, &default_filters[axis]);
+                    }
+                    memset(event_names[i], 0, sizeof(event_names[i]));
+                    snprintf(event_names[i], sizeof(event_names[i]), "%s", devices[i].device_name);
+
+                    device_event.device_id = i;
+                    device_event.vendor_id = vendor_id;
+                    device_event.product_id = product_id;
+                    memcpy(device_event.serial_number, event_names[i], sizeof(device_event.serial_number));
+                    snprintf(device_event.event_type, sizeof(device_event.event_type), "connected");
+                    snprintf(device_event.type, sizeof(device_event.type), "Connection");
+                    snprintf(device_event.value, sizeof(device_event.value), "%s", devices[i].device_name);
+                    kind = CAPTURE_KIND_CONNECTED;
+                    send = 1;
+                    break;
+                }
+            }
+        } else {
+            fprintf(stderr, "No se pudo abrir el joystick %d: %s\n", device_index, SDL_GetError());
+        }
+        pthread_mutex_unlock(&devices_mutex);
+    } else if (event->type == SDL_JOYDEVICEREMOVED) {
+        pthread_mutex_lock(&devices_mutex);
+        int instance_id = event->jdevice.which;
+        int i = find_instance_slot(instance_id);
+        if (i >= 0) {
+            SDL_JoystickClose(devices[i].joystick);
+            devices[i].joystick = NULL;
+            remove_instance_slot(instance_id);
+            snprintf(device_event.event_type, sizeof(device_event.event_type), "disconnected");
+            device_event.device_id = devices[i].device_index;
+            device_event.vendor_id = devices[i].vendor_id;
+            device_event.product_id = devices[i].product_id;
+            memcpy(device_event.serial_number, event_names[i], sizeof(device_event.serial_number));
+            snprintf(device_event.type, sizeof(device_event.type), "Disconnection");
+            snprintf(device_event.value, sizeof(device_event.value), "%s", devices[i].device_name);
+            kind = CAPTURE_KIND_DISCONNECTED;
+            send = 1;
+        }
+        pthread_mutex_unlock(&devices_mutex);
+    }
+
+    if (send && filtered >= 0) {
+        send_axis_events(&device_event, axes, filtered);
+        return;
+    }
+    if (send && capture_enabled) {
+        capture_event(&device_event, kind, &input);
+    }
+
+    // The callback runs without devices_mutex so a slow consumer cannot block the table
+    if (send && send_data) {
+        send_data(device_event);
+    }
+}
+
 void* read_device_data(void* /*arg*/) {
     printf("Hilo de lectura de datos de dispositivo iniciado.\n");
-    while (1) {
+    thread_sched_apply(DEVICE_THREAD_READER);
+    while (atomic_load(&reader_running)) {
         SDL_Event event;
-        while (SDL_PollEvent(&event)) {
-            pthread_testcancel(); // Verificar si se solicitó la cancelación del hilo
-            DeviceEvent device_event;
-            memset(&device_event, 0, sizeof(DeviceEvent));
-
-            if (event.type == SDL_JOYAXISMOTION || event.type == SDL_JOYBUTTONDOWN || event.type == SDL_JOYBUTTONUP || event.type == SDL_JOYHATMOTION) {
-                pthread_mutex_lock(&devices_mutex);
-                int instance_id = event.jaxis.which;
-                for (int i = 0; i < MAX_DEVICES; ++i) {
-                    if (devices[i].joystick != NULL && SDL_JoystickInstanceID(devices[i].joystick) == instance_id) {
-                        device_event.device_id = devices[i].device_index;
-                        device_event.vendor_id = devices[i].vendor_id;
-                        device_event.product_id = devices[i].product_id;
-                        snprintf(device_event.serial_number, sizeof(device_event.serial_number), "%s", devices[i].device_name);
-
-                        switch (event.type) {
-                            case SDL_JOYAXISMOTION:
-                                snprintf(device_event.event_type, sizeof(device_event.event_type), "Axis %d", event.jaxis.axis);
-                                snprintf(device_event.value, sizeof(device_event.value), "%d", event.jaxis.value);
-                                break;
-                            case SDL_JOYBUTTONDOWN:
-                                snprintf(device_event.event_type, sizeof(device_event.event_type), "Button %d Down", event.jbutton.button);
-                                snprintf(device_event.value, sizeof(device_event.value), "Down");
-                                break;
-                            case SDL_JOYBUTTONUP:
-                                snprintf(device_event.event_type, sizeof(device_event.event_type), "Button %d Up", event.jbutton.button);
-                                snprintf(device_event.value, sizeof(device_event.value), "Up");
-                                break;
-                            case SDL_JOYHATMOTION:
-                                snprintf(device_event.event_type, sizeof(device_event.event_type), "Hat %d", event.jhat.hat);
-                                snprintf(device_event.value, sizeof(device_event.value), "%d", event.jhat.value);
-                                break;
-                        }
-
-                        if (send_data) {
-                            send_data(device_event);
-                        }
-                        break;
-                    }
-                }
-                pthread_mutex_unlock(&devices_mutex);
-            } else if (event.type == SDL_JOYDEVICEADDED) {
-                pthread_mutex_lock(&devices_mutex);
-                int device_index = event.jdevice.which;
-                const char* device_name = SDL_JoystickNameForIndex(device_index);
-                SDL_Joystick* joystick = SDL_JoystickOpen(device_index);
-                if (joystick != NULL) {
-                    int instance_id = SDL_JoystickInstanceID(joystick);
-                    int vendor_id = SDL_JoystickGetVendor(joystick);
-                    int product_id = SDL_JoystickGetProduct(joystick);
-
-                    for (int i = 0; i < MAX_DEVICES; ++i) {
-                        if (devices[i].joystick == NULL) {
-                            strncpy(devices[i].device_name, device_name != NULL ? device_name : "Unknown", sizeof(devices[i].device_name) - 1);
-                            devices[i].device_index = i;
-                            devices[i].joystick = joystick;
-                            devices[i].vendor_id = vendor_id;
-                            devices[i].product_id = product_id;
-
-                            DeviceEvent connect_event;
-                            memset(&connect_event, 0, sizeof(DeviceEvent));
-                            connect_event.device_id = i;
-                            connect_event.vendor_id = vendor_id;
-                            connect_event.product_id = product_id;
-                            snprintf(connect_event.serial_number, sizeof(connect_event.serial_number), "%s", devices[i].device_name);
-                            snprintf(connect_event.event_type, sizeof(connect_event.event_type), "connected");
-                            snprintf(connect_event.type, sizeof(connect_event.type), "Connection");
-                            snprintf(connect_event.value, sizeof(connect_event.value), "%s", devices[i].device_name);
-                            if (send_data) {
-                                send_data(connect_event);
-                            }
-
-                            break;
-                        }
-                    }
-                } else {
-                    fprintf(stderr, "No se pudo abrir el joystick %d: %s\n", device_index, SDL_GetError());
-                }
-                pthread_mutex_unlock(&devices_mutex);
-            } else if (event.type == SDL_JOYDEVICEREMOVED) {
-                pthread_mutex_lock(&devices_mutex);
-                int instance_id = event.jdevice.which;
-                for (int i = 0; i < MAX_DEVICES; ++i) {
-                    if (devices[i].joystick != NULL && SDL_JoystickInstanceID(devices[i].joystick) == instance_id) {
-                        SDL_JoystickClose(devices[i].joystick);
-                        devices[i].joystick = NULL;
-                        DeviceEvent disconnect_event;
-                        memset(&disconnect_event, 0, sizeof(DeviceEvent));
-                        snprintf(disconnect_event.event_type, sizeof(disconnect_event.event_type), "disconnected");
-                        disconnect_event.device_id = devices[i].device_index;
-                        disconnect_event.vendor_id = devices[i].vendor_id;
-                        disconnect_event.product_id = devices[i].product_id;
-                        snprintf(disconnect_event.serial_number, sizeof(disconnect_event.serial_number), "%s", devices[i].device_name);
-                        snprintf(disconnect_event.type, sizeof(disconnect_event.type), "Disconnection");
-                        snprintf(disconnect_event.value, sizeof(disconnect_event.value), "%s", devices[i].device_name);
-                        if (send_data) {
-                            send_data(disconnect_event);
-                        }
-                        break;
-                    }
-                }
-                pthread_mutex_unlock(&devices_mutex);
+        int flush_ms = flush_axis_filters();
+        if (reader_mode == READER_MODE_WAIT) {
+            // Sleeps until SDL queues an event; stop_detection() pushes one to wake it
+            if (SDL_WaitEventTimeout(&event, flush_ms >= 0 && flush_ms < 100 ? flush_ms : 100)) {
+                handle_event(&event);
             }
         }
-        usleep(10000);  // 10ms
+        while (atomic_load(&reader_running) && SDL_PollEvent(&event)) {
+            handle_event(&event);
+        }
+        if (reader_mode == READER_MODE_POLL && atomic_load(&reader_running)) {
+            usleep(10000);  // 10ms
+        }
     }
+    thread_sched_forget(DEVICE_THREAD_READER);
     return NULL;
 }
 
+// Calling it again while the reader runs only replaces the callback.
 void detect_devices(void (*send_data_func)(DeviceEvent)) {
     send_data = send_data_func;
 
+    pthread_mutex_lock(&lifecycle_mutex);
+    if (reader_started) {
+        pthread_mutex_unlock(&lifecycle_mutex);
+        return;
+    }
+
     if (SDL_Init(SDL_INIT_JOYSTICK) < 0) {
         fprintf(stderr, "No se pudo inicializar SDL: %s\n", SDL_GetError());
+        pthread_mutex_unlock(&lifecycle_mutex);
         return;
     }
 
@@ -154,17 +386,161 @@ void detect_devices(void (*send_data_func)(DeviceEvent)) {
         devices[i].vendor_id = 0;
         devices[i].product_id = 0;
     }
+    for (int i = 0; i < INSTANCE_TABLE_SIZE; ++i) {
+        instance_table[i].slot = -1;
+    }
 
-    pthread_t device_thread;
-    if (pthread_create(&device_thread, NULL, read_device_data, NULL) != 0) {
+    atomic_store(&reader_running, 1);
+    if (pthread_create(&reader_thread, NULL, read_device_data, NULL) != 0) {
         fprintf(stderr, "No se pudo crear el hilo de lectura de datos de dispositivo.\n");
+        atomic_store(&reader_running, 0);
+        SDL_Quit();
+        pthread_mutex_unlock(&lifecycle_mutex);
         return;
     }
-    pthread_detach(device_thread); // Detach thread to allow resources to be freed upon completion
+    reader_started = 1;
+    pthread_mutex_unlock(&lifecycle_mutex);
 
     printf("Hilo de detección de dispositivos iniciado.\n");
 }
 
+// Called with lifecycle_mutex held
+static void stop_reader() {
+    if (reader_started && atomic_exchange(&reader_running, 0)) {
+        SDL_Event wake;
+        memset(&wake, 0, sizeof(wake));
+        wake.type = SDL_USEREVENT;
+        SDL_PushEvent(&wake);
+    }
+}
+
+// Asks the reader thread to exit and wakes it if it is waiting for SDL events.
+void stop_detection() {
+    pthread_mutex_lock(&lifecycle_mutex);
+    stop_reader();
+    pthread_mutex_unlock(&lifecycle_mutex);
+}
+
+// Stops the reader thread if stop_detection() was not called and waits for
+// it; detect_devices() can start a new one. The thread is joined without
+// lifecycle_mutex, so the callback may still call stop_detection().
+void join_detection() {
+    pthread_mutex_lock(&lifecycle_mutex);
+    if (reader_joining) {
+        // Another thread is joining the reader; wait until it is done
+        while (reader_joining) {
+            pthread_cond_wait(&lifecycle_cond, &lifecycle_mutex);
+        }
+        pthread_mutex_unlock(&lifecycle_mutex);
+        return;
+    }
+    if (!reader_started) {
+        pthread_mutex_unlock(&lifecycle_mutex);
+        return;
+    }
+    stop_reader();
+    reader_joining = 1;
+    pthread_mutex_unlock(&lifecycle_mutex);
+
+    pthread_join(reader_thread, NULL);
+
+    pthread_mutex_lock(&lifecycle_mutex);
+    reader_started = 0;
+    reader_joining = 0;
+    pthread_cond_broadcast(&lifecycle_cond);
+    pthread_mutex_unlock(&lifecycle_mutex);
+}
+
+// READER_MODE_WAIT blocks in SDL_WaitEventTimeout instead of sleeping 10 ms between polls.
+void set_reader_mode(ReaderMode mode) {
+    reader_mode = mode;
+}
+
+// SCHED_FIFO/SCHED_RR priority and CPU pinning for the reader thread, before
+// or after detect_devices(). Falls back to what the process is allowed to use.
+int set_thread_config(const DeviceThreadConfig* config) {
+    if (config == NULL) {
+        return -1;
+    }
+    thread_sched_configure(DEVICE_THREAD_READER, config);
+    return 0;
+}
+
+// Policy, priority and CPUs the reader thread actually got.
+int get_thread_status(DeviceThreadStatus* status) {
+    if (status == NULL) {
+        return -1;
+    }
+    thread_sched_status(DEVICE_THREAD_READER, status);
+    return 0;
+}
+
+int lock_memory(int enable) {
+    return thread_sched_lock_memory(enable);
+}
+
+// Deadzone, hysteresis, rate limit and smoothing for one axis (or all axes
+// with axis -1) of a joystick, like device_manager_set_axis_filter() in the
+// HID library. index -1 changes the default used for every joystick,
+// including the ones connected later. Filtered axes only send an event when
+// their value after filtering changes.
+int set_axis_filter(int index, int axis, const AxisFilterConfig* config) {
+    if (config == NULL || axis >= AXIS_FILTER_MAX || index >= MAX_DEVICES) {
+        return -1;
+    }
+    pthread_mutex_lock(&devices_mutex);
+    if (index < 0) {
+        for (int j = 0; j < AXIS_FILTER_MAX; ++j) {
+            if (axis < 0 || axis == j) {
+                default_filters[j] = *config;
+            }
+        }
+        default_filters_set = 1;
+    }
+    int res = -1;
+    for (int i = index < 0 ? 0 : index; i <= (index < 0 ? MAX_DEVICES - 1 : index); ++i) {
+        if (devices[i].joystick == NULL) {
+            continue;
+        }
+        for (int j = 0; j < axis_filters[i].count; ++j) {
+            if (axis < 0 || axis == j) {
+                axis_filter_configure(&axis_filters[i], j, config);
+            }
+        }
+        axis_filtered[i] = 1;
+        res = 0;
+    }
+    pthread_mutex_unlock(&devices_mutex);
+    return index < 0 ? 0 : res;
+}
+
+// Records every delivered event to a capture file until stop_capture().
+int start_capture(const char* path) {
+    pthread_mutex_lock(&capture_mutex);
+    if (capture_enabled) {
+        capture_writer_close(&capture_writer);
+        capture_enabled = 0;
+    }
+    int res = capture_writer_open(&capture_writer, path, monotonic_ns());
+    capture_enabled = res == 0;
+    pthread_mutex_unlock(&capture_mutex);
+    return res;
+}
+
+void stop_capture() {
+    pthread_mutex_lock(&capture_mutex);
+    if (capture_enabled) {
+        capture_writer_close(&capture_writer);
+        capture_enabled = 0;
+    }
+    pthread_mutex_unlock(&capture_mutex);
+}
+
+// Same clock as DeviceEvent.timestamp, to measure how long an event took to arrive.
+unsigned int get_ticks() {
+    return SDL_GetTicks();
+}
+
 const Device* get_device(int index) {
     if (index < 0 || index >= MAX_DEVICES) {
         return NULL;
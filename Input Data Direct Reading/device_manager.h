@@ -7,6 +7,8 @@ extern "C" {
 
 #include <SDL2/SDL.h>
 #include <pthread.h>
+#include "thread_sched.h"
+#include "axis_filter.h"
 
 #define MAX_DEVICES 6
 
@@ -26,14 +28,30 @@ typedef struct {
     char event_type[32];
     char type[32];
     char value[256];
+    unsigned int timestamp;  // SDL_GetTicks() when SDL queued the event
 } DeviceEvent;
 
+typedef enum {
+    READER_MODE_POLL = 0,   // SDL_PollEvent every 10 ms
+    READER_MODE_WAIT,       // Block in SDL_WaitEventTimeout until an event arrives
+} ReaderMode;
+
 extern Device devices[MAX_DEVICES];
 extern pthread_mutex_t devices_mutex;
 
 void clean_up_devices();
 void* read_device_data(void* arg);
 void detect_devices(void (*send_data_func)(DeviceEvent));
+void stop_detection();
+void join_detection();
+void set_reader_mode(ReaderMode mode);
+int set_thread_config(const DeviceThreadConfig* config);
+int get_thread_status(DeviceThreadStatus* status);
+int lock_memory(int enable);
+int set_axis_filter(int index, int axis, const AxisFilterConfig* config);
+int start_capture(const char* path);
+void stop_capture();
+unsigned int get_ticks();
 const Device* get_device(int index);
 int get_device_count();
 